@@ -25,8 +25,9 @@ export async function GET(request: NextRequest, { params }: RouteParams) {
     const station = await prisma.chargingStation.findUnique({
       where: { id: stationId },
       include: {
-        // 获取最近 10 条遥测数据
+        // 获取最近 10 条遥测数据 (完整上报, 不含单通道序列点)
         telemetryData: {
+          where: { source: 'REPORT' },
           orderBy: { timestamp: 'desc' },
           take: 10,
         },
@@ -29,9 +29,9 @@ export async function GET(request: NextRequest, { params }: RouteParams) {
       )
     }
 
-    // 获取最新的遥测数据
+    // 获取最新的遥测数据 (只取完整上报, 序列点只有一个通道)
     const latestTelemetry = await prisma.telemetryData.findFirst({
-      where: { stationId },
+      where: { stationId, source: 'REPORT' },
       orderBy: { timestamp: 'desc' },
     })
 
@@ -40,6 +40,7 @@ export async function GET(request: NextRequest, { params }: RouteParams) {
     const historicalData = await prisma.telemetryData.findMany({
       where: {
         stationId,
+        source: 'REPORT',
         timestamp: { gte: twentyFourHoursAgo },
       },
       orderBy: { timestamp: 'asc' },
@@ -37,12 +37,14 @@ interface BackendReservation {
 // 后端返回的充电会话类型
 interface BackendChargingSession {
   id: string;
-  userId: string;
+  userId: string | null; // 设备检测到的会话没有用户
   stationId: number;
   startTime: string;
   endTime: string | null;
   energyDelivered: number | null;
   cost: number | null;
+  peakCurrent?: number | null;
+  avgCurrent?: number | null;
   station?: {
     id: number;
     name: string;
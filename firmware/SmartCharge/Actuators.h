@@ -0,0 +1,138 @@
+#ifndef ACTUATORS_H
+#define ACTUATORS_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <soc/gpio_struct.h>
+#include "Config.h"
+#include "Drivers.h"
+
+// --- Relay Bank ---
+// Responsibilities: Change-only relay actuation, Minimum on/off times, Switch counters
+// A Manager states the desired output of every relay for the tick with request(),
+// then apply() drives only the relays whose state actually changes, batched into
+// one write per GPIO set/clear register. A change is held back until the relay
+// has spent its minimum time in the current state (unless it is an urgent
+// switch-off), so a signal flapping around a threshold cannot chatter the
+// contacts. Switch counts are kept in NVS for maintenance.
+class RelayBank {
+  private:
+    struct Channel {
+      RelayDriver* driver;
+      const char* key;      // NVS key of the switch counter
+      uint32_t minOnMs;
+      uint32_t minOffMs;
+      bool desired;
+      bool urgent;          // Switch off now, ignoring minOnMs
+      uint32_t lastChangeMs;
+      uint32_t switches;
+    };
+
+    Channel _channels[RELAY_BANK_MAX];
+    uint8_t _count;
+    uint32_t _registerWrites;  // GPIO register writes issued by apply()
+    uint32_t _deferred;        // Ticks a change was held back by a minimum time
+    bool _countersDirty;
+    uint32_t _lastSaveMs;
+    Preferences _prefs;
+
+    void saveCounters() {
+      if (!_prefs.begin(RELAY_NVS_NAMESPACE, false)) return;
+      for (uint8_t i = 0; i < _count; i++) {
+        _prefs.putUInt(_channels[i].key, _channels[i].switches);
+      }
+      _prefs.end();
+      _countersDirty = false;
+    }
+
+  public:
+    RelayBank() : _count(0), _registerWrites(0), _deferred(0), _countersDirty(false), _lastSaveMs(0) {}
+
+    // Register a relay. Returns its channel index (used by request()/getSwitchCount()).
+    uint8_t add(RelayDriver* driver, const char* key, uint32_t minOnMs, uint32_t minOffMs) {
+      if (_count >= RELAY_BANK_MAX) return RELAY_BANK_MAX - 1;
+      Channel& c = _channels[_count];
+      c.driver = driver;
+      c.key = key;
+      c.minOnMs = minOnMs;
+      c.minOffMs = minOffMs;
+      c.desired = false;
+      c.urgent = false;
+      c.lastChangeMs = 0;
+      c.switches = 0;
+      return _count++;
+    }
+
+    // Call after the drivers' begin(): restores the counters and adopts the pin states
+    void begin() {
+      if (_prefs.begin(RELAY_NVS_NAMESPACE, true)) {
+        for (uint8_t i = 0; i < _count; i++) {
+          _channels[i].switches = _prefs.getUInt(_channels[i].key, 0);
+        }
+        _prefs.end();
+      }
+      uint32_t now = millis();
+      for (uint8_t i = 0; i < _count; i++) {
+        _channels[i].desired = _channels[i].driver->getState();
+        _channels[i].lastChangeMs = now - (_channels[i].minOnMs > _channels[i].minOffMs ? _channels[i].minOnMs : _channels[i].minOffMs);
+      }
+      _lastSaveMs = now;
+    }
+
+    // Desired state for this tick. The last request before apply() wins.
+    void request(uint8_t channel, bool on, bool urgent = false) {
+      _channels[channel].desired = on;
+      _channels[channel].urgent = urgent && !on;
+    }
+
+    // Drive the changed relays. Called once at the end of the owner's tick.
+    void apply() {
+      uint32_t now = millis();
+      uint32_t set0 = 0, clear0 = 0; // GPIO 0-31
+      uint32_t set1 = 0, clear1 = 0; // GPIO 32-39
+
+      for (uint8_t i = 0; i < _count; i++) {
+        Channel& c = _channels[i];
+        bool current = c.driver->getState();
+        if (c.desired == current) continue;
+
+        uint32_t minTime = current ? c.minOnMs : c.minOffMs;
+        if (!c.urgent && now - c.lastChangeMs < minTime) {
+          _deferred++;
+          continue;
+        }
+
+        uint8_t pin = c.driver->getPin();
+        uint32_t bit = 1UL << (pin & 31);
+        if (pin < 32) {
+          if (c.desired) set0 |= bit; else clear0 |= bit;
+        } else {
+          if (c.desired) set1 |= bit; else clear1 |= bit;
+        }
+
+        c.driver->setState(c.desired);
+        c.lastChangeMs = now;
+        if (c.desired) {
+          c.switches++; // One operating cycle per closing
+          _countersDirty = true;
+        }
+      }
+
+      if (set0)   { GPIO.out_w1ts = set0;       _registerWrites++; }
+      if (clear0) { GPIO.out_w1tc = clear0;     _registerWrites++; }
+      if (set1)   { GPIO.out1_w1ts.val = set1;  _registerWrites++; }
+      if (clear1) { GPIO.out1_w1tc.val = clear1; _registerWrites++; }
+
+      // Flash writes stall both cores: persist rarely
+      if (_countersDirty && now - _lastSaveMs >= RELAY_COUNTER_SAVE_MS) {
+        saveCounters();
+        _lastSaveMs = now;
+      }
+    }
+
+    uint32_t getSwitchCount(uint8_t channel) { return _channels[channel].switches; }
+    uint32_t getRegisterWrites() { return _registerWrites; }
+    uint32_t getDeferredCount() { return _deferred; }
+};
+
+#endif // ACTUATORS_H
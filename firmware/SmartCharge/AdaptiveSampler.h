@@ -0,0 +1,74 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// --- Adaptive Sampler ---
+// Responsibilities: Decide when a channel is due, Track signal activity, Back off on flat signals
+// One instance per channel. The owner calls isDue() every tick and addSample()
+// after each acquisition. A step or a noisy signal snaps the interval to the
+// channel minimum; a flat signal doubles it (SAMPLE_BACKOFF_FACTOR) up to the maximum.
+class AdaptiveSampler {
+  private:
+    uint32_t _minIntervalMs;
+    uint32_t _maxIntervalMs;
+    float _threshold;        // Activity threshold in channel units (A, W, V...)
+    uint32_t _intervalMs;
+    uint32_t _lastSampleMs;
+    float _lastValue;
+    float _mean;             // EWMA mean
+    float _variance;         // EWMA variance
+    bool _hasValue;
+
+    static constexpr float kAlpha = 0.25f; // EWMA weight of the newest sample
+
+  public:
+    AdaptiveSampler(uint32_t minIntervalMs, uint32_t maxIntervalMs, float threshold)
+      : _minIntervalMs(minIntervalMs), _maxIntervalMs(maxIntervalMs), _threshold(threshold) {
+        _intervalMs = minIntervalMs;
+        _lastSampleMs = 0;
+        _lastValue = 0.0f;
+        _mean = 0.0f;
+        _variance = 0.0f;
+        _hasValue = false;
+    }
+
+    bool isDue(uint32_t nowMs) {
+      return !_hasValue || (nowMs - _lastSampleMs) >= _intervalMs;
+    }
+
+    void addSample(float value, uint32_t nowMs) {
+      _lastSampleMs = nowMs;
+
+      if (!_hasValue) {
+        _hasValue = true;
+        _lastValue = value;
+        _mean = value;
+        return;
+      }
+
+      // Rate of change (per sample) and EWMA variance
+      float delta = fabsf(value - _lastValue);
+      float diff = value - _mean;
+      _mean += kAlpha * diff;
+      _variance = (1.0f - kAlpha) * (_variance + kAlpha * diff * diff);
+      _lastValue = value;
+
+      if (delta > _threshold || _variance > _threshold * _threshold) {
+        _intervalMs = _minIntervalMs; // Active: sample as fast as allowed
+      } else if (_intervalMs < _maxIntervalMs) {
+        uint32_t next = _intervalMs * SAMPLE_BACKOFF_FACTOR;
+        _intervalMs = next > _maxIntervalMs ? _maxIntervalMs : next;
+      }
+    }
+
+    // Force the fastest rate, e.g. when the relay is about to switch
+    void boost() {
+      _intervalMs = _minIntervalMs;
+    }
+
+    uint32_t getIntervalMs() { return _intervalMs; }
+};
+
+#endif // ADAPTIVE_SAMPLER_H
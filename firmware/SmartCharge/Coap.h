@@ -0,0 +1,219 @@
+#ifndef COAP_H
+#define COAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// --- CoAP Message Format (RFC 7252) ---
+// Plain C++ so the host tools (tools/loadgen) share it. The gateway side is
+// lib/iot/coap.ts; keep both in sync.
+//
+//   Ver(2) T(2) TKL(4) | Code (class.detail, 3+5 bits) | Message ID (16)
+//   | Token (0-8 bytes) | Options (delta-encoded, ascending) | 0xFF | Payload
+enum CoapType : uint8_t {
+  COAP_CON = 0,
+  COAP_NON,
+  COAP_ACK,
+  COAP_RST
+};
+
+#define COAP_CODE(cls, detail) (uint8_t)(((cls) << 5) | (detail))
+#define COAP_EMPTY                    0
+#define COAP_POST                     COAP_CODE(0, 2)
+#define COAP_CHANGED                  COAP_CODE(2, 4)
+#define COAP_CONTINUE                 COAP_CODE(2, 31) // Block1: send the next block
+#define COAP_REQUEST_ENTITY_TOO_LARGE COAP_CODE(4, 13)
+#define COAP_CODE_CLASS(code)         ((code) >> 5)
+
+#define COAP_OPT_URI_PATH       11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_URI_QUERY      15
+#define COAP_OPT_BLOCK1         27 // RFC 7959
+#define COAP_OPT_SIZE1          60
+
+#define COAP_FORMAT_JSON  50
+#define COAP_MAX_TOKEN    8
+#define COAP_HEADER_BYTES 4
+
+// Block1 option value: NUM(4-20 bits) | M(1) | SZX(3), block size 2^(SZX + 4)
+inline uint32_t coapBlock1(uint32_t num, bool more, uint8_t szx) {
+  return (num << 4) | (more ? 0x08 : 0) | (szx & 0x07);
+}
+inline size_t coapBlockSize(uint8_t szx) { return (size_t)16 << szx; }
+
+// Minimal-length big-endian unsigned option value
+inline uint32_t coapUint(const uint8_t* value, uint16_t length) {
+  uint32_t v = 0;
+  for (uint16_t i = 0; i < length && i < 4; i++) v = (v << 8) | value[i];
+  return v;
+}
+
+// --- CoAP Writer ---
+// Responsibilities: Serialize one message into a caller-owned buffer
+// Options must be added in ascending number order. Overflow is sticky: check
+// ok() once at the end instead of after every call.
+class CoapWriter {
+  private:
+    uint8_t* _buf;
+    size_t _cap;
+    size_t _len;
+    uint16_t _lastOption;
+    bool _overflow;
+
+    void put(uint8_t b) {
+      if (_len < _cap) _buf[_len++] = b;
+      else _overflow = true;
+    }
+
+    void put(const uint8_t* p, size_t n) {
+      if (_len + n > _cap) {
+        _overflow = true;
+        return;
+      }
+      memcpy(_buf + _len, p, n);
+      _len += n;
+    }
+
+    // 4-bit field with 8/16-bit extension (13: +13, 14: +269)
+    static uint8_t nibble(uint16_t v) { return v < 13 ? v : (v < 269 ? 13 : 14); }
+    void putExtension(uint16_t v) {
+      if (v >= 269) {
+        put((uint8_t)((v - 269) >> 8));
+        put((uint8_t)(v - 269));
+      } else if (v >= 13) {
+        put((uint8_t)(v - 13));
+      }
+    }
+
+  public:
+    CoapWriter(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap), _len(0), _lastOption(0), _overflow(false) {}
+
+    void header(uint8_t type, uint8_t code, uint16_t messageId, const uint8_t* token, uint8_t tokenLength) {
+      _len = 0;
+      _lastOption = 0;
+      _overflow = tokenLength > COAP_MAX_TOKEN;
+      put((uint8_t)(0x40 | (type << 4) | (tokenLength & 0x0F)));
+      put(code);
+      put((uint8_t)(messageId >> 8));
+      put((uint8_t)messageId);
+      put(token, tokenLength);
+    }
+
+    void option(uint16_t number, const uint8_t* value, uint16_t length) {
+      if (number < _lastOption) {
+        _overflow = true;
+        return;
+      }
+      uint16_t delta = number - _lastOption;
+      put((uint8_t)((nibble(delta) << 4) | nibble(length)));
+      putExtension(delta);
+      putExtension(length);
+      put(value, length);
+      _lastOption = number;
+    }
+
+    void option(uint16_t number, const char* value) {
+      option(number, (const uint8_t*)value, (uint16_t)strlen(value));
+    }
+
+    void optionUint(uint16_t number, uint32_t value) {
+      uint8_t bytes[4];
+      uint8_t n = 0;
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        if (n > 0 || (value >> shift) & 0xFF) bytes[n++] = (uint8_t)(value >> shift);
+      }
+      option(number, bytes, n); // 0 is the empty value
+    }
+
+    void payload(const uint8_t* data, size_t length) {
+      if (length == 0) return;
+      put(0xFF);
+      put(data, length);
+    }
+
+    size_t length() const { return _len; }
+    bool ok() const { return !_overflow; }
+};
+
+// --- CoAP Message View ---
+// Parsed header with pointers into the received datagram (valid while it is)
+struct CoapView {
+  uint8_t type;
+  uint8_t code;
+  uint16_t messageId;
+  const uint8_t* token;
+  uint8_t tokenLength;
+  const uint8_t* options; // Raw option bytes, walk with coapNextOption()
+  size_t optionsLength;
+  const uint8_t* payload;
+  size_t payloadLength;
+};
+
+// Decode the option at p (previous option number in/out). False at the end or on bad input.
+inline bool coapNextOption(const uint8_t*& p, const uint8_t* end, uint16_t& number,
+                           const uint8_t*& value, uint16_t& length) {
+  if (p >= end || *p == 0xFF) return false;
+  const uint8_t* q = p; // p only moves past a complete option
+  uint16_t fields[2] = { (uint16_t)(*q >> 4), (uint16_t)(*q & 0x0F) };
+  q++;
+  for (uint8_t i = 0; i < 2; i++) {
+    if (fields[i] == 13) {
+      if (q + 1 > end) return false;
+      fields[i] = *q++ + 13;
+    } else if (fields[i] == 14) {
+      if (q + 2 > end) return false;
+      fields[i] = (uint16_t)(((q[0] << 8) | q[1]) + 269);
+      q += 2;
+    } else if (fields[i] == 15) {
+      return false;
+    }
+  }
+  if (q + fields[1] > end) return false;
+  number += fields[0];
+  value = q;
+  length = fields[1];
+  p = q + length;
+  return true;
+}
+
+inline bool coapParse(const uint8_t* buf, size_t len, CoapView& out) {
+  if (len < COAP_HEADER_BYTES || (buf[0] >> 6) != 1) return false;
+  out.type = (buf[0] >> 4) & 0x03;
+  out.tokenLength = buf[0] & 0x0F;
+  out.code = buf[1];
+  out.messageId = (uint16_t)((buf[2] << 8) | buf[3]);
+  if (out.tokenLength > COAP_MAX_TOKEN || (size_t)(COAP_HEADER_BYTES + out.tokenLength) > len) return false;
+  out.token = buf + COAP_HEADER_BYTES;
+
+  const uint8_t* p = out.token + out.tokenLength;
+  const uint8_t* end = buf + len;
+  out.options = p;
+  uint16_t number = 0;
+  const uint8_t* value;
+  uint16_t length;
+  while (coapNextOption(p, end, number, value, length)) {}
+  out.optionsLength = p - out.options;
+  out.payload = NULL;
+  out.payloadLength = 0;
+  if (p < end) {
+    if (*p != 0xFF || p + 1 == end) return false; // Bad option or marker without payload
+    out.payload = p + 1;
+    out.payloadLength = end - out.payload;
+  }
+  return true;
+}
+
+// First option with this number
+inline bool coapFindOption(const CoapView& m, uint16_t number, const uint8_t*& value, uint16_t& length) {
+  const uint8_t* p = m.options;
+  const uint8_t* end = m.options + m.optionsLength;
+  uint16_t current = 0;
+  while (coapNextOption(p, end, current, value, length)) {
+    if (current == number) return true;
+    if (current > number) break;
+  }
+  return false;
+}
+
+#endif // COAP_H
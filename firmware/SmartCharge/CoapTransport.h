@@ -0,0 +1,158 @@
+#ifndef COAP_TRANSPORT_H
+#define COAP_TRANSPORT_H
+
+#include "Config.h"
+
+#if ENABLE_WIFI && ENABLE_COAP
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "Coap.h"
+#include "Log.h"
+
+// Exchange metrics (reported with telemetry)
+struct CoapStats {
+  uint32_t requests;        // post() calls
+  uint32_t datagrams;       // Requests on the air, retransmissions and blocks included
+  uint32_t retransmissions;
+  uint32_t timeouts;        // Requests abandoned after COAP_MAX_RETRANSMIT
+  uint32_t lastRttMs;       // Last post(), first datagram to final response
+};
+
+// --- CoAP Client ---
+// Responsibilities: Confirmable POST over UDP, Retransmission, Block-wise request bodies
+// One request at a time from the IoT job. Each datagram is sent as CON and
+// retransmitted with a randomized, doubling timeout (RFC 7252 §4.2) until the
+// gateway (scripts/coap-gateway.ts) piggybacks its response on the ACK. Bodies
+// larger than one block go out as a Block1 transfer (RFC 7959); if the gateway
+// asks for smaller blocks, the rest of the transfer (and later ones) use its size.
+// The gateway answers retransmissions from a cache, so a lost ACK never stores
+// a report twice. Plain UDP: there is no DTLS (see ENABLE_TLS in Config.h).
+class CoapClient {
+  private:
+    WiFiUDP _udp;
+    const char* _host;
+    uint16_t _port;
+    IPAddress _ip;
+    bool _started;
+    uint16_t _messageId;
+    uint8_t _szx;
+    uint8_t _token[4];
+    CoapStats _stats;
+
+    uint8_t _tx[COAP_HEADER_BYTES + COAP_MAX_TOKEN + 96 + 1 + (16 << COAP_BLOCK_SZX)];
+    uint8_t _rx[COAP_HEADER_BYTES + COAP_MAX_TOKEN + 32 + 1 + COAP_RESPONSE_BYTES];
+
+    // Send _tx[0..len) and wait for the ACK carrying the response.
+    // Other datagrams (late ACKs of earlier requests) are skipped.
+    bool exchange(size_t len, uint16_t messageId, CoapView& response) {
+      uint32_t timeoutMs = COAP_ACK_TIMEOUT_MS + esp_random() % (COAP_ACK_TIMEOUT_MS / 2 + 1); // ACK_RANDOM_FACTOR 1.5
+      for (uint8_t attempt = 0; attempt <= COAP_MAX_RETRANSMIT; attempt++) {
+        if (attempt > 0) _stats.retransmissions++;
+        _udp.beginPacket(_ip, _port);
+        _udp.write(_tx, len);
+        _udp.endPacket();
+        _stats.datagrams++;
+
+        uint32_t sentMs = millis();
+        while (millis() - sentMs < timeoutMs) {
+          int n = _udp.parsePacket();
+          if (n <= 0) {
+            delay(2);
+            continue;
+          }
+          n = _udp.read(_rx, sizeof(_rx));
+          if (n <= 0 || !coapParse(_rx, n, response) || response.messageId != messageId) continue;
+          if (response.type == COAP_RST) return false;
+          if (response.type == COAP_ACK && response.code != COAP_EMPTY &&
+              response.tokenLength == sizeof(_token) && memcmp(response.token, _token, sizeof(_token)) == 0) {
+            return true;
+          }
+        }
+        timeoutMs *= 2;
+      }
+      _stats.timeouts++;
+      return false;
+    }
+
+  public:
+    CoapClient(const char* host, uint16_t port)
+      : _host(host), _port(port), _started(false), _messageId(0), _szx(COAP_BLOCK_SZX) {
+        memset(&_stats, 0, sizeof(_stats));
+      }
+
+    // POST body to coap://host/path?query ("a/b/c", "k=v"). Returns the response
+    // code (0: no response) and copies up to responseCap - 1 payload bytes into
+    // `response`, NUL-terminated.
+    uint8_t post(const char* path, const char* query, const uint8_t* body, size_t len,
+                 char* response, size_t responseCap) {
+      response[0] = '\0';
+      if (!_started) {
+        if (!WiFi.hostByName(_host, _ip) || !_udp.begin(COAP_LOCAL_PORT)) return 0;
+        _messageId = (uint16_t)esp_random(); // Random start (RFC 7252 §4.4)
+        _started = true;
+      }
+      _stats.requests++;
+      uint32_t token = esp_random(); // One token for every block of this request
+      memcpy(_token, &token, sizeof(_token));
+      uint32_t startMs = millis();
+
+      size_t offset = 0;
+      uint32_t num = 0;
+      bool blockwise = len > coapBlockSize(_szx);
+      CoapView res;
+      while (true) {
+        size_t chunk = blockwise ? coapBlockSize(_szx) : len;
+        if (chunk > len - offset) chunk = len - offset;
+        bool more = offset + chunk < len;
+        uint16_t messageId = _messageId++;
+
+        CoapWriter w(_tx, sizeof(_tx));
+        w.header(COAP_CON, COAP_POST, messageId, _token, sizeof(_token));
+        char segment[32];
+        for (const char* p = path; *p; ) {
+          const char* slash = strchr(p, '/');
+          size_t n = slash ? (size_t)(slash - p) : strlen(p);
+          if (n >= sizeof(segment)) n = sizeof(segment) - 1;
+          memcpy(segment, p, n);
+          segment[n] = '\0';
+          w.option(COAP_OPT_URI_PATH, segment);
+          p += slash ? (slash - p) + 1 : strlen(p);
+        }
+        w.optionUint(COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_JSON);
+        w.option(COAP_OPT_URI_QUERY, query);
+        if (blockwise) {
+          w.optionUint(COAP_OPT_BLOCK1, coapBlock1(num, more, _szx));
+          if (num == 0) w.optionUint(COAP_OPT_SIZE1, len); // Lets the gateway refuse early
+        }
+        w.payload(body + offset, chunk);
+        if (!w.ok()) {
+          LOG_E("CoAP: request does not fit %u bytes", (unsigned)sizeof(_tx));
+          return 0;
+        }
+
+        if (!exchange(w.length(), messageId, res)) return 0;
+        if (!blockwise || !more || res.code != COAP_CONTINUE) break;
+
+        // 2.31 Continue: the gateway may ask for a smaller block size
+        const uint8_t* value;
+        uint16_t vlen;
+        offset += chunk;
+        if (coapFindOption(res, COAP_OPT_BLOCK1, value, vlen)) {
+          uint8_t szx = coapUint(value, vlen) & 0x07;
+          if (szx < _szx) _szx = szx;
+        }
+        num = offset / coapBlockSize(_szx);
+      }
+
+      _stats.lastRttMs = millis() - startMs;
+      size_t n = res.payloadLength < responseCap - 1 ? res.payloadLength : responseCap - 1;
+      if (n > 0) memcpy(response, res.payload, n);
+      response[n] = '\0';
+      return res.code;
+    }
+
+    const CoapStats& getStats() { return _stats; }
+};
+#endif // ENABLE_WIFI && ENABLE_COAP
+
+#endif // COAP_TRANSPORT_H
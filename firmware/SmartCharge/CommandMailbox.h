@@ -0,0 +1,73 @@
+#ifndef COMMAND_MAILBOX_H
+#define COMMAND_MAILBOX_H
+
+#include <string.h>
+#include "Config.h"
+#include "MpscQueue.h"
+
+// Who issued a command; acknowledgements go back the same way
+enum CommandSource : uint8_t {
+  CMD_SOURCE_SERVER, // DeviceCommand via HTTP (acked in the next telemetry report)
+  CMD_SOURCE_MQTT,   // Home Assistant (acked on MQTT_TOPIC_ACK)
+  CMD_SOURCE_LOCAL   // Button (no acknowledgement)
+};
+
+#define CMD_ACK_SOURCES 2 // Sources with an acknowledgement queue
+
+enum CommandAction : uint8_t {
+  CMD_CHARGE_ON,
+  CMD_CHARGE_OFF,
+  CMD_CHARGE_TOGGLE
+};
+
+enum AckResult : uint8_t {
+  ACK_APPLIED,    // The main relay reached the requested state
+  ACK_SUPERSEDED, // A newer command arrived before the relay switched
+  ACK_REJECTED    // Not allowed (safety cutoff)
+};
+
+inline const char* commandActionName(CommandAction a) {
+  switch (a) {
+    case CMD_CHARGE_ON:  return "ON";
+    case CMD_CHARGE_OFF: return "OFF";
+    default:             return "TOGGLE";
+  }
+}
+
+inline const char* ackResultName(AckResult r) {
+  switch (r) {
+    case ACK_APPLIED:    return "APPLIED";
+    case ACK_SUPERSEDED: return "SUPERSEDED";
+    default:             return "REJECTED";
+  }
+}
+
+// Posted by the Services / InterfaceManager, consumed by PowerManager::update()
+struct PowerCommand {
+  uint32_t id;         // Device-local sequence number
+  uint32_t issuedMs;   // millis() when the command was posted
+  CommandAction action;
+  CommandSource source;
+  char ref[CMD_REF_BYTES]; // Server DeviceCommand id ("" for MQTT/button)
+
+  void setRef(const char* r) {
+    strncpy(ref, r ? r : "", sizeof(ref) - 1);
+    ref[sizeof(ref) - 1] = '\0';
+  }
+};
+
+// Emitted by PowerManager::update() once the outcome is known
+struct CommandAck {
+  uint32_t id;
+  uint32_t actuatedMs; // millis() when the outcome was decided
+  uint32_t latencyMs;  // issuedMs -> actuatedMs
+  CommandAction action;
+  AckResult result;
+  bool relayOn;        // Main relay state when the outcome was decided
+  char ref[CMD_REF_BYTES];
+};
+
+typedef MpscQueue<PowerCommand, CMD_MAILBOX_SIZE> CommandMailbox;
+typedef MpscQueue<CommandAck, CMD_ACK_QUEUE_SIZE> AckQueue;
+
+#endif // COMMAND_MAILBOX_H
@@ -37,15 +37,24 @@
 // For production: use your Vercel deployment URL
 #define API_BASE_URL        "http://172.20.10.3:3000"  // Your PC's WLAN IP
 #define STATION_ID          1                            // Database station ID (integer)
+#define API_BASE_URL_TLS    "https://172.20.10.3:3443" // Used when ENABLE_TLS (tools/tls-standin)
 #define IOT_API_KEY         "smartcharge-neo-secret-key-2024"  // Must match .env.local IOT_API_KEY
 
 // --- MQTT Configuration (for Home Assistant) ---
 #define MQTT_SERVER         "172.20.10.3"       // Your PC's WLAN IP (same as API)
 #define MQTT_PORT           1883
+#define MQTT_PORT_TLS       8883
 #define MQTT_CLIENT_ID      "smartcharge-station1"
 #define MQTT_TOPIC_STATE    "smartcharge/station1/state"
 #define MQTT_TOPIC_CMD      "smartcharge/station1/set"
 #define MQTT_TOPIC_AVAIL    "smartcharge/station1/availability"
+#define MQTT_TOPIC_CAPTURE  "smartcharge/station1/capture"
+#define MQTT_TOPIC_ACK      "smartcharge/station1/ack"
+#define MQTT_TOPIC_TRACE    "smartcharge/station1/trace"
+
+// --- CoAP Configuration (scripts/coap-gateway.ts) ---
+#define COAP_SERVER         "172.20.10.3"       // Your PC's WLAN IP (same as API)
+#define COAP_PORT           5683
 
 // --- Feature Toggles ---
 // Set to 1 to enable, 0 to disable
@@ -56,9 +65,154 @@
 #define ENABLE_BUTTON     0 // Enable User Button input
 #define ENABLE_LED        0 // Enable Status LED breathing/indication
 #define ENABLE_SOLAR      0 // Enable EPEVER Solar Controller (Modbus)
+#define ENABLE_SERIES_UPLOAD 1 // Upload compressed high-resolution series with telemetry
+#define ENABLE_CAPTURE    1 // Enable on-demand raw current waveform capture
+#define ENABLE_AGGREGATES 1 // Report per-window min/max/mean/variance/p50/p95 with telemetry
+#define ENABLE_TLS        0 // Use TLS (pinned CA, session resumption) for HTTP and MQTT
+#define ENABLE_TRACE      1 // Record driver inputs for host replay (firmware/tools/replay)
+#define ENABLE_COAP       0 // Send telemetry as CoAP over UDP instead of HTTP (no TLS)
+#define ENABLE_SESSIONS   1 // Detect charging sessions from the current and report start/end events
+#define ENABLE_LOW_POWER  0 // Light sleep between jobs, slower jobs while idle (core with CONFIG_PM_ENABLE)
+#define ENABLE_CLOCK_SYNC 1 // SNTP-disciplined device clock: samples carry their acquisition time
+
+// --- TLS (see TlsTransport.h) ---
+// Only this CA is trusted. For the local stand-ins, paste the output of
+// firmware/tools/tls-standin/gen-certs.sh (out/ca.pem) here.
+#define TLS_CA_CERT \
+  "-----BEGIN CERTIFICATE-----\n" \
+  "REPLACE_WITH_YOUR_CA_CERTIFICATE\n" \
+  "-----END CERTIFICATE-----\n"
+#define TLS_HANDSHAKE_TIMEOUT_MS 10000
+
+#if ENABLE_TLS
+  #define API_URL           API_BASE_URL_TLS
+  #define MQTT_BROKER_PORT  MQTT_PORT_TLS
+#else
+  #define API_URL           API_BASE_URL
+  #define MQTT_BROKER_PORT  MQTT_PORT
+#endif
+
+#if ENABLE_COAP && ENABLE_TLS
+  #warning "ENABLE_COAP sends telemetry without TLS (no DTLS support); MQTT still uses TLS"
+#endif
+
+// --- CoAP Transport (see CoapTransport.h) ---
+#define COAP_BLOCK_SZX      4     // Block1 size 2^(4+4) = 256 bytes (fits one 802.11 frame easily)
+#define COAP_ACK_TIMEOUT_MS 1000  // First retransmission after 1-1.5 s, then doubling
+#define COAP_MAX_RETRANSMIT 2     // Datagram attempts = 1 + retransmissions (IoT job period bounds it)
+#define COAP_RESPONSE_BYTES 128   // Piggybacked response payload ({command, commandId})
+#define COAP_LOCAL_PORT     5683
 
 // --- Task Timing (Milliseconds) ---
+// Jobs are released on absolute ticks by the Scheduler (see Scheduler.h).
+// Deadline 0 means the deadline equals the period.
 #define HARDWARE_LOOP_DELAY 20   // 50Hz for smooth LED & responsive button
+#define SOLAR_READ_PERIOD   1000 // Fastest EPEVER Modbus poll (actual rate is adaptive)
 #define NETWORK_LOOP_DELAY  5000 // 5s Telemetry interval
+#define MQTT_LOOP_PERIOD    100  // MQTT keep-alive & incoming commands
+
+// --- Adaptive Sampling (see AdaptiveSampler.h) ---
+// Per channel: fastest interval, slowest interval (ms), activity threshold
+#define CURRENT_SAMPLE_MIN_MS   HARDWARE_LOOP_DELAY
+#define CURRENT_SAMPLE_MAX_MS   1000 // Idle station only: under load the current is read every tick
+#define CURRENT_ACTIVITY_THRESH 0.10f  // A
+#define PV_SAMPLE_MIN_MS        SOLAR_READ_PERIOD
+#define PV_SAMPLE_MAX_MS        60000
+#define PV_ACTIVITY_THRESH      5.0f   // W
+#define BATT_SAMPLE_MIN_MS      SOLAR_READ_PERIOD
+#define BATT_SAMPLE_MAX_MS      60000
+#define BATT_ACTIVITY_THRESH    0.05f  // V
+#define SAMPLE_BACKOFF_FACTOR   2      // Interval multiplier while the signal is flat
+
+// --- Compressed Series Upload (see SeriesCompressor.h) ---
+#define SERIES_BLOCK_BYTES  256   // One Gorilla block per channel buffer
+#define SERIES_MAX_AGE_MS   30000 // Seal a partially filled block after this long
+
+// --- Waveform Capture (see WaveformCapture.h) ---
+#define CAPTURE_SAMPLES       1024  // Raw samples kept (4 bytes each: value + dt)
+#define CAPTURE_PRE_SAMPLES   256   // History required before a manual trigger fires
+#define CAPTURE_POST_SAMPLES  768   // Recorded back-to-back after the trigger
+#define CAPTURE_TRIGGER_AMPS  2.0f  // |I| threshold used by the CAPTURE_ARM command
+#define CAPTURE_CHUNK_SAMPLES 48    // Samples per MQTT chunk (fits the 512 B buffer)
+
+// --- MQTT Outbox (see MqttOutbox.h) ---
+#define MQTT_OUTBOX_SLOTS    8     // Messages held while the broker is slow or away
+#define MQTT_OUTBOX_PAYLOAD  512   // Max payload per message (bytes)
+#define MQTT_INFLIGHT_WINDOW 2     // Unacknowledged QoS 1 messages on the wire
+#define MQTT_RETRY_MS        5000  // Resend a QoS 1 message without PUBACK after this long
+#define MQTT_STATE_QOS       1
+#define MQTT_CAPTURE_QOS     1
+
+// --- Relay Actuation (see Actuators.h) ---
+#define RELAY_BANK_MAX         4
+#define RELAY_MAIN_MIN_ON_MS   2000   // Contactor: no chatter from button bounce / command bursts
+#define RELAY_MAIN_MIN_OFF_MS  2000
+#define RELAY_FAN_MIN_ON_MS    10000  // Fan keeps running through short dips below the limit
+#define RELAY_FAN_MIN_OFF_MS   5000
+#define RELAY_NVS_NAMESPACE    "relays"
+#define RELAY_COUNTER_SAVE_MS  600000 // Persist switch counters at most every 10 min
+
+// --- Command Mailbox (see CommandMailbox.h) ---
+#define CMD_MAILBOX_SIZE    8   // Commands waiting for the Power job (power of two)
+#define CMD_ACK_QUEUE_SIZE  8   // Acknowledgements waiting per source (power of two)
+#define CMD_REF_BYTES       32  // Server DeviceCommand id (cuid)
+#define CMD_ACK_BATCH       8   // Acknowledgements carried per telemetry report
+
+// --- Charging Sessions (see SessionDetector.h) ---
+#define SESSION_FILTER_TAU_MS    2000   // Low-pass time constant of the current profile
+#define SESSION_START_AMPS       1.0f   // Filtered current above this...
+#define SESSION_START_MS         10000  // ...for this long opens a session
+#define SESSION_END_AMPS         0.5f   // Filtered current below this...
+#define SESSION_END_MS           60000  // ...for this long closes it (EVs pause while balancing)
+#define SESSION_SUPPLY_VOLTAGE   230.0f // V at the outlet: energy = V x integral of I dt
+#define SESSION_EVENT_QUEUE_SIZE 8      // Events waiting for the IoT job (power of two)
+#define SESSION_EVENT_BATCH      4      // Events carried per telemetry report
+
+// --- Device Clock (see DeviceClock.h) ---
+#define NTP_SERVER                  "pool.ntp.org"
+#define CLOCK_SYNC_INTERVAL_MS      900000 // SNTP update every 15 min
+#define CLOCK_STEP_MS               200    // Larger errors are stepped, smaller ones slewed
+#define CLOCK_SLEW_PPM              500    // Slew rate (200 ms takes 400 s)
+#define CLOCK_MAX_DRIFT_PPM         200    // Crystal tolerance bound for the drift estimate
+#define CLOCK_DRIFT_GAIN            4      // Drift EWMA weight 1/4 per update
+#define CLOCK_MIN_DRIFT_INTERVAL_MS 60000  // Shorter update intervals are too noisy for drift
+
+// --- Telemetry Bus (see TelemetryBus.h) ---
+#define TELEMETRY_PUBLISH_PERIOD_MS 1000 // Station snapshot posted to every sink (hardware core)
+#define TELEMETRY_MAX_SINKS         4
+#define TELEMETRY_SINK_DEPTH_MAX    8    // Records one sink can queue
+#define MQTT_STATE_PERIOD_MS        5000 // State messages for Home Assistant
+#define MQTT_STATE_DEPTH            4    // Kept while the outbox is full, oldest dropped first
+
+// --- Trace Recorder (see TraceRecorder.h) ---
+#define TRACE_RING_RECORDS  1024  // 12 bytes each; newest inputs kept
+#define TRACE_SNAPSHOT_MS   5000  // PowerManager state record (replay start / check points)
+#define TRACE_CHUNK_RECORDS 24    // Records per MQTT chunk (fits the 512 B buffer)
+#ifndef TRACE_REPLAY
+  #define TRACE_REPLAY      0     // Set by tools/replay: drivers read the trace, not the hardware
+#endif
+
+// --- Logging (see Log.h) ---
+#define LOG_LEVEL        LOG_LEVEL_INFO // NONE, ERROR, WARN, INFO, DEBUG: higher levels are compiled out
+#define LOG_RING_SIZE    64   // Records (power of two), kept in RTC memory across resets
+#define LOG_DRAIN_PERIOD 100  // Background job formatting records to Serial
+#define LOG_DRAIN_BATCH  16   // Max records printed per release
+#define LOG_LINE_BYTES   128  // Formatted line length
+
+// --- Low Power (see LowPower.h) ---
+#define PM_MAX_FREQ_MHZ         240
+#define PM_MIN_FREQ_MHZ         40    // XTAL when both cores are idle (between light sleeps)
+#define PM_WIFI_LISTEN_INTERVAL 3     // Modem wakes for every 3rd DTIM beacon
+#define PM_IDLE_PERIOD_MS       250   // Interface/Power/MQTT/Log period while the station is idle
+#define PM_IDLE_MAX_AMPS        0.5f  // Measured current below this counts as idle
+#define PM_WAKE_HOLD_MS         2000  // Full rate after the button wakes the Interface job
+#define PM_REPORT_PERIOD_MS     60000 // Duty cycle log (active/idle/sleep per job)
+
+// --- Scheduler ---
+#define SCHED_MAX_JOBS      10
+#define SCHED_BASE_PRIORITY 2    // Priority of the slowest job on each core
+#define SCHED_BACKGROUND_PRIORITY 1 // Background jobs (log drain)
+#define HARDWARE_CORE       1
+#define NETWORK_CORE        0
 
 #endif // CONFIG_H
@@ -0,0 +1,152 @@
+#ifndef DEVICE_CLOCK_H
+#define DEVICE_CLOCK_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Log.h"
+
+#if ENABLE_WIFI && ENABLE_CLOCK_SYNC
+#include <esp_sntp.h>
+#endif
+
+// Discipline metrics (reported with telemetry)
+struct ClockStats {
+  uint32_t syncs;      // SNTP updates received
+  uint32_t steps;      // Updates applied as a jump (first sync, error > CLOCK_STEP_MS)
+  int32_t lastErrorUs; // SNTP time minus the model's prediction at the last update
+  int32_t driftPpb;    // Estimated rate error of the local counter (+: runs slow)
+};
+
+// --- Device Clock ---
+// Responsibilities: Monotonic microsecond time base, SNTP discipline, Drift estimation
+// Samples are stamped with esp_timer_get_time() (monotonic, keeps counting in
+// light sleep) where they are acquired, and converted to Unix time only when a
+// report is built. The conversion is a piecewise-linear model fitted to the
+// SNTP updates: a small error is slewed out at CLOCK_SLEW_PPM so converted
+// times never jump or run backwards, a large one is stepped. The residual
+// error left after each update interval feeds the drift estimate (EWMA), so
+// the model keeps tracking the crystal between updates.
+class DeviceClock {
+  private:
+    static DeviceClock* _instance; // SNTP notification callback
+
+    portMUX_TYPE _lock;
+    bool _synced;
+    int64_t _anchorMono;  // Model: unix = anchorUnix + dm + dm * rate (dm = mono - anchorMono)
+    int64_t _anchorUnix;
+    int64_t _ratePpb;     // Drift plus slew, until _slewEndMono
+    int64_t _slewEndMono;
+    int64_t _driftPpb;
+    int64_t _lastSyncMono;
+    uint8_t _driftSamples;
+    ClockStats _stats;
+
+    static int64_t scale(int64_t us, int64_t ppb) { return us * ppb / 1000000000LL; }
+
+    int64_t predict(int64_t mono) const {
+      if (mono > _slewEndMono && _slewEndMono > _anchorMono) {
+        int64_t slew = _slewEndMono - _anchorMono;
+        int64_t after = mono - _slewEndMono;
+        return _anchorUnix + slew + scale(slew, _ratePpb) + after + scale(after, _driftPpb);
+      }
+      int64_t dm = mono - _anchorMono;
+      return _anchorUnix + dm + scale(dm, _ratePpb);
+    }
+
+    static int64_t clamp(int64_t v, int64_t limit) { return v > limit ? limit : (v < -limit ? -limit : v); }
+
+    #if ENABLE_WIFI && ENABLE_CLOCK_SYNC
+      // lwIP task, right after SNTP has set the system time
+      static void onSntp(struct timeval* tv) {
+        int64_t mono = esp_timer_get_time();
+        if (_instance) _instance->update(mono, (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec);
+      }
+    #endif
+
+  public:
+    DeviceClock() : _synced(false), _anchorMono(0), _anchorUnix(0), _ratePpb(0), _slewEndMono(0),
+                    _driftPpb(0), _lastSyncMono(0), _driftSamples(0) {
+      _lock = portMUX_INITIALIZER_UNLOCKED;
+      memset(&_stats, 0, sizeof(_stats));
+    }
+
+    // Start SNTP. Call once Wi-Fi is up (the client retries until it gets an answer).
+    void begin() {
+      #if ENABLE_WIFI && ENABLE_CLOCK_SYNC
+        _instance = this;
+        sntp_set_sync_interval(CLOCK_SYNC_INTERVAL_MS);
+        sntp_set_time_sync_notification_cb(onSntp);
+        configTime(0, 0, NTP_SERVER);
+      #endif
+    }
+
+    // One SNTP measurement: `unixUs` was the time at monotonic `mono`
+    void update(int64_t mono, int64_t unixUs) {
+      portENTER_CRITICAL(&_lock);
+      _stats.syncs++;
+      if (!_synced) {
+        _synced = true;
+        _anchorMono = _slewEndMono = _lastSyncMono = mono;
+        _anchorUnix = unixUs;
+        _ratePpb = _driftPpb;
+        _stats.steps++;
+        _stats.lastErrorUs = 0;
+        portEXIT_CRITICAL(&_lock);
+        return;
+      }
+
+      int64_t predicted = predict(mono);
+      int64_t error = unixUs - predicted;
+      bool step = error > (int64_t)CLOCK_STEP_MS * 1000 || error < -(int64_t)CLOCK_STEP_MS * 1000;
+
+      // Whatever the model missed over the interval is rate error
+      int64_t interval = mono - _lastSyncMono;
+      if (!step && interval >= (int64_t)CLOCK_MIN_DRIFT_INTERVAL_MS * 1000) {
+        if (_driftSamples < CLOCK_DRIFT_GAIN) _driftSamples++; // Plain average until the EWMA window is full
+        _driftPpb += error * 1000000000LL / interval / _driftSamples;
+        _driftPpb = clamp(_driftPpb, (int64_t)CLOCK_MAX_DRIFT_PPM * 1000);
+      }
+      _lastSyncMono = mono;
+
+      _anchorMono = mono;
+      if (step) {
+        _anchorUnix = unixUs;
+        _ratePpb = _driftPpb;
+        _slewEndMono = mono;
+        _stats.steps++;
+      } else {
+        // Continue from the prediction and run fast/slow until the error is gone
+        _anchorUnix = predicted;
+        int64_t slewPpb = (int64_t)CLOCK_SLEW_PPM * 1000;
+        _ratePpb = _driftPpb + (error >= 0 ? slewPpb : -slewPpb);
+        _slewEndMono = mono + (error >= 0 ? error : -error) * 1000000000LL / slewPpb;
+      }
+      _stats.lastErrorUs = (int32_t)clamp(error, INT32_MAX);
+      _stats.driftPpb = (int32_t)_driftPpb;
+      portEXIT_CRITICAL(&_lock);
+    }
+
+    bool isSynced() { return _synced; }
+
+    // Unix time of a monotonic stamp (esp_timer_get_time()), 0 before the first sync
+    int64_t toUnixUs(int64_t mono) {
+      if (!_synced) return 0;
+      portENTER_CRITICAL(&_lock);
+      int64_t unixUs = predict(mono);
+      portEXIT_CRITICAL(&_lock);
+      return unixUs;
+    }
+
+    int64_t toUnixMs(int64_t mono) { return toUnixUs(mono) / 1000; }
+
+    ClockStats getStats() {
+      portENTER_CRITICAL(&_lock);
+      ClockStats s = _stats;
+      portEXIT_CRITICAL(&_lock);
+      return s;
+    }
+};
+
+DeviceClock* DeviceClock::_instance = NULL;
+
+#endif // DEVICE_CLOCK_H
@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include "Config.h"
+#include "WaveformCapture.h"
+#include "TraceRecorder.h"
 
 // --- Relay Driver ---
 class RelayDriver {
@@ -29,6 +31,11 @@ class RelayDriver {
     }
 
     bool getState() { return _state; }
+
+    int getPin() { return _pin; }
+
+    // Record a state written directly to the GPIO registers (see RelayBank)
+    void setState(bool state) { _state = state; }
 };
 
 // --- Button Driver ---
@@ -40,23 +47,47 @@ class ButtonDriver {
     int _lastButtonState;
     int _buttonState;
     bool _pressed;
+    TraceRecorder* _trace;
+    #if TRACE_REPLAY
+      int _replayLevel;
+    #endif
+
+    // Raw pin level (the trace's level at millis() in a replay)
+    int readPin() {
+      #if TRACE_REPLAY
+        TraceRecord rec;
+        while (_trace && _trace->takeDue(TRACE_BUTTON, millis(), rec)) _replayLevel = rec.arg;
+        return _replayLevel;
+      #else
+        return digitalRead(_pin);
+      #endif
+    }
 
   public:
-    ButtonDriver(int pin) : _pin(pin) {
+    ButtonDriver(int pin) : _pin(pin), _trace(NULL) {
       _lastButtonState = HIGH; // Input Pullup defaults HIGH
       _buttonState = HIGH;
       _pressed = false;
+      #if TRACE_REPLAY
+        _replayLevel = HIGH;
+      #endif
     }
 
     void begin() {
       pinMode(_pin, INPUT_PULLUP);
     }
 
+    // Record every raw edge (before debouncing)
+    void attachTrace(TraceRecorder* trace) {
+      _trace = trace;
+    }
+
     void update() {
-      int reading = digitalRead(_pin);
+      int reading = readPin();
 
       if (reading != _lastButtonState) {
         _lastDebounceTime = millis();
+        if (_trace) _trace->record(TRACE_BUTTON, reading);
       }
 
       if ((millis() - _lastDebounceTime) > _debounceDelay) {
@@ -124,25 +155,63 @@ class CurrentSensorDriver {
     float _midValue;
     float _sensitivity;
     float _currentVal;
+    WaveformCapture* _capture;
+    TraceRecorder* _trace;
     
   public:
     CurrentSensorDriver(int pin, float midVal, float sens) 
-      : _pin(pin), _midValue(midVal), _sensitivity(sens), _currentVal(0.0) {}
+      : _pin(pin), _midValue(midVal), _sensitivity(sens), _currentVal(0.0), _capture(NULL), _trace(NULL) {}
 
     void begin() {
       pinMode(_pin, INPUT);
     }
 
+    // Mirror every raw sample into a waveform capture buffer
+    void attachCapture(WaveformCapture* capture) {
+      _capture = capture;
+    }
+
+    // Record the raw sum of every burst (what read() computes the current from)
+    void attachTrace(TraceRecorder* trace) {
+      _trace = trace;
+    }
+
     float read() {
-      float totalVoltage = 0.0;
+      uint32_t rawSum = 0;
       int samples = 50; 
       
-      for(int i=0; i<samples; i++) {
-         int raw = analogRead(_pin);
-         totalVoltage += raw * (ADC_VREF / ADC_RESOLUTION);
-      }
+      #if TRACE_REPLAY
+        TraceRecord rec;
+        if (_trace && _trace->take(TRACE_ADC, rec)) {
+          rawSum = rec.b;
+          samples = rec.arg;
+        } else {
+          rawSum = (uint32_t)(_midValue / (ADC_VREF / ADC_RESOLUTION)) * samples; // Trace exhausted: 0 A
+        }
+        // Keep an armed capture moving as on the device (burst average as the raw samples)
+        if (_capture) {
+          uint16_t avg = rawSum / samples;
+          for (int i = 0; i < samples; i++) _capture->push(avg);
+          while (_capture->isCapturing()) _capture->push(avg);
+        }
+      #else
+        for(int i=0; i<samples; i++) {
+           int raw = analogRead(_pin);
+           if (_capture) _capture->push(raw);
+           rawSum += raw;
+        }
+
+        // Triggered: record the post-trigger window back-to-back at max rate
+        if (_capture) {
+          while (_capture->isCapturing()) {
+            _capture->push(analogRead(_pin));
+          }
+        }
+
+        if (_trace) _trace->record(TRACE_ADC, samples, 0, rawSum);
+      #endif
       
-      float avgVoltage = totalVoltage / samples;
+      float avgVoltage = rawSum * (ADC_VREF / ADC_RESOLUTION) / samples;
       
       float current = (avgVoltage - _midValue) / _sensitivity;
       
@@ -178,14 +247,48 @@ class SolarDriver {
     float _pvPower;
     float _battVoltage;
     float _battCurrent;
+    TraceRecorder* _trace;
+
+    // One readInputRegisters(0x3100, 6) transaction (from the trace in a replay)
+    uint8_t readRegisters(uint16_t* regs) {
+      #if TRACE_REPLAY
+        TraceRecord rec, ext;
+        if (!_trace || !_trace->take(TRACE_MODBUS, rec)) return _node.ku8MBResponseTimedOut;
+        if (rec.arg == _node.ku8MBSuccess && _trace->take(TRACE_MODBUS_EXT, ext)) {
+          regs[0] = rec.a; regs[1] = rec.b & 0xFFFF; regs[2] = rec.b >> 16;
+          regs[3] = ext.a; regs[4] = ext.b & 0xFFFF; regs[5] = ext.b >> 16;
+        }
+        return rec.arg;
+      #else
+        uint8_t result = _node.readInputRegisters(0x3100, 6);
+        if (result == _node.ku8MBSuccess) {
+          for (uint8_t i = 0; i < 6; i++) regs[i] = _node.getResponseBuffer(i);
+        }
+        if (_trace) {
+          _trace->record(TRACE_MODBUS, result, regs[0], regs[1] | ((uint32_t)regs[2] << 16));
+          if (result == _node.ku8MBSuccess) {
+            _trace->record(TRACE_MODBUS_EXT, 0, regs[3], regs[4] | ((uint32_t)regs[5] << 16));
+          }
+        }
+        return result;
+      #endif
+    }
     
   public:
-    SolarDriver() {
+    SolarDriver() : _trace(NULL) {
         _pvVoltage = 0; _pvCurrent = 0; _pvPower = 0;
         _battVoltage = 0; _battCurrent = 0;
     }
 
+    // Record every Modbus response (result code and registers)
+    void attachTrace(TraceRecorder* trace) {
+      _trace = trace;
+    }
+
     void begin() {
+      #if TRACE_REPLAY
+        return; // No bus: responses come from the trace
+      #endif
       // 1. Init RS485 Control Pin
       pinMode(PIN_RS485_DE, OUTPUT);
       digitalWrite(PIN_RS485_DE, LOW);
@@ -200,17 +303,18 @@ class SolarDriver {
     }
 
     void readData() {
-       uint8_t result = _node.readInputRegisters(0x3100, 6);
+       uint16_t regs[6] = { 0, 0, 0, 0, 0, 0 };
+       uint8_t result = readRegisters(regs);
        
        if (result == _node.ku8MBSuccess) {
-           _pvVoltage = _node.getResponseBuffer(0) / 100.0f;
-           _pvCurrent = _node.getResponseBuffer(1) / 100.0f;
+           _pvVoltage = regs[0] / 100.0f;
+           _pvCurrent = regs[1] / 100.0f;
            // Power is 32-bit (Low | High<<16)
-           uint32_t powerRaw = (_node.getResponseBuffer(2) | (_node.getResponseBuffer(3) << 16));
+           uint32_t powerRaw = (regs[2] | ((uint32_t)regs[3] << 16));
            _pvPower   = powerRaw / 100.0f;
            
-           _battVoltage = _node.getResponseBuffer(4) / 100.0f;
-           _battCurrent = _node.getResponseBuffer(5) / 100.0f;
+           _battVoltage = regs[4] / 100.0f;
+           _battCurrent = regs[5] / 100.0f;
        }
     }
     
@@ -224,6 +328,7 @@ class SolarDriver {
 // Dummy SolarDriver if disabled, to avoid breaking SolarManager compilation
 class SolarDriver {
   public:
+    void attachTrace(TraceRecorder* trace) {}
     void begin() {}
     void readData() {}
     float getPvVoltage() { return 0.0f; }
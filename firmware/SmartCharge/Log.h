@@ -0,0 +1,324 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include "Config.h"
+
+// --- Log Levels ---
+// Anything above LOG_LEVEL (Config.h) is removed by the preprocessor, arguments included
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#define LOG_MAX_ARGS 4
+
+enum LogArgType : uint8_t {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_FLOAT,
+  LOG_ARG_STR,  // Must point to a string that outlives the record (literals, Config.h)
+  LOG_ARG_INT64, // Two words, low word first (both slots carry the type)
+  LOG_ARG_UINT64
+};
+
+// Argument words a call needs: 64-bit integers take two
+template <typename... Args> struct LogArgWords;
+template <> struct LogArgWords<> { static const uint8_t value = 0; };
+template <typename T, typename... Rest> struct LogArgWords<T, Rest...> {
+  static const uint8_t value =
+    (std::is_same<T, long long>::value || std::is_same<T, unsigned long long>::value ? 2 : 1) + LogArgWords<Rest...>::value;
+};
+
+// One deferred log line: the format string is stored by address, arguments as
+// pointer-sized words (4 bytes on the ESP32; only the low 32 bits are used)
+struct LogRecord {
+  const char* fmt;
+  uint32_t timestamp; // millis()
+  uint32_t pos;       // Ring position, validates records found after a reset
+  uint8_t level;
+  uint8_t argc;
+  uint8_t types[LOG_MAX_ARGS];
+  uintptr_t args[LOG_MAX_ARGS];
+};
+
+// --- Deferred Binary Logger ---
+// Responsibilities: Lock-free record ring, Background formatting, Crash-persistent history
+// LOG_E/W/I/D only copy the format address and the raw arguments into a
+// bounded MPSC ring (Vyukov): a producer claims a slot with one CAS and never
+// blocks; when the ring is full the record is dropped and counted. The
+// formatting and the Serial writes happen in update(), registered as a
+// background job. The ring lives in RTC memory that survives a panic or
+// watchdog reset, so begin() prints the last records of the previous boot.
+class Logger {
+  private:
+    struct Cell {
+      volatile uint32_t seq; // Vyukov sequence: pos = free, pos + 1 = written
+      LogRecord rec;
+    };
+
+    struct Ring {
+      uint32_t magic;
+      uint32_t build;
+      Cell cells[LOG_RING_SIZE];
+    };
+
+    static const uint32_t kMagic = 0x4C4F4752; // "LOGR"
+    static const uint32_t kMask = LOG_RING_SIZE - 1;
+    static_assert((LOG_RING_SIZE & kMask) == 0, "LOG_RING_SIZE must be a power of two");
+
+    // RTC slow memory does not support the atomic compare-and-set instruction, so
+    // only plain loads/stores touch the cells; the claimed position lives in DRAM.
+    static Ring _ring;
+    static std::atomic<uint32_t> _enqueuePos;
+    static std::atomic<uint32_t> _dropped;
+    uint32_t _dequeuePos;
+    uint32_t _reportedDrops;
+
+    static uint32_t loadSeq(const Cell& c) { return __atomic_load_n(&c.seq, __ATOMIC_ACQUIRE); }
+    static void storeSeq(Cell& c, uint32_t v) { __atomic_store_n(&c.seq, v, __ATOMIC_RELEASE); }
+
+    // Changes with every build, so format addresses from another firmware are never used
+    static uint32_t buildId() {
+      const char* stamp = __DATE__ " " __TIME__;
+      uint32_t h = 2166136261u; // FNV-1a
+      while (*stamp) h = (h ^ (uint8_t)*stamp++) * 16777619u;
+      return h;
+    }
+
+    static void encode(LogRecord& r, int v)           { r.types[r.argc] = LOG_ARG_INT;   r.args[r.argc++] = (uint32_t)v; }
+    static void encode(LogRecord& r, long v)          { r.types[r.argc] = LOG_ARG_INT;   r.args[r.argc++] = (uint32_t)v; }
+    static void encode(LogRecord& r, unsigned int v)  { r.types[r.argc] = LOG_ARG_UINT;  r.args[r.argc++] = (uint32_t)v; }
+    static void encode(LogRecord& r, unsigned long v) { r.types[r.argc] = LOG_ARG_UINT;  r.args[r.argc++] = (uint32_t)v; }
+    static void encode(LogRecord& r, const char* v)   { r.types[r.argc] = LOG_ARG_STR;   r.args[r.argc++] = (uintptr_t)v; }
+    static void encode(LogRecord& r, long long v)          { encode64(r, LOG_ARG_INT64,  (uint64_t)v); }
+    static void encode(LogRecord& r, unsigned long long v) { encode64(r, LOG_ARG_UINT64, (uint64_t)v); }
+    static void encode64(LogRecord& r, LogArgType type, uint64_t v) {
+      r.types[r.argc] = type;  r.args[r.argc++] = (uint32_t)v;
+      r.types[r.argc] = type;  r.args[r.argc++] = (uint32_t)(v >> 32);
+    }
+    static void encode(LogRecord& r, double v) {
+      float f = (float)v;
+      r.types[r.argc] = LOG_ARG_FLOAT;
+      r.args[r.argc] = 0;
+      memcpy(&r.args[r.argc++], &f, sizeof(f));
+    }
+
+    static void push(LogRecord& r) {
+      uint32_t pos = _enqueuePos.load(std::memory_order_relaxed);
+      Cell* cell;
+      for (;;) {
+        cell = &_ring.cells[pos & kMask];
+        int32_t dif = (int32_t)(loadSeq(*cell) - pos);
+        if (dif == 0) {
+          if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+          _dropped.fetch_add(1, std::memory_order_relaxed); // Full: never block the caller
+          return;
+        } else {
+          pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+      }
+      r.pos = pos;
+      cell->rec = r;
+      storeSeq(*cell, pos + 1);
+    }
+
+    static char levelChar(uint8_t level) {
+      switch (level) {
+        case LOG_LEVEL_ERROR: return 'E';
+        case LOG_LEVEL_WARN:  return 'W';
+        case LOG_LEVEL_INFO:  return 'I';
+        default:              return 'D';
+      }
+    }
+
+    void print(const LogRecord& r, const char* prefix) {
+      char line[LOG_LINE_BYTES];
+      format(r, line, sizeof(line));
+      Serial.printf("%s[%lu] %c %s\n", prefix, (unsigned long)r.timestamp, levelChar(r.level), line);
+    }
+
+    // Print what the previous boot left in the ring, oldest first
+    void dumpPrevious() {
+      uint32_t newest = 0;
+      bool found = false;
+      for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        const Cell& c = _ring.cells[i];
+        bool written = c.seq == c.rec.pos + 1 || c.seq == c.rec.pos + LOG_RING_SIZE;
+        if (written && (c.rec.pos & kMask) == i && (!found || (int32_t)(c.rec.pos - newest) > 0)) {
+          newest = c.rec.pos;
+          found = true;
+        }
+      }
+      if (!found) return;
+
+      Serial.printf("--- Log of previous boot (reset reason %d) ---\n", (int)esp_reset_reason());
+      for (uint32_t pos = newest - kMask; pos != newest + 1; pos++) {
+        const Cell& c = _ring.cells[pos & kMask];
+        bool written = c.seq == pos + 1 || c.seq == pos + LOG_RING_SIZE;
+        if (written && c.rec.pos == pos) print(c.rec, "  ");
+      }
+      Serial.println("--- End of previous log ---");
+    }
+
+  public:
+    Logger() : _dequeuePos(0), _reportedDrops(0) {}
+
+    // Call first in setup(), before anything logs
+    void begin() {
+      if (_ring.magic == kMagic && _ring.build == buildId()) {
+        dumpPrevious();
+      }
+      for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        _ring.cells[i].seq = i;
+      }
+      _ring.build = buildId();
+      _ring.magic = kMagic;
+      _enqueuePos.store(0);
+      _dequeuePos = 0;
+    }
+
+    template <typename... Args>
+    static void write(uint8_t level, const char* fmt, Args... args) {
+      static_assert(LogArgWords<Args...>::value <= LOG_MAX_ARGS, "Too many log arguments (64-bit integers count twice)");
+      LogRecord r;
+      r.fmt = fmt;
+      r.timestamp = millis();
+      r.level = level;
+      r.argc = 0;
+      int expand[] = { 0, (encode(r, args), 0)... };
+      (void)expand;
+      push(r);
+    }
+
+    // Render a record with printf semantics, one conversion at a time
+    static void format(const LogRecord& r, char* out, size_t size) {
+      size_t len = 0;
+      uint8_t arg = 0;
+      const char* p = r.fmt;
+      while (*p && len + 1 < size) {
+        if (*p != '%') {
+          out[len++] = *p++;
+          continue;
+        }
+        if (p[1] == '%') {
+          out[len++] = '%';
+          p += 2;
+          continue;
+        }
+
+        // Copy one conversion specification (flags, width, precision, length, type)
+        char spec[16];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p && !strchr("diouxXcsfgeEp", *p) && n < sizeof(spec) - 4) {
+          if (!strchr("hlzjt", *p)) spec[n++] = *p; // Length modifiers are re-derived below
+          p++;
+        }
+        if (!*p) break;
+        char conv = *p++;
+        spec[n++] = conv;
+        spec[n] = '\0';
+
+        if (arg >= r.argc) break;
+        uintptr_t word = r.args[arg];
+        uint32_t raw = (uint32_t)word;
+        uint8_t type = r.types[arg++];
+        bool wide = type == LOG_ARG_INT64 || type == LOG_ARG_UINT64;
+        uint64_t raw64 = raw;
+        if (wide) {
+          if (arg >= r.argc) break;
+          raw64 |= (uint64_t)(uint32_t)r.args[arg++] << 32;
+        }
+        int written;
+        if (strchr("fgeE", conv)) {
+          float f;
+          if (type == LOG_ARG_FLOAT) memcpy(&f, &word, sizeof(f));
+          else if (wide) f = type == LOG_ARG_INT64 ? (float)(int64_t)raw64 : (float)raw64;
+          else f = type == LOG_ARG_INT ? (float)(int32_t)raw : (float)raw;
+          written = snprintf(out + len, size - len, spec, (double)f);
+        } else if (conv == 's') {
+          written = snprintf(out + len, size - len, spec, type == LOG_ARG_STR ? (const char*)word : "?");
+        } else if (conv == 'c') {
+          written = snprintf(out + len, size - len, spec, (int)raw);
+        } else if (conv == 'p') {
+          written = snprintf(out + len, size - len, spec, (void*)word);
+        } else if (wide) {
+          spec[n - 1] = 'l'; // 64-bit arguments: print as long long
+          spec[n] = 'l';
+          spec[n + 1] = conv;
+          spec[n + 2] = '\0';
+          if (conv == 'd' || conv == 'i') {
+            written = snprintf(out + len, size - len, spec, (long long)(int64_t)raw64);
+          } else {
+            written = snprintf(out + len, size - len, spec, (unsigned long long)raw64);
+          }
+        } else {
+          spec[n - 1] = 'l'; // Integer arguments are 32-bit: print as long
+          spec[n] = conv;
+          spec[n + 1] = '\0';
+          if (conv == 'd' || conv == 'i') {
+            written = snprintf(out + len, size - len, spec, (long)(int32_t)raw);
+          } else {
+            written = snprintf(out + len, size - len, spec, (unsigned long)raw);
+          }
+        }
+        if (written < 0) break;
+        len += (size_t)written < size - len ? (size_t)written : size - len - 1;
+      }
+      out[len] = '\0';
+    }
+
+    // Background job: format and print up to LOG_DRAIN_BATCH records
+    void update() {
+      for (uint8_t i = 0; i < LOG_DRAIN_BATCH; i++) {
+        Cell& cell = _ring.cells[_dequeuePos & kMask];
+        if ((int32_t)(loadSeq(cell) - (_dequeuePos + 1)) < 0) break; // Empty
+        LogRecord r = cell.rec;
+        storeSeq(cell, _dequeuePos + LOG_RING_SIZE); // Slot free for the next lap (contents kept)
+        _dequeuePos++;
+        print(r, "");
+      }
+
+      uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+      if (dropped != _reportedDrops) {
+        Serial.printf("Log: %lu records dropped\n", (unsigned long)(dropped - _reportedDrops));
+        _reportedDrops = dropped;
+      }
+    }
+
+    uint32_t getDropped() { return _dropped.load(std::memory_order_relaxed); }
+};
+
+RTC_NOINIT_ATTR Logger::Ring Logger::_ring;
+std::atomic<uint32_t> Logger::_enqueuePos(0);
+std::atomic<uint32_t> Logger::_dropped(0);
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_E(fmt, ...) Logger::write(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+  #define LOG_E(fmt, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+  #define LOG_W(fmt, ...) Logger::write(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+  #define LOG_W(fmt, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_I(fmt, ...) Logger::write(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+  #define LOG_I(fmt, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_D(fmt, ...) Logger::write(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+  #define LOG_D(fmt, ...) do {} while (0)
+#endif
+
+#endif // LOG_H
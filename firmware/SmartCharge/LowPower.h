@@ -0,0 +1,173 @@
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Log.h"
+
+#if ENABLE_LOW_POWER
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+#include <driver/gpio.h>
+#endif
+
+// Job wake source: a GPIO that releases `task` before its next period
+struct WakePin {
+  int pin;           // -1: none
+  TaskHandle_t task;
+};
+
+// --- Low Power Mode ---
+// Responsibilities: Automatic light sleep, Wakeup sources, Modem sleep, Chip sleep accounting
+// With ENABLE_LOW_POWER, begin() hands the clocks to the ESP-IDF power
+// management: the CPU runs at PM_MAX_FREQ_MHZ while any task is ready, drops
+// to PM_MIN_FREQ_MHZ when both cores are idle, and FreeRTOS tickless idle puts
+// the chip into light sleep until the next timer (the earliest job release).
+// Other wakeups are the job wake pins (GPIO, see Scheduler::setWakePin) and
+// the Wi-Fi modem waking for every PM_WIFI_LISTEN_INTERVAL-th DTIM beacon.
+// Needs an Arduino core built with CONFIG_PM_ENABLE and
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE; otherwise begin() logs a warning and the
+// chip stays awake. Sleep time is only measured when the core also has
+// CONFIG_PM_LIGHT_SLEEP_CALLBACKS; without it every blocked microsecond counts
+// as idle.
+class LowPower {
+  private:
+    static volatile uint32_t _sleptUs; // Wraps: consumers take differences
+    static volatile uint32_t _sleeps;
+    static bool _enabled;
+
+    #if ENABLE_LOW_POWER && defined(CONFIG_PM_LIGHT_SLEEP_CALLBACKS)
+      static esp_err_t IRAM_ATTR onWake(int64_t sleepTimeUs, void* arg) {
+        _sleptUs = _sleptUs + (uint32_t)sleepTimeUs;
+        _sleeps = _sleeps + 1;
+        return ESP_OK;
+      }
+    #endif
+
+    #if ENABLE_LOW_POWER
+      // Level interrupt: disabled here, re-armed by the job once the pin is released
+      static void IRAM_ATTR onWakePin(void* arg) {
+        WakePin* wake = static_cast<WakePin*>(arg);
+        gpio_intr_disable((gpio_num_t)wake->pin);
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(wake->task, &woken);
+        if (woken) portYIELD_FROM_ISR();
+      }
+    #endif
+
+  public:
+    // Enable DFS and automatic light sleep. Call once from setup().
+    static bool begin() {
+      #if ENABLE_LOW_POWER
+        esp_pm_config_esp32_t pm = {};
+        pm.max_freq_mhz = PM_MAX_FREQ_MHZ;
+        pm.min_freq_mhz = PM_MIN_FREQ_MHZ;
+        pm.light_sleep_enable = true;
+        esp_err_t err = esp_pm_configure(&pm);
+        if (err != ESP_OK) {
+          LOG_W("LowPower: esp_pm_configure failed (%d), core without CONFIG_PM_ENABLE?", (int)err);
+          return false;
+        }
+        #ifdef CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+          esp_pm_sleep_cbs_register_config_t cbs = {};
+          cbs.exit_cb = onWake;
+          esp_pm_light_sleep_register_cbs(&cbs);
+        #else
+          LOG_W("LowPower: no light sleep callbacks, sleep time not measured");
+        #endif
+        _enabled = true;
+        LOG_I("LowPower: light sleep on, %d-%d MHz", PM_MIN_FREQ_MHZ, PM_MAX_FREQ_MHZ);
+        return true;
+      #else
+        return false;
+      #endif
+    }
+
+    // Modem sleep between DTIM beacons. Call right after WiFi.begin(): the
+    // listen interval goes out with the association request.
+    static void configureWifi() {
+      #if ENABLE_LOW_POWER && ENABLE_WIFI
+        wifi_config_t conf;
+        if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK) {
+          conf.sta.listen_interval = PM_WIFI_LISTEN_INTERVAL;
+          esp_wifi_set_config(WIFI_IF_STA, &conf);
+        }
+        esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+      #endif
+    }
+
+    // Notify wake->task when wake->pin goes low, from light sleep too
+    // (active-low button). `wake` is used by the ISR and must outlive it.
+    static void attachWakePin(WakePin* wake) {
+      #if ENABLE_LOW_POWER
+        gpio_num_t pin = (gpio_num_t)wake->pin;
+        gpio_install_isr_service(0); // ESP_ERR_INVALID_STATE if already installed
+        gpio_set_intr_type(pin, GPIO_INTR_LOW_LEVEL);
+        gpio_isr_handler_add(pin, onWakePin, wake);
+        gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+        rearmWakePin(wake->pin);
+      #endif
+    }
+
+    // Re-enable the wake interrupt once the pin is back high
+    static void rearmWakePin(int pin) {
+      #if ENABLE_LOW_POWER
+        if (gpio_get_level((gpio_num_t)pin)) gpio_intr_enable((gpio_num_t)pin);
+      #endif
+    }
+
+    static bool isEnabled() { return _enabled; }
+    static uint32_t getSleptUs() { return _sleptUs; }
+    static uint32_t getSleepCount() { return _sleeps; }
+};
+
+volatile uint32_t LowPower::_sleptUs = 0;
+volatile uint32_t LowPower::_sleeps = 0;
+bool LowPower::_enabled = false;
+
+// --- Awake Lock ---
+// Responsibilities: Keep the chip out of light sleep (and APB at full speed) while held
+// For work that waits on a peripheral the sleep would stop, e.g. a Modbus
+// transaction: the UART neither receives in light sleep nor keeps its baud
+// rate when the APB clock scales down.
+class AwakeLock {
+  private:
+    #if ENABLE_LOW_POWER
+      esp_pm_lock_handle_t _noSleep;
+      esp_pm_lock_handle_t _apb;
+    #endif
+
+  public:
+    AwakeLock() {
+      #if ENABLE_LOW_POWER
+        _noSleep = NULL;
+        _apb = NULL;
+      #endif
+    }
+
+    // name: shown by esp_pm_dump_locks(); must outlive the lock
+    void begin(const char* name) {
+      #if ENABLE_LOW_POWER
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, name, &_noSleep);
+        esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, name, &_apb);
+      #endif
+    }
+
+    void acquire() {
+      #if ENABLE_LOW_POWER
+        if (_noSleep) esp_pm_lock_acquire(_noSleep);
+        if (_apb) esp_pm_lock_acquire(_apb);
+      #endif
+    }
+
+    void release() {
+      #if ENABLE_LOW_POWER
+        if (_apb) esp_pm_lock_release(_apb);
+        if (_noSleep) esp_pm_lock_release(_noSleep);
+      #endif
+    }
+};
+
+#endif // LOW_POWER_H
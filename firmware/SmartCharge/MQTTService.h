@@ -5,23 +5,54 @@
   #include <WiFi.h>
   #include <PubSubClient.h>
   #include <ArduinoJson.h>
+  #include <mbedtls/base64.h>
 #endif
 #include "Config.h"
 #include "Managers.h"
+#include "Protocol.h"
+#include "TlsTransport.h"
+#include "TelemetryBus.h"
+#include "Log.h"
+#if ENABLE_MQTT
+  #include "MqttOutbox.h"
+#endif
 
 // --- MQTT Service for Home Assistant ---
 // Responsibilities: MQTT Connection, Publish sensor data, Subscribe to commands
+// Outgoing messages go through MqttOutbox: publishing only enqueues, and the
+// outbox is drained here after PubSubClient has processed incoming packets.
 class MQTTService {
   private:
     #if ENABLE_MQTT
-      WiFiClient _wifiClient;
+      #if ENABLE_TLS
+        TlsSessionClient _netClient; // Session survives broker reconnects
+      #else
+        WiFiClient _netClient;
+      #endif
+      MqttOutbox _outbox;
+      MqttAckTap _tap; // PubSubClient -> _tap -> _netClient
       PubSubClient _mqttClient;
     #endif
     PowerManager* _powerManager;
     SolarManager* _solarManager;
+    TelemetryBus* _bus;
+    SinkId _sink;
 
-    unsigned long _lastPublish;
-    const unsigned long _publishInterval = 5000; // Publish every 5 seconds
+    #if ENABLE_CAPTURE
+      // Waveform upload: one chunk per update so the network job never blocks for long
+      static const size_t kCaptureChunkBytes = CAPTURE_CHUNK_SAMPLES * 4;
+      uint16_t _captureOffset;
+      uint8_t _captureChunk[kCaptureChunkBytes];
+      char _captureB64[4 * ((kCaptureChunkBytes + 2) / 3) + 1];
+    #endif
+
+    #if ENABLE_TRACE
+      // Trace upload: the recorder stays frozen until the last chunk is queued
+      static const size_t kTraceChunkBytes = TRACE_CHUNK_RECORDS * sizeof(TraceRecord);
+      uint32_t _traceOffset;
+      TraceRecord _traceChunk[TRACE_CHUNK_RECORDS];
+      char _traceB64[4 * ((kTraceChunkBytes + 2) / 3) + 1];
+    #endif
 
     // Static pointer for callback (PubSubClient requires static callback)
     static MQTTService* _instance;
@@ -42,19 +73,37 @@ class MQTTService {
           message += (char)payload[i];
         }
 
-        Serial.print("MQTT Message [");
-        Serial.print(topic);
-        Serial.print("]: ");
-        Serial.println(message);
+        LOG_D("MQTT: message (%u bytes)", length);
 
         // Check if it's a command topic
         if (String(topic) == MQTT_TOPIC_CMD) {
-          if (message == "ON") {
-            Serial.println("MQTT: Received ON command");
-            _powerManager->setChargingRequest(true);
-          } else if (message == "OFF") {
-            Serial.println("MQTT: Received OFF command");
-            _powerManager->setChargingRequest(false);
+          switch (parseMqttCommand(message.c_str())) {
+            case CMD_START:
+              LOG_I("MQTT: Received ON command");
+              _powerManager->post(CMD_CHARGE_ON, CMD_SOURCE_MQTT);
+              break;
+            case CMD_STOP:
+              LOG_I("MQTT: Received OFF command");
+              _powerManager->post(CMD_CHARGE_OFF, CMD_SOURCE_MQTT);
+              break;
+            #if ENABLE_CAPTURE
+            case CMD_CAPTURE:
+              LOG_I("MQTT: Received CAPTURE command");
+              _powerManager->triggerCapture();
+              break;
+            case CMD_CAPTURE_ARM:
+              LOG_I("MQTT: Received CAPTURE_ARM command");
+              _powerManager->armCapture();
+              break;
+            #endif
+            #if ENABLE_TRACE
+            case CMD_TRACE:
+              LOG_I("MQTT: Received TRACE command");
+              if (_powerManager->getTrace()) _powerManager->getTrace()->freeze();
+              break;
+            #endif
+            default:
+              break;
           }
         }
       #endif
@@ -65,24 +114,25 @@ class MQTTService {
       #if ENABLE_MQTT
         if (_mqttClient.connected()) return true;
 
-        Serial.print("Connecting to MQTT broker...");
+        LOG_I("Connecting to MQTT broker %s:%d", MQTT_SERVER, MQTT_BROKER_PORT);
 
         // Connect with Last Will and Testament (LWT)
         if (_mqttClient.connect(MQTT_CLIENT_ID, NULL, NULL, MQTT_TOPIC_AVAIL, 0, true, "offline")) {
-          Serial.println("connected!");
+          LOG_I("MQTT connected");
+
+          // Anything unacknowledged on the old connection goes out again
+          _outbox.onReconnect();
 
           // Publish online status
           _mqttClient.publish(MQTT_TOPIC_AVAIL, "online", true);
 
           // Subscribe to command topic
           _mqttClient.subscribe(MQTT_TOPIC_CMD);
-          Serial.print("Subscribed to: ");
-          Serial.println(MQTT_TOPIC_CMD);
+          LOG_I("Subscribed to: %s", MQTT_TOPIC_CMD);
 
           return true;
         } else {
-          Serial.print("failed, rc=");
-          Serial.println(_mqttClient.state());
+          LOG_W("MQTT connect failed, rc=%d", _mqttClient.state());
           return false;
         }
       #else
@@ -90,60 +140,173 @@ class MQTTService {
       #endif
     }
 
-    // Publish sensor data to MQTT
-    void publishState() {
+    // Queue one bus snapshot for MQTT (kept while the broker is unreachable)
+    void publishState(const TelemetryRecord& record) {
+      #if ENABLE_MQTT
+        // Build JSON payload (see Protocol.h)
+        JsonDocument doc;
+        buildStateDoc(doc, record.toReport());
+
+        #if ENABLE_TLS
+          doc["tls_handshakes"] = _netClient.getStats().handshakes;
+          doc["tls_resumed"]    = _netClient.getStats().resumed;
+          doc["tls_ms"]         = _netClient.getStats().lastHandshakeMs;
+        #endif
+
+        // Relay wear (operating cycles since first boot)
+        doc["main_switches"] = _powerManager->getMainSwitchCount();
+        doc["fan_switches"]  = _powerManager->getFanSwitchCount();
+
+        OutboxStats queue = _outbox.getStats();
+        doc["queue_depth"]      = queue.depth;
+        doc["queue_dropped"]    = queue.dropped;
+        doc["queue_latency_ms"] = queue.lastLatencyMs;
+
+        SinkStats sink = _bus->getStats(_sink);
+        doc["bus_dropped"] = sink.dropped;
+        doc["bus_lag_ms"]  = sink.lastLagMs;
+
+        char payload[MQTT_OUTBOX_PAYLOAD];
+        size_t len = serializeJson(doc, payload, sizeof(payload));
+
+        // Queue for the state topic; the update loop delivers it
+        bool queued = _outbox.enqueue(MQTT_TOPIC_STATE, (const uint8_t*)payload, len, MQTT_STATE_QOS, false);
+
+        LOG_D("MQTT Publish: %u bytes %s", len, queued ? "[QUEUED]" : "[DROPPED]");
+      #endif
+    }
+
+    // Queue acknowledgements of MQTT commands (QoS 1, so they survive reconnects).
+    // MQTT commands carry no id, so the ack names the action and the resulting relay state.
+    void publishAcks() {
+      #if ENABLE_MQTT
+        CommandAck ack;
+        while (_outbox.getFreeSlots() >= 2 && _powerManager->takeAck(CMD_SOURCE_MQTT, ack)) {
+          JsonDocument doc;
+          doc["action"]    = commandActionName(ack.action);
+          doc["result"]    = ackResultName(ack.result);
+          doc["latencyMs"] = ack.latencyMs;
+          doc["relay"]     = ack.relayOn ? "ON" : "OFF";
+
+          char payload[128];
+          size_t len = serializeJson(doc, payload, sizeof(payload));
+          _outbox.enqueue(MQTT_TOPIC_ACK, (const uint8_t*)payload, len, 1, false);
+        }
+      #endif
+    }
+
+    #if ENABLE_CAPTURE
+    // Publish the next chunk of a finished waveform capture, then release the buffer
+    void publishCaptureChunk() {
+      #if ENABLE_MQTT
+        WaveformCapture* capture = _powerManager->getCapture();
+        // Keep one slot free for state updates
+        if (!capture->isReady() || _outbox.getFreeSlots() < 2) return;
+
+        uint16_t count = capture->readChunk(_captureOffset, _captureChunk, CAPTURE_CHUNK_SAMPLES);
+        if (count == 0) {
+          capture->release();
+          _captureOffset = 0;
+          return;
+        }
+
+        size_t written = 0;
+        mbedtls_base64_encode((unsigned char*)_captureB64, sizeof(_captureB64), &written,
+                              _captureChunk, count * 4);
+
+        // data: little-endian uint16 pairs (raw ADC, us since previous sample)
+        JsonDocument doc;
+        doc["offset"]    = _captureOffset;
+        doc["total"]     = capture->getSampleCount();
+        doc["trigger"]   = capture->getTriggerOffset();
+        doc["triggerMs"] = capture->getTriggerMillis();
+        doc["data"]      = (const char*)_captureB64;
+
+        char payload[MQTT_OUTBOX_PAYLOAD];
+        size_t len = serializeJson(doc, payload, sizeof(payload));
+        if (_outbox.enqueue(MQTT_TOPIC_CAPTURE, (const uint8_t*)payload, len, MQTT_CAPTURE_QOS, false)) {
+          _captureOffset += count; // Retry the same chunk next time on failure
+        }
+      #endif
+    }
+    #endif
+
+    #if ENABLE_TRACE
+    // Publish the next chunk of a frozen input trace, then resume recording
+    void publishTraceChunk() {
       #if ENABLE_MQTT
-        if (!_mqttClient.connected()) return;
+        TraceRecorder* trace = _powerManager->getTrace();
+        // Keep one slot free for state updates
+        if (!trace || !trace->isFrozen() || _outbox.getFreeSlots() < 2) return;
 
-        // Collect data from managers
-        float current = _powerManager->getCurrent();
-        float pvPower = _solarManager->getPvPower();
-        float battVoltage = _solarManager->getBattVoltage();
-        float voltage = battVoltage * 10.0f; // Scaled voltage
-        float power = (voltage * current) / 1000.0f; // kW
-        bool relayState = _powerManager->getChargingRequest();
+        uint16_t count = trace->readChunk(_traceOffset, _traceChunk, TRACE_CHUNK_RECORDS);
+        if (count == 0) {
+          trace->release();
+          _traceOffset = 0;
+          return;
+        }
 
-        // Build JSON payload
+        size_t written = 0;
+        mbedtls_base64_encode((unsigned char*)_traceB64, sizeof(_traceB64), &written,
+                              (const unsigned char*)_traceChunk, count * sizeof(TraceRecord));
+
+        // data: little-endian TraceRecords (see TraceRecorder.h), oldest first
         JsonDocument doc;
-        doc["voltage"] = voltage;
-        doc["current"] = current;
-        doc["power"] = power;
-        doc["pv_power"] = pvPower;
-        doc["batt_voltage"] = battVoltage;
-        doc["relay"] = relayState ? "ON" : "OFF";
-
-        String jsonString;
-        serializeJson(doc, jsonString);
-
-        // Publish to state topic
-        bool success = _mqttClient.publish(MQTT_TOPIC_STATE, jsonString.c_str());
-
-        Serial.print("MQTT Publish: ");
-        Serial.print(jsonString);
-        Serial.println(success ? " [OK]" : " [FAILED]");
+        doc["offset"]  = _traceOffset;
+        doc["total"]   = trace->getCount();
+        doc["missed"]  = trace->getMissed();
+        doc["version"] = TRACE_FORMAT_VERSION;
+        doc["data"]    = (const char*)_traceB64;
+
+        char payload[MQTT_OUTBOX_PAYLOAD];
+        size_t len = serializeJson(doc, payload, sizeof(payload));
+        if (_outbox.enqueue(MQTT_TOPIC_TRACE, (const uint8_t*)payload, len, 1, false)) {
+          _traceOffset += count; // Retry the same chunk next time on failure
+        }
       #endif
     }
+    #endif
 
   public:
     MQTTService(PowerManager* pm, SolarManager* sm)
-      : _powerManager(pm), _solarManager(sm) {
+      :
+      #if ENABLE_MQTT && ENABLE_TLS
+        _netClient(TLS_CA_CERT),
+      #endif
+      #if ENABLE_MQTT
+        _tap(&_netClient, &_outbox),
+      #endif
+        _powerManager(pm), _solarManager(sm), _bus(NULL), _sink(-1) {
         #if ENABLE_MQTT
-          _mqttClient.setClient(_wifiClient);
+          _mqttClient.setClient(_tap);
+        #endif
+        #if ENABLE_CAPTURE
+          _captureOffset = 0;
+        #endif
+        #if ENABLE_TRACE
+          _traceOffset = 0;
         #endif
-        _lastPublish = 0;
         _instance = this;
     }
 
+    // State source: every MQTT_STATE_PERIOD_MS snapshot on the bus. While the
+    // outbox is full they wait in the sink queue, oldest dropped first.
+    // Call before the Scheduler starts.
+    void attachBus(TelemetryBus* bus) {
+      _bus = bus;
+      _sink = bus->subscribe("mqtt", MQTT_STATE_PERIOD_MS, MQTT_STATE_DEPTH, SINK_DROP_OLDEST);
+    }
+
     void begin() {
       #if ENABLE_MQTT
-        _mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+        _mqttClient.setServer(MQTT_SERVER, MQTT_BROKER_PORT);
         _mqttClient.setCallback(staticCallback);
         _mqttClient.setBufferSize(512);
         Serial.println("MQTT Service initialized");
         Serial.print("MQTT Server: ");
         Serial.print(MQTT_SERVER);
         Serial.print(":");
-        Serial.println(MQTT_PORT);
+        Serial.println(MQTT_BROKER_PORT);
       #endif
     }
 
@@ -159,13 +322,28 @@ class MQTTService {
           connectMQTT();
         }
 
-        // Process incoming messages
+        // Process incoming messages (PUBACKs are picked up by the tap)
         _mqttClient.loop();
 
-        // Publish state periodically
-        if (millis() - _lastPublish > _publishInterval) {
-          publishState();
-          _lastPublish = millis();
+        // State snapshots from the bus, as far as the outbox has room
+        TelemetryRecord record;
+        while (_bus && _outbox.getFreeSlots() >= 2 && _bus->take(_sink, record)) {
+          publishState(record);
+        }
+
+        publishAcks();
+
+        #if ENABLE_CAPTURE
+          publishCaptureChunk();
+        #endif
+
+        #if ENABLE_TRACE
+          publishTraceChunk();
+        #endif
+
+        // Deliver queued messages within the in-flight window
+        if (_mqttClient.connected()) {
+          _outbox.service(_tap);
         }
       #endif
     }
@@ -177,6 +355,12 @@ class MQTTService {
         return false;
       #endif
     }
+
+    #if ENABLE_MQTT
+    OutboxStats getOutboxStats() {
+      return _outbox.getStats();
+    }
+    #endif
 };
 
 // Initialize static instance pointer
@@ -3,88 +3,326 @@
 
 #include "Drivers.h"
 #include "Config.h"
+#include "AdaptiveSampler.h"
+#include "SeriesCompressor.h"
+#include "WindowAggregator.h"
+#include "Actuators.h"
+#include "CommandMailbox.h"
+#include "SessionDetector.h"
 
 // --- Power Manager ---
-// Responsibilities: Charging logic, Safety monitoring, Relay control
+// Responsibilities: Charging logic, Safety monitoring, Relay control, Command acknowledgement,
+//                   Charging session detection
+// Other tasks never write the charging state: they post() a command into the
+// mailbox, which update() drains at the start of its tick. The acknowledgement
+// is queued for the issuing Service once the main relay has actually switched.
 class PowerManager {
   private:
     RelayDriver* _mainRelay;
     RelayDriver* _fanRelay;
     CurrentSensorDriver* _sensor;
+    RelayBank _relays;
+    uint8_t _mainChannel;
+    uint8_t _fanChannel;
+    AdaptiveSampler _currentSampler;
+    TelemetrySeries _currentSeries;
+    WindowAggregator _currentAgg;
+    WaveformCapture _capture;
+    SessionDetector _session;
+
+    // Commands in, acknowledgements out (one queue per acknowledged source)
+    CommandMailbox _mailbox;
+    AckQueue _acks[CMD_ACK_SOURCES];
+    std::atomic<uint32_t> _nextCommandId;
+    PowerCommand _pending; // Waiting for the relay
+    bool _hasPending;
+    std::atomic<uint32_t> _droppedCommands; // post() runs in any task
+    uint32_t _droppedAcks;
+
+    TraceRecorder* _trace;
+    uint32_t _lastSnapshotMs;
     
     // State
     bool _isChargingRequested;
     bool _isSafetyCutoff;
     float _lastCurrent;
+    int64_t _lastSampleUs; // Acquisition time of _lastCurrent (esp_timer_get_time())
+
+    void emitAck(const PowerCommand& cmd, AckResult result, uint32_t now) {
+        if (cmd.source >= CMD_ACK_SOURCES) return;
+        CommandAck ack;
+        ack.id = cmd.id;
+        ack.actuatedMs = now;
+        ack.latencyMs = now - cmd.issuedMs;
+        ack.action = cmd.action;
+        ack.result = result;
+        ack.relayOn = _mainRelay->getState();
+        memcpy(ack.ref, cmd.ref, sizeof(ack.ref));
+        if (!_acks[cmd.source].push(ack)) _droppedAcks++;
+    }
+
+    // Apply mailbox commands to the charging request (hardware task only)
+    void processCommands(uint32_t now) {
+        PowerCommand cmd;
+        while (_mailbox.pop(cmd)) {
+            bool target = cmd.action == CMD_CHARGE_ON  ? true
+                        : cmd.action == CMD_CHARGE_OFF ? false
+                        : !_isChargingRequested;
+            if (target != _isChargingRequested) _currentSampler.boost(); // Session edge: sample fast
+            _isChargingRequested = target;
+
+            if (_hasPending) {
+                emitAck(_pending, ACK_SUPERSEDED, now);
+                _hasPending = false;
+            }
+            if (target && _isSafetyCutoff) {
+                emitAck(cmd, ACK_REJECTED, now);
+                continue;
+            }
+            _pending = cmd;
+            _hasPending = true;
+        }
+    }
+
+    // Acknowledge the pending command once the main relay matches it
+    void confirmActuation(uint32_t now) {
+        if (!_hasPending) return;
+        #if ENABLE_RELAYS
+          if (_mainRelay->getState() != _isChargingRequested) return; // Held by the minimum on/off time
+        #endif
+        emitAck(_pending, ACK_APPLIED, now);
+        _hasPending = false;
+    }
     
   public:
     PowerManager(RelayDriver* main, RelayDriver* fan, CurrentSensorDriver* sensor) 
-      : _mainRelay(main), _fanRelay(fan), _sensor(sensor) {
+      : _mainRelay(main), _fanRelay(fan), _sensor(sensor),
+        _currentSampler(CURRENT_SAMPLE_MIN_MS, CURRENT_SAMPLE_MAX_MS, CURRENT_ACTIVITY_THRESH) {
         _isChargingRequested = false;
         _isSafetyCutoff = false;
         _lastCurrent = 0.0f;
+        _lastSampleUs = 0;
+        _nextCommandId = 1;
+        _hasPending = false;
+        _droppedCommands = 0;
+        _droppedAcks = 0;
+        _trace = NULL;
+        _lastSnapshotMs = 0;
+        _mainChannel = _relays.add(main, "main", RELAY_MAIN_MIN_ON_MS, RELAY_MAIN_MIN_OFF_MS);
+        _fanChannel  = _relays.add(fan,  "fan",  RELAY_FAN_MIN_ON_MS,  RELAY_FAN_MIN_OFF_MS);
     }
 
     void begin() {
       #if ENABLE_RELAYS
         _mainRelay->begin();
         _fanRelay->begin();
+        _relays.begin();
       #endif
       #if ENABLE_SENSORS
         _sensor->begin();
+        #if ENABLE_CAPTURE
+          _sensor->attachCapture(&_capture);
+        #endif
       #endif
+      if (_trace) _trace->record(TRACE_STATE, getTraceState());
+      _lastSnapshotMs = millis();
+    }
+
+    // Record commands, capture requests and state snapshots (and the sensor's
+    // samples) for a host replay. Call before begin().
+    void attachTrace(TraceRecorder* trace) {
+      _trace = trace;
+      _sensor->attachTrace(trace);
     }
 
     void update() {
-      // 1. Read Sensors
+      uint32_t now = millis();
+
+      // 0. Commands posted since the last tick
+      processCommands(now);
+
+      // 1. Read Sensors. The adaptive backoff only applies while the station is
+      // idle: with a charge requested or the main relay closed the current is
+      // safety-monitored every tick (CURRENT_SAMPLE_MIN_MS).
       float current = 0.0f;
       #if ENABLE_SENSORS
-        current = _sensor->read();
-        _lastCurrent = current;
+        bool underLoad = _isChargingRequested || _mainRelay->getState();
+        if (underLoad || _currentSampler.isDue(now) || _capture.isArmed()) { // Armed capture needs every tick
+          _lastCurrent = _sensor->read();
+          _lastSampleUs = esp_timer_get_time(); // Stamped here, converted to Unix time per report
+          _currentSampler.addSample(_lastCurrent, now);
+          #if ENABLE_SERIES_UPLOAD
+            _currentSeries.add(now, _lastCurrent);
+          #endif
+          #if ENABLE_AGGREGATES
+            _currentAgg.add(_lastCurrent);
+          #endif
+          #if ENABLE_SESSIONS
+            _session.add(_lastCurrent, now);
+          #endif
+        }
+        current = _lastCurrent;
       #endif
       
-      // 2. Safety Logic
+      // 2. Control Logic: desired state of every relay for this tick
       #if ENABLE_RELAYS
-        if (current > SAFETY_CURRENT_LIMIT && _mainRelay->getState()) {
-          _fanRelay->on();
-          // Ideally we might want to cut off charging too if it's DANGEROUSLY high
-          // But spec says "Limit > 3.0A triggers Fan". 
-        } else {
-          _fanRelay->off();
-        }
-      #endif
+        bool mainOn = _isChargingRequested && !_isSafetyCutoff;
+        _relays.request(_mainChannel, mainOn, _isSafetyCutoff);
 
-      // 3. Control Logic
-      #if ENABLE_RELAYS
-        if (_isChargingRequested && !_isSafetyCutoff) {
-            _mainRelay->on();
-        } else {
-            _mainRelay->off();
-            _fanRelay->off(); // Safe state
-        }
+        // 3. Safety Logic
+        // Ideally we might want to cut off charging too if it's DANGEROUSLY high
+        // But spec says "Limit > 3.0A triggers Fan". Fan is off in the safe state.
+        bool fanOn = mainOn && current > SAFETY_CURRENT_LIMIT && _mainRelay->getState();
+        _relays.request(_fanChannel, fanOn, !mainOn);
+
+        // 4. Apply only what changed
+        _relays.apply();
       #endif
+
+      // 5. Acknowledge once the relay has switched
+      confirmActuation(now);
+
+      // 6. Trace check point
+      if (_trace && now - _lastSnapshotMs >= TRACE_SNAPSHOT_MS) {
+        _trace->record(TRACE_STATE, getTraceState());
+        _lastSnapshotMs = now;
+      }
     }
     
-    // API for Services/UI
-    void setChargingRequest(bool state) {
-        _isChargingRequested = state;
+    // API for Services/UI (any task). ref: server command id, NULL if none.
+    // Returns false if the mailbox is full.
+    bool post(CommandAction action, CommandSource source, const char* ref = NULL) {
+        PowerCommand cmd;
+        cmd.id = _nextCommandId.fetch_add(1);
+        cmd.issuedMs = millis();
+        cmd.action = action;
+        cmd.source = source;
+        cmd.setRef(ref);
+        // Button commands are replayed from the button edges
+        if (_trace && source != CMD_SOURCE_LOCAL) _trace->record(TRACE_COMMAND, action | (source << 4), 0, cmd.id);
+        if (!_mailbox.push(cmd)) {
+            _droppedCommands.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Next acknowledgement for a source (one consumer task per source)
+    bool takeAck(CommandSource source, CommandAck& out) {
+        return source < CMD_ACK_SOURCES && _acks[source].pop(out);
     }
     
+    // Next session start/end event (IoT job only)
+    bool takeSessionEvent(SessionEvent& out) {
+        return _session.take(out);
+    }
+
+    bool isSessionActive() {
+        return _session.isActive();
+    }
+
     bool getChargingRequest() {
         return _isChargingRequested;
     }
     
-    void toggleChargingRequest() {
-        _isChargingRequested = !_isChargingRequested;
-    }
-    
     float getCurrent() {
         return _lastCurrent;
     }
+
+    // Monotonic time at which getCurrent() was acquired (now without a sensor)
+    int64_t getCurrentSampledUs() {
+        return _lastSampleUs ? _lastSampleUs : esp_timer_get_time();
+    }
+
+    uint32_t getCurrentSampleInterval() {
+        return _currentSampler.getIntervalMs();
+    }
+
+    TelemetrySeries* getCurrentSeries() {
+        return &_currentSeries;
+    }
+
+    WindowAggregator* getCurrentAggregator() {
+        return &_currentAgg;
+    }
+
+    // Start recording pre-trigger history; fires when |I| > CAPTURE_TRIGGER_AMPS
+    bool armCapture() {
+        const uint16_t zeroRaw = ACS_ZERO_VOLTAGE / ADC_VREF * ADC_RESOLUTION;
+        const uint16_t deltaRaw = CAPTURE_TRIGGER_AMPS * ACS_SENSITIVITY / ADC_VREF * ADC_RESOLUTION;
+        if (_trace) _trace->record(TRACE_CAPTURE, 0);
+        return _capture.arm(zeroRaw, deltaRaw);
+    }
+
+    // Capture now (after the pre-trigger history has been recorded)
+    void triggerCapture() {
+        if (_trace) _trace->record(TRACE_CAPTURE, 1);
+        _capture.arm(0, 0); // No-op if already armed
+        _capture.trigger();
+    }
+
+    WaveformCapture* getCapture() {
+        return &_capture;
+    }
+
+    TraceRecorder* getTrace() {
+        return _trace;
+    }
+
+    // TRACE_STATE_* flags of the control state (trace snapshots, replay checks)
+    uint8_t getTraceState() {
+        uint8_t flags = 0;
+        if (_isChargingRequested) flags |= TRACE_STATE_REQUESTED;
+        if (_isSafetyCutoff)      flags |= TRACE_STATE_CUTOFF;
+        if (_mainRelay->getState()) flags |= TRACE_STATE_MAIN;
+        if (_fanRelay->getState())  flags |= TRACE_STATE_FAN;
+        return flags;
+    }
+
+    // Boot self-test (setup() only, before the jobs start): pulse the main relay
+    // through the bank, so its switch counter and minimum off time include it
+    void selfTestMainRelay(uint32_t holdMs) {
+        _relays.request(_mainChannel, true);
+        _relays.apply();
+        delay(holdMs);
+        _relays.request(_mainChannel, false, true); // Urgent: the pulse may be shorter than the minimum on time
+        _relays.apply();
+    }
+
+    RelayBank* getRelays() {
+        return &_relays;
+    }
+
+    uint32_t getMainSwitchCount() {
+        return _relays.getSwitchCount(_mainChannel);
+    }
+
+    uint32_t getFanSwitchCount() {
+        return _relays.getSwitchCount(_fanChannel);
+    }
     
+    // Nothing to switch, sample fast or hold awake for (Scheduler idle source)
+    bool isIdle() {
+        if (_isChargingRequested || _hasPending || _capture.isArmed()) return false;
+        #if ENABLE_RELAYS
+          if (_mainRelay->getState() || _fanRelay->getState()) return false; // Minimum on time pending
+        #endif
+        #if ENABLE_SENSORS
+          if (fabsf(_lastCurrent) >= PM_IDLE_MAX_AMPS) return false;
+          #if ENABLE_SESSIONS
+            if (_session.isActive()) return false;
+          #endif
+        #endif
+        return true;
+    }
+
     String getStatusString() {
         if (_isSafetyCutoff) return "FAULT";
-        if (_mainRelay->getState()) return "CHARGING";
+        #if ENABLE_SENSORS && ENABLE_SESSIONS
+          if (_session.isActive()) return "CHARGING"; // Current is actually flowing
+        #else
+          if (_mainRelay->getState()) return "CHARGING";
+        #endif
         return "AVAILABLE";
     }
 };
@@ -115,7 +353,7 @@ class InterfaceManager {
       #if ENABLE_BUTTON
         _button->update();
         if (_button->wasPressed()) {
-            _powerManager->toggleChargingRequest(); // Command the PowerManager
+            _powerManager->post(CMD_CHARGE_TOGGLE, CMD_SOURCE_LOCAL); // Command the PowerManager
         }
       #endif
       
@@ -135,16 +373,24 @@ class InterfaceManager {
 
 // --- Solar Manager ---
 // Responsibilities: Periodically read Solar Data
+// Released every SOLAR_READ_PERIOD by the Scheduler; the Modbus transaction only
+// runs when the PV or battery channel is due, so a flat signal (e.g. at night)
+// backs the polling off towards PV_SAMPLE_MAX_MS.
 class SolarManager {
   private:
     SolarDriver* _driver;
-    unsigned long _lastReadTime;
-    const unsigned long _readInterval = 2000; // Read every 2s
+    AdaptiveSampler _pvSampler;
+    AdaptiveSampler _battSampler;
+    TelemetrySeries _pvSeries;
+    TelemetrySeries _battSeries;
+    WindowAggregator _pvAgg;
+    WindowAggregator _battAgg;
     
   public:
-    SolarManager(SolarDriver* driver) : _driver(driver) {
-        _lastReadTime = 0;
-    }
+    SolarManager(SolarDriver* driver)
+      : _driver(driver),
+        _pvSampler(PV_SAMPLE_MIN_MS, PV_SAMPLE_MAX_MS, PV_ACTIVITY_THRESH),
+        _battSampler(BATT_SAMPLE_MIN_MS, BATT_SAMPLE_MAX_MS, BATT_ACTIVITY_THRESH) {}
     
     void begin() {
       #if ENABLE_SOLAR
@@ -154,9 +400,20 @@ class SolarManager {
     
     void update() {
       #if ENABLE_SOLAR
-        if (millis() - _lastReadTime > _readInterval) {
+        uint32_t now = millis();
+        if (_pvSampler.isDue(now) || _battSampler.isDue(now)) {
             _driver->readData();
-            _lastReadTime = millis();
+            // One transaction refreshes both channels
+            _pvSampler.addSample(_driver->getPvPower(), now);
+            _battSampler.addSample(_driver->getBattVoltage(), now);
+            #if ENABLE_SERIES_UPLOAD
+              _pvSeries.add(now, _driver->getPvPower());
+              _battSeries.add(now, _driver->getBattVoltage());
+            #endif
+            #if ENABLE_AGGREGATES
+              _pvAgg.add(_driver->getPvPower());
+              _battAgg.add(_driver->getBattVoltage());
+            #endif
         }
       #endif
     }
@@ -176,6 +433,11 @@ class SolarManager {
             return 0.0f;
         #endif
     }
+
+    TelemetrySeries* getPvSeries() { return &_pvSeries; }
+    TelemetrySeries* getBattSeries() { return &_battSeries; }
+    WindowAggregator* getPvAggregator() { return &_pvAgg; }
+    WindowAggregator* getBattAggregator() { return &_battAgg; }
 };
 
 #endif // MANAGERS_H
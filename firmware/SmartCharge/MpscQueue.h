@@ -0,0 +1,65 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+// --- Bounded MPSC Queue ---
+// Responsibilities: Lock-free hand-over of small records between tasks/cores
+// Dmitry Vyukov's bounded queue: every cell carries a sequence number, a
+// producer claims a position with one CAS on the enqueue counter and publishes
+// the cell with a release store. push() never blocks: it fails when the queue
+// is full. pop() must only be called from one task.
+template <typename T, uint32_t N>
+class MpscQueue {
+  private:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+
+    struct Cell {
+      std::atomic<uint32_t> seq; // pos = free for lap pos, pos + 1 = holds a value
+      T value;
+    };
+
+    Cell _cells[N];
+    std::atomic<uint32_t> _enqueuePos;
+    uint32_t _dequeuePos;
+
+  public:
+    MpscQueue() : _enqueuePos(0), _dequeuePos(0) {
+      for (uint32_t i = 0; i < N; i++) {
+        _cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    bool push(const T& value) {
+      uint32_t pos = _enqueuePos.load(std::memory_order_relaxed);
+      Cell* cell;
+      for (;;) {
+        cell = &_cells[pos & (N - 1)];
+        int32_t dif = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+        if (dif == 0) {
+          if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+          return false; // Full
+        } else {
+          pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+      }
+      cell->value = value;
+      cell->seq.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(T& out) {
+      Cell* cell = &_cells[_dequeuePos & (N - 1)];
+      if ((int32_t)(cell->seq.load(std::memory_order_acquire) - (_dequeuePos + 1)) < 0) {
+        return false; // Empty
+      }
+      out = cell->value;
+      cell->seq.store(_dequeuePos + N, std::memory_order_release);
+      _dequeuePos++;
+      return true;
+    }
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,340 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "Config.h"
+
+// Outbox metrics (exposed in the MQTT state payload)
+struct OutboxStats {
+  uint16_t depth;          // Queued + in flight
+  uint16_t inFlight;       // QoS 1 messages waiting for PUBACK
+  uint32_t delivered;      // Sent (QoS 0) or acknowledged (QoS 1)
+  uint32_t dropped;        // Rejected or superseded while the pool was full
+  uint32_t retransmits;    // QoS 1 resends (timeout or reconnect)
+  uint32_t lastLatencyMs;  // Enqueue -> delivery of the last message
+  uint32_t maxLatencyMs;
+};
+
+// --- MQTT Outbox ---
+// Responsibilities: Bounded message pool, Non-blocking enqueue, QoS 1 in-flight window, Retransmission
+// PubSubClient only publishes QoS 0 and ignores PUBACK, so the outbox writes its own
+// PUBLISH packets through the same connection and learns about PUBACKs from
+// MqttAckTap below. enqueue() may be called from any task; service() and
+// onPuback() run in the MQTT job. A slot being written is SENDING, which
+// enqueue() never supersedes, so service() can write it outside the lock.
+class MqttOutbox {
+  private:
+    enum SlotState : uint8_t { FREE, QUEUED, SENDING, IN_FLIGHT };
+
+    struct Slot {
+      SlotState state;
+      uint8_t qos;
+      bool retain;
+      bool dup;
+      uint16_t packetId;
+      uint16_t length;
+      uint32_t seq;         // FIFO order
+      uint32_t enqueuedMs;
+      uint32_t sentMs;
+      const char* topic;    // Topics are compile-time constants
+      uint8_t payload[MQTT_OUTBOX_PAYLOAD];
+    };
+
+    Slot _slots[MQTT_OUTBOX_SLOTS];
+    uint8_t _packet[MQTT_OUTBOX_PAYLOAD + 128]; // Header + topic + packet id + payload
+    uint32_t _nextSeq;
+    uint16_t _nextPacketId;
+    OutboxStats _stats;
+    portMUX_TYPE _lock;
+
+    void recordDelivery(Slot& slot, uint32_t now) {
+      uint32_t latency = now - slot.enqueuedMs;
+      _stats.lastLatencyMs = latency;
+      if (latency > _stats.maxLatencyMs) _stats.maxLatencyMs = latency;
+      _stats.delivered++;
+      slot.state = FREE;
+    }
+
+    // PUBLISH packet size without the fixed header (enqueue() rejects what does not fit _packet)
+    static size_t remainingLength(const char* topic, size_t length, uint8_t qos) {
+      return 2 + strlen(topic) + (qos ? 2 : 0) + length;
+    }
+
+    // Serialize and write one PUBLISH packet. Returns false on a failed or short write.
+    bool writePublish(Client& client, Slot& slot) {
+      size_t topicLen = strlen(slot.topic);
+      size_t remaining = remainingLength(slot.topic, slot.length, slot.qos);
+
+      size_t pos = 0;
+      _packet[pos++] = 0x30 | (slot.dup ? 0x08 : 0) | (slot.qos << 1) | (slot.retain ? 0x01 : 0);
+      do { // Remaining length (variable byte integer)
+        uint8_t b = remaining % 128;
+        remaining /= 128;
+        _packet[pos++] = remaining ? (b | 0x80) : b;
+      } while (remaining);
+      _packet[pos++] = topicLen >> 8;
+      _packet[pos++] = topicLen & 0xFF;
+      memcpy(&_packet[pos], slot.topic, topicLen);
+      pos += topicLen;
+      if (slot.qos) {
+        _packet[pos++] = slot.packetId >> 8;
+        _packet[pos++] = slot.packetId & 0xFF;
+      }
+      memcpy(&_packet[pos], slot.payload, slot.length);
+      pos += slot.length;
+
+      return client.write(_packet, pos) == pos;
+    }
+
+    // Oldest QUEUED slot, or NULL
+    Slot* nextQueued() {
+      Slot* best = NULL;
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        if (_slots[i].state == QUEUED && (!best || _slots[i].seq < best->seq)) {
+          best = &_slots[i];
+        }
+      }
+      return best;
+    }
+
+  public:
+    MqttOutbox() : _nextSeq(0), _nextPacketId(1) {
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        _slots[i].state = FREE;
+      }
+      memset(&_stats, 0, sizeof(_stats));
+      _lock = portMUX_INITIALIZER_UNLOCKED;
+    }
+
+    // Non-blocking. When the pool is full, the oldest queued message on the same
+    // topic is superseded (a newer state replaces an older one); otherwise the
+    // new message is dropped.
+    bool enqueue(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+      if (length > MQTT_OUTBOX_PAYLOAD || remainingLength(topic, length, qos) + 5 > sizeof(_packet)) {
+        _stats.dropped++;
+        return false;
+      }
+
+      portENTER_CRITICAL(&_lock);
+      Slot* slot = NULL;
+      Slot* oldestSameTopic = NULL;
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        Slot& s = _slots[i];
+        if (s.state == FREE) {
+          slot = &s;
+          break;
+        }
+        if (s.state == QUEUED && strcmp(s.topic, topic) == 0 &&
+            (!oldestSameTopic || s.seq < oldestSameTopic->seq)) {
+          oldestSameTopic = &s;
+        }
+      }
+      if (!slot && oldestSameTopic) {
+        slot = oldestSameTopic;
+        _stats.dropped++;
+      }
+
+      if (slot) {
+        slot->state = QUEUED;
+        slot->qos = qos ? 1 : 0;
+        slot->retain = retain;
+        slot->dup = false;
+        slot->packetId = 0;
+        slot->length = length;
+        slot->seq = _nextSeq++;
+        slot->enqueuedMs = millis();
+        slot->sentMs = 0;
+        slot->topic = topic;
+        memcpy(slot->payload, payload, length);
+      } else {
+        _stats.dropped++;
+      }
+      portEXIT_CRITICAL(&_lock);
+      return slot != NULL;
+    }
+
+    // Connection (re)established: everything unacknowledged goes out again with DUP
+    void onReconnect() {
+      portENTER_CRITICAL(&_lock);
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        if (_slots[i].state == IN_FLIGHT) {
+          _slots[i].state = QUEUED;
+          _slots[i].dup = true;
+          _stats.retransmits++;
+        }
+      }
+      portEXIT_CRITICAL(&_lock);
+    }
+
+    // Called by MqttAckTap for every PUBACK seen on the wire
+    void onPuback(uint16_t packetId) {
+      uint32_t now = millis();
+      portENTER_CRITICAL(&_lock);
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        if (_slots[i].state == IN_FLIGHT && _slots[i].packetId == packetId) {
+          recordDelivery(_slots[i], now);
+          break;
+        }
+      }
+      portEXIT_CRITICAL(&_lock);
+    }
+
+    // Send what the in-flight window allows and resend timed-out QoS 1 messages.
+    // Only call while connected. A failed or short write leaves a partial packet
+    // on the stream, so the connection is closed: the reconnect runs onReconnect()
+    // and everything unacknowledged goes out again with DUP.
+    void service(Client& client) {
+      uint32_t now = millis();
+      uint8_t inFlight = 0;
+
+      // Retransmit QoS 1 messages whose PUBACK is overdue
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        Slot& s = _slots[i];
+        if (s.state != IN_FLIGHT) continue;
+        inFlight++;
+        if (now - s.sentMs >= MQTT_RETRY_MS) {
+          s.dup = true;
+          if (!writePublish(client, s)) {
+            client.stop();
+            return;
+          }
+          s.sentMs = now;
+          _stats.retransmits++;
+        }
+      }
+
+      // Drain the queue in FIFO order
+      for (;;) {
+        portENTER_CRITICAL(&_lock);
+        Slot* s = nextQueued();
+        bool blocked = s && s->qos && inFlight >= MQTT_INFLIGHT_WINDOW;
+        if (s && !blocked) {
+          if (s->qos && !s->dup) {
+            s->packetId = _nextPacketId++;
+            if (_nextPacketId == 0) _nextPacketId = 1; // 0 is not a valid packet id
+          }
+          s->state = SENDING; // enqueue() no longer supersedes it
+        }
+        portEXIT_CRITICAL(&_lock);
+        if (!s || blocked) break;
+
+        bool written = writePublish(client, *s);
+
+        portENTER_CRITICAL(&_lock);
+        if (!written) {
+          s->state = QUEUED; // Resent after the reconnect; part of it may have reached the broker
+          s->dup = s->qos != 0;
+        } else if (s->qos) {
+          s->sentMs = now;
+          s->state = IN_FLIGHT;
+          inFlight++;
+        } else {
+          recordDelivery(*s, now);
+        }
+        portEXIT_CRITICAL(&_lock);
+
+        if (!written) {
+          client.stop();
+          break;
+        }
+      }
+    }
+
+    uint8_t getFreeSlots() {
+      uint8_t free = 0;
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        if (_slots[i].state == FREE) free++;
+      }
+      return free;
+    }
+
+    OutboxStats getStats() {
+      OutboxStats stats = _stats;
+      stats.depth = 0;
+      stats.inFlight = 0;
+      for (uint8_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        if (_slots[i].state != FREE) stats.depth++;
+        if (_slots[i].state == IN_FLIGHT) stats.inFlight++;
+      }
+      return stats;
+    }
+};
+
+// --- MQTT Ack Tap ---
+// Responsibilities: Transparent Client wrapper that reports PUBACK packets to the outbox
+// Sits between PubSubClient and the network client. Bytes pass through unchanged;
+// a small state machine follows MQTT packet boundaries on the receive side.
+class MqttAckTap : public Client {
+  private:
+    Client* _inner;
+    MqttOutbox* _outbox;
+
+    enum ParseState : uint8_t { HEADER, LENGTH, BODY };
+    ParseState _parse;
+    uint8_t _type;
+    uint32_t _remaining;
+    uint32_t _multiplier;
+    uint16_t _ackId;
+
+    void observe(uint8_t b) {
+      switch (_parse) {
+        case HEADER:
+          _type = b >> 4;
+          _remaining = 0;
+          _multiplier = 1;
+          _ackId = 0;
+          _parse = LENGTH;
+          break;
+        case LENGTH:
+          _remaining += (b & 0x7F) * _multiplier;
+          _multiplier *= 128;
+          if (!(b & 0x80)) _parse = _remaining ? BODY : HEADER;
+          break;
+        case BODY:
+          if (_type == 4) _ackId = (_ackId << 8) | b; // PUBACK: 2-byte packet id
+          if (--_remaining == 0) {
+            if (_type == 4) _outbox->onPuback(_ackId);
+            _parse = HEADER;
+          }
+          break;
+      }
+    }
+
+  public:
+    MqttAckTap(Client* inner, MqttOutbox* outbox)
+      : _inner(inner), _outbox(outbox), _parse(HEADER), _type(0), _remaining(0), _multiplier(1), _ackId(0) {}
+
+    int connect(IPAddress ip, uint16_t port) {
+      _parse = HEADER;
+      return _inner->connect(ip, port);
+    }
+
+    int connect(const char* host, uint16_t port) {
+      _parse = HEADER;
+      return _inner->connect(host, port);
+    }
+
+    size_t write(uint8_t b) { return _inner->write(b); }
+    size_t write(const uint8_t* buf, size_t size) { return _inner->write(buf, size); }
+    int available() { return _inner->available(); }
+    int peek() { return _inner->peek(); }
+    void flush() { _inner->flush(); }
+    void stop() { _inner->stop(); }
+    uint8_t connected() { return _inner->connected(); }
+    operator bool() { return _inner->connected(); }
+
+    int read() {
+      int b = _inner->read();
+      if (b >= 0) observe((uint8_t)b);
+      return b;
+    }
+
+    int read(uint8_t* buf, size_t size) {
+      int n = _inner->read(buf, size);
+      for (int i = 0; i < n; i++) observe(buf[i]);
+      return n;
+    }
+};
+
+#endif // MQTT_OUTBOX_H
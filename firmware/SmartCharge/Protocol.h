@@ -0,0 +1,150 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Wire formats shared by IoTService, MQTTService and the host-side tools in
+// firmware/tools/. Only depends on ArduinoJson so it also builds on a PC.
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+
+// --- Telemetry Snapshot ---
+// Values collected from the Managers for one report
+struct TelemetryReport {
+  float current;      // A
+  float voltage;      // V (scaled from battery voltage)
+  float pvPower;      // W (solar power)
+  float battVoltage;  // V (battery voltage)
+  const char* status; // PowerManager::getStatusString()
+  bool relayOn;       // Charging requested
+  int64_t timestamp;  // Unix ms at which the current was acquired (DeviceClock), 0: unknown
+};
+
+// --- Window Statistics ---
+// One channel over one reporting window (see WindowAggregator.h)
+struct WindowStats {
+  uint32_t count;
+  float min;
+  float max;
+  float mean;
+  float variance;
+  float p50; // Streaming estimates
+  float p95;
+};
+
+// "agg": { "<channel>": { n, min, max, mean, var, p50, p95 } }; empty windows are omitted
+inline void addWindowStats(JsonObject agg, const char* channel, const WindowStats& s) {
+  if (s.count == 0) return;
+  JsonObject o = agg[channel].to<JsonObject>();
+  o["n"]    = s.count;
+  o["min"]  = s.min;
+  o["max"]  = s.max;
+  o["mean"] = s.mean;
+  o["var"]  = s.variance;
+  o["p50"]  = s.p50;
+  o["p95"]  = s.p95;
+}
+
+// --- Remote Commands ---
+enum RemoteCommand {
+  CMD_NONE,
+  CMD_START,
+  CMD_STOP,
+  CMD_CAPTURE,
+  CMD_CAPTURE_ARM,
+  CMD_TRACE        // Upload the input trace on MQTT_TOPIC_TRACE
+};
+
+// Server command strings (DeviceCommand.command)
+inline RemoteCommand parseServerCommand(const char* cmd) {
+  if (!cmd) return CMD_NONE;
+  if (strcmp(cmd, "START") == 0) return CMD_START;
+  if (strcmp(cmd, "STOP") == 0) return CMD_STOP;
+  if (strcmp(cmd, "CAPTURE") == 0) return CMD_CAPTURE;
+  if (strcmp(cmd, "TRACE") == 0) return CMD_TRACE;
+  return CMD_NONE;
+}
+
+// MQTT command payloads (Home Assistant switch)
+inline RemoteCommand parseMqttCommand(const char* msg) {
+  if (!msg) return CMD_NONE;
+  if (strcmp(msg, "ON") == 0) return CMD_START;
+  if (strcmp(msg, "OFF") == 0) return CMD_STOP;
+  if (strcmp(msg, "CAPTURE") == 0) return CMD_CAPTURE;
+  if (strcmp(msg, "CAPTURE_ARM") == 0) return CMD_CAPTURE_ARM;
+  if (strcmp(msg, "TRACE") == 0) return CMD_TRACE;
+  return CMD_NONE;
+}
+
+// --- HTTP: POST /api/iot/stations/[id] ---
+// Backend expects: voltage, current, power, temperature, status, deviceId
+inline void buildTelemetryDoc(JsonDocument& doc, const TelemetryReport& r, int stationId) {
+  char deviceId[32];
+  snprintf(deviceId, sizeof(deviceId), "esp32-station-%d", stationId);
+
+  doc["voltage"]     = r.voltage;                        // V (scaled from battery voltage)
+  doc["current"]     = r.current;                        // A
+  doc["power"]       = (r.voltage * r.current) / 1000.0f; // kW
+  doc["pvPower"]     = r.pvPower;                        // W (solar power)
+  doc["battVoltage"] = r.battVoltage;                    // V (battery voltage)
+  doc["deviceId"]    = deviceId;
+  if (r.timestamp) doc["timestamp"] = r.timestamp;       // Otherwise the server's receive time
+
+  // Map status string to backend enum values
+  // Backend expects: AVAILABLE, OCCUPIED, RESERVED, MAINTENANCE, FAULT
+  // (PowerManager::getStatusString(): AVAILABLE, CHARGING, FAULT)
+  if (strcmp(r.status, "AVAILABLE") == 0 || strcmp(r.status, "IDLE") == 0) {
+    doc["status"] = "AVAILABLE";
+  } else if (strcmp(r.status, "CHARGING") == 0) {
+    doc["status"] = "OCCUPIED";
+  } else if (strcmp(r.status, "FAULT") == 0) {
+    doc["status"] = "FAULT";
+  }
+  // If status doesn't match, let the backend infer from sensor data
+}
+
+// Sent with every report: the server answers 204 No Content when no command is
+// pending, otherwise a minimal { command } body
+#define PREFER_MINIMAL_HEADER "return=minimal"
+
+// Only the command fields survive deserialization (see deserializeJson Filter),
+// so the rest of a full response never reaches the heap
+inline void buildCommandFilter(JsonDocument& filter) {
+  filter["command"] = true;
+  filter["commandId"] = true;
+  filter["data"]["command"] = true;
+  filter["data"]["commandId"] = true;
+}
+
+// Command carried by the server response, NULL if none
+inline const char* extractCommand(JsonDocument& res) {
+  const char* cmd = NULL;
+  // Check for command in response
+  if (res["command"].is<const char*>()) {
+    cmd = res["command"];
+  }
+  // Also check nested in data object
+  if (res["data"]["command"].is<const char*>()) {
+    cmd = res["data"]["command"];
+  }
+  return cmd;
+}
+
+// DeviceCommand id of that command (echoed back in the acknowledgement), NULL if none
+inline const char* extractCommandId(JsonDocument& res) {
+  if (res["commandId"].is<const char*>()) return res["commandId"];
+  if (res["data"]["commandId"].is<const char*>()) return res["data"]["commandId"];
+  return NULL;
+}
+
+// --- MQTT: smartcharge/<station>/state ---
+inline void buildStateDoc(JsonDocument& doc, const TelemetryReport& r) {
+  doc["voltage"]      = r.voltage;
+  doc["current"]      = r.current;
+  doc["power"]        = (r.voltage * r.current) / 1000.0f; // kW
+  doc["pv_power"]     = r.pvPower;
+  doc["batt_voltage"] = r.battVoltage;
+  doc["relay"]        = r.relayOn ? "ON" : "OFF";
+  if (r.timestamp) doc["ts"] = r.timestamp;
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,366 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "LowPower.h"
+#include "Log.h"
+
+// Job entry point. `context` is the object registered with the job.
+typedef void (*JobFunction)(void* context);
+
+// Per-job timing statistics (written by the job's own task, read by anyone)
+struct JobStats {
+  uint32_t releases;        // Number of times the job ran
+  uint32_t deadlineMisses;  // Completions later than release + deadline
+  uint32_t skippedReleases; // Whole periods dropped after an overrun
+  uint32_t lastExecUs;      // Execution time of the last release
+  uint32_t maxExecUs;       // Worst observed execution time
+  uint64_t totalExecUs;     // Accumulated execution time (active)
+  uint64_t idleUs;          // Blocked between releases, chip awake
+  uint64_t sleepUs;         // Blocked between releases, chip in light sleep
+  uint32_t wakeups;         // Early releases by the wake pin
+};
+
+// Station state that lets jobs run at their idle period (see Scheduler::setIdleSource)
+typedef bool (*IdleFunction)(void* context);
+
+// --- Rate-Monotonic Scheduler ---
+// Responsibilities: Periodic job release on absolute ticks, RM priority assignment, Deadline accounting
+// Each registered job gets its own FreeRTOS task pinned to the requested core.
+// Priorities follow rate-monotonic order per core: the shorter the period, the
+// higher the priority, so a slow job (Modbus, HTTP) can never stretch a fast one.
+// Background jobs (log drain) sit below every rate-monotonic job and only run
+// when the core is otherwise idle.
+// Low power (ENABLE_LOW_POWER): while the idle source reports the station idle,
+// jobs with an idle period are released at that longer period so the chip can
+// light-sleep in between; a wake pin releases its job at once and keeps it at
+// the normal rate for PM_WAKE_HOLD_MS. Keep-awake jobs hold an AwakeLock while
+// they run. The time between releases is split into idle and sleep per job.
+class Scheduler {
+  private:
+    struct Job {
+      const char* name;
+      JobFunction fn;
+      void* context;
+      TickType_t period;
+      TickType_t deadline;
+      BaseType_t core;
+      uint32_t stackSize;
+      UBaseType_t priority;
+      bool background;
+      TaskHandle_t handle;
+      TickType_t epoch;
+      JobStats stats;
+
+      Scheduler* owner;
+      TickType_t idlePeriod; // 0: always the normal period
+      TickType_t fullRateUntil;
+      WakePin wake;
+      bool keepAwake;
+      AwakeLock awake;
+    };
+
+    Job _jobs[SCHED_MAX_JOBS];
+    uint8_t _jobCount;
+    bool _started;
+    IdleFunction _isIdle;
+    void* _idleContext;
+
+    // Template trampoline so any Manager/Service exposing update() can be registered
+    template <class T>
+    static void invokeUpdate(void* context) {
+      static_cast<T*>(context)->update();
+    }
+
+    template <class T>
+    static bool invokeIsIdle(void* context) {
+      return static_cast<T*>(context)->isIdle();
+    }
+
+    Job* find(const char* name) {
+      for (uint8_t i = 0; i < _jobCount; i++) {
+        if (strcmp(_jobs[i].name, name) == 0) return &_jobs[i];
+      }
+      return NULL;
+    }
+
+    // Period to the next release: stretched while the station is idle
+    static TickType_t nextPeriod(Job* job) {
+      if (!job->idlePeriod) return job->period;
+      if ((int32_t)(job->fullRateUntil - xTaskGetTickCount()) > 0) return job->period;
+      Scheduler* s = job->owner;
+      return s->_isIdle && s->_isIdle(s->_idleContext) ? job->idlePeriod : job->period;
+    }
+
+    // Block until the next release (or the wake pin) and account the wait
+    static void waitForRelease(Job* job, TickType_t& release) {
+      int64_t waitUs = esp_timer_get_time();
+      uint32_t sleptUs = LowPower::getSleptUs();
+
+      #if ENABLE_LOW_POWER
+        release += nextPeriod(job);
+        int32_t ticks = (int32_t)(release - xTaskGetTickCount());
+        if (ticks > 0 && ulTaskNotifyTake(pdTRUE, (TickType_t)ticks) > 0) {
+          // Woken by the pin: release now and stay at full rate for a while
+          release = xTaskGetTickCount();
+          job->fullRateUntil = release + pdMS_TO_TICKS(PM_WAKE_HOLD_MS);
+          job->stats.wakeups++;
+        }
+      #else
+        vTaskDelayUntil(&release, job->period);
+      #endif
+
+      uint32_t blockedUs = (uint32_t)(esp_timer_get_time() - waitUs);
+      uint32_t sleepUs = LowPower::getSleptUs() - sleptUs; // Chip sleep needs every task blocked
+      if (sleepUs > blockedUs) sleepUs = blockedUs;
+      job->stats.idleUs += blockedUs - sleepUs;
+      job->stats.sleepUs += sleepUs;
+    }
+
+    static void jobTask(void* arg) {
+      Job* job = static_cast<Job*>(arg);
+      TickType_t release = job->epoch;
+
+      // All jobs share the same epoch so their releases stay phase-aligned
+      int32_t untilEpoch = (int32_t)(release - xTaskGetTickCount());
+      if (untilEpoch > 0) {
+        vTaskDelay((TickType_t)untilEpoch);
+      }
+
+      for (;;) {
+        int64_t startUs = esp_timer_get_time();
+        if (job->keepAwake) job->awake.acquire();
+        job->fn(job->context);
+        if (job->keepAwake) job->awake.release();
+        if (job->wake.pin >= 0) LowPower::rearmWakePin(job->wake.pin);
+        uint32_t execUs = (uint32_t)(esp_timer_get_time() - startUs);
+
+        JobStats& s = job->stats;
+        s.releases++;
+        s.lastExecUs = execUs;
+        s.totalExecUs += execUs;
+        if (execUs > s.maxExecUs) s.maxExecUs = execUs;
+
+        TickType_t elapsed = xTaskGetTickCount() - release;
+        if (elapsed > job->deadline) {
+          s.deadlineMisses++;
+        }
+
+        // Overran one or more whole periods: drop those releases instead of
+        // bursting to catch up, which would starve lower-priority jobs.
+        if (elapsed >= job->period) {
+          TickType_t skipped = elapsed / job->period;
+          release += skipped * job->period;
+          s.skippedReleases += skipped;
+        }
+
+        waitForRelease(job, release);
+      }
+    }
+
+    // Rate-monotonic priority: one level above the base for every job on the
+    // same core with a strictly longer period. Background jobs are not ranked.
+    void assignPriorities() {
+      for (uint8_t i = 0; i < _jobCount; i++) {
+        if (_jobs[i].background) {
+          _jobs[i].priority = SCHED_BACKGROUND_PRIORITY;
+          continue;
+        }
+        UBaseType_t rank = 0;
+        for (uint8_t j = 0; j < _jobCount; j++) {
+          if (!_jobs[j].background && _jobs[j].core == _jobs[i].core && _jobs[j].period > _jobs[i].period) {
+            rank++;
+          }
+        }
+        _jobs[i].priority = SCHED_BASE_PRIORITY + rank;
+      }
+    }
+
+  public:
+    Scheduler() : _jobCount(0), _started(false), _isIdle(NULL), _idleContext(NULL) {}
+
+    // Register a job. deadlineMs = 0 means "implicit deadline" (equal to the period).
+    bool addJob(const char* name, JobFunction fn, void* context,
+                uint32_t periodMs, uint32_t deadlineMs, BaseType_t core, uint32_t stackSize) {
+      if (_started || _jobCount >= SCHED_MAX_JOBS || periodMs == 0) return false;
+
+      Job& job = _jobs[_jobCount++];
+      job.name = name;
+      job.fn = fn;
+      job.context = context;
+      job.period = pdMS_TO_TICKS(periodMs);
+      job.deadline = pdMS_TO_TICKS(deadlineMs ? deadlineMs : periodMs);
+      job.core = core;
+      job.stackSize = stackSize;
+      job.priority = SCHED_BASE_PRIORITY;
+      job.background = false;
+      job.handle = NULL;
+      job.epoch = 0;
+      memset(&job.stats, 0, sizeof(job.stats));
+      job.owner = this;
+      job.idlePeriod = 0;
+      job.fullRateUntil = 0;
+      job.wake.pin = -1;
+      job.wake.task = NULL;
+      job.keepAwake = false;
+      return true;
+    }
+
+    // Register a Manager/Service whose update() is the job body
+    template <class T>
+    bool addUpdate(const char* name, T* obj,
+                   uint32_t periodMs, uint32_t deadlineMs, BaseType_t core, uint32_t stackSize) {
+      return addJob(name, &Scheduler::invokeUpdate<T>, obj, periodMs, deadlineMs, core, stackSize);
+    }
+
+    // Register a background job (below every rate-monotonic job, no deadline accounting)
+    template <class T>
+    bool addBackground(const char* name, T* obj, uint32_t periodMs, BaseType_t core, uint32_t stackSize) {
+      if (!addJob(name, &Scheduler::invokeUpdate<T>, obj, periodMs, 0, core, stackSize)) return false;
+      _jobs[_jobCount - 1].background = true;
+      _jobs[_jobCount - 1].deadline = portMAX_DELAY;
+      return true;
+    }
+
+    // Low power: release this job every idlePeriodMs while the station is idle
+    bool setIdlePeriod(const char* name, uint32_t idlePeriodMs) {
+      Job* job = find(name);
+      if (_started || !job || idlePeriodMs < job->period * portTICK_PERIOD_MS) return false;
+      job->idlePeriod = pdMS_TO_TICKS(idlePeriodMs);
+      return true;
+    }
+
+    // Low power: an active-low GPIO that releases this job immediately
+    bool setWakePin(const char* name, int pin) {
+      Job* job = find(name);
+      if (_started || !job) return false;
+      job->wake.pin = pin;
+      return true;
+    }
+
+    // Low power: no light sleep (and full APB clock) while this job runs
+    bool setKeepAwake(const char* name) {
+      Job* job = find(name);
+      if (_started || !job) return false;
+      job->keepAwake = true;
+      return true;
+    }
+
+    // Whatever decides that the station is idle (T::isIdle(), any task)
+    template <class T>
+    void setIdleSource(T* obj) {
+      _isIdle = &Scheduler::invokeIsIdle<T>;
+      _idleContext = obj;
+    }
+
+    // Create one task per job. Must be called once, after all jobs are registered.
+    void start() {
+      if (_started) return;
+      _started = true;
+      assignPriorities();
+
+      TickType_t epoch = xTaskGetTickCount() + pdMS_TO_TICKS(10); // Let every task get created first
+      for (uint8_t i = 0; i < _jobCount; i++) {
+        Job& job = _jobs[i];
+        job.epoch = epoch;
+        if (job.keepAwake) job.awake.begin(job.name);
+        xTaskCreatePinnedToCore(jobTask, job.name, job.stackSize, &job, job.priority, &job.handle, job.core);
+        if (job.wake.pin >= 0) {
+          job.wake.task = job.handle;
+          LowPower::attachWakePin(&job.wake);
+        }
+
+        Serial.print("Scheduler: ");
+        Serial.print(job.name);
+        Serial.print(" T=");
+        Serial.print((unsigned long)(job.period * portTICK_PERIOD_MS));
+        Serial.print("ms prio=");
+        Serial.print((unsigned long)job.priority);
+        Serial.print(" core=");
+        Serial.println((int)job.core);
+      }
+    }
+
+    uint8_t getJobCount() { return _jobCount; }
+
+    const char* getJobName(uint8_t index) {
+      return index < _jobCount ? _jobs[index].name : "";
+    }
+
+    const JobStats* getJobStats(uint8_t index) {
+      return index < _jobCount ? &_jobs[index].stats : NULL;
+    }
+
+    uint32_t getTotalDeadlineMisses() {
+      uint32_t total = 0;
+      for (uint8_t i = 0; i < _jobCount; i++) {
+        total += _jobs[i].stats.deadlineMisses;
+      }
+      return total;
+    }
+};
+
+// --- Duty Cycle Monitor ---
+// Responsibilities: Per-job active/idle/sleep shares over a report window
+// Registered as a background job: every release logs one line per job and one
+// for the chip, so it is obvious which job keeps the station awake.
+class DutyMonitor {
+  private:
+    struct Totals {
+      uint64_t activeUs;
+      uint64_t idleUs;
+      uint64_t sleepUs;
+    };
+
+    Scheduler* _scheduler;
+    Totals _last[SCHED_MAX_JOBS];
+    int64_t _lastUs;
+    uint32_t _lastSleptUs;
+    uint32_t _lastSleeps;
+
+    static float percent(uint64_t part, uint64_t whole) {
+      return whole ? 100.0f * (float)part / (float)whole : 0.0f;
+    }
+
+  public:
+    DutyMonitor(Scheduler* scheduler)
+      : _scheduler(scheduler), _lastUs(0), _lastSleptUs(0), _lastSleeps(0) {
+        memset(_last, 0, sizeof(_last));
+      }
+
+    void update() {
+      int64_t nowUs = esp_timer_get_time();
+      if (_lastUs == 0) { // First release: start the window
+        _lastUs = nowUs;
+        _lastSleptUs = LowPower::getSleptUs();
+        _lastSleeps = LowPower::getSleepCount();
+        for (uint8_t i = 0; i < _scheduler->getJobCount(); i++) {
+          const JobStats* s = _scheduler->getJobStats(i);
+          _last[i] = { s->totalExecUs, s->idleUs, s->sleepUs };
+        }
+        return;
+      }
+
+      for (uint8_t i = 0; i < _scheduler->getJobCount(); i++) {
+        const JobStats* s = _scheduler->getJobStats(i);
+        Totals now = { s->totalExecUs, s->idleUs, s->sleepUs };
+        uint64_t active = now.activeUs - _last[i].activeUs;
+        uint64_t idle   = now.idleUs - _last[i].idleUs;
+        uint64_t sleep  = now.sleepUs - _last[i].sleepUs;
+        uint64_t total  = active + idle + sleep;
+        LOG_I("Duty %s: active %.2f%% idle %.1f%% sleep %.1f%%", _scheduler->getJobName(i),
+              percent(active, total), percent(idle, total), percent(sleep, total));
+        _last[i] = now;
+      }
+
+      uint32_t slept = LowPower::getSleptUs() - _lastSleptUs;
+      uint32_t sleeps = LowPower::getSleepCount() - _lastSleeps;
+      LOG_I("Duty chip: light sleep %.1f%% (%lu sleeps)", percent(slept, nowUs - _lastUs), (unsigned long)sleeps);
+      _lastUs = nowUs;
+      _lastSleptUs += slept;
+      _lastSleeps += sleeps;
+    }
+};
+
+#endif // SCHEDULER_H
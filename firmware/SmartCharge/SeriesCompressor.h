@@ -0,0 +1,193 @@
+#ifndef SERIES_COMPRESSOR_H
+#define SERIES_COMPRESSOR_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// --- Series Block ---
+// Responsibilities: Gorilla-style encoding of (timestamp, float) samples into a fixed buffer
+// Bit stream (MSB first), decoded by lib/gorilla.ts on the server:
+//   first sample : 32-bit timestamp (ms), 32-bit raw float
+//   timestamps   : delta-of-delta  '0' | '10'+7 | '110'+9 | '1110'+12 | '1111'+32 bits
+//   values       : XOR with previous '0' (same) | '10' + bits in previous window
+//                  | '11' + 5-bit leading zeros + 5-bit (length - 1) + meaningful bits
+// No allocation: the block is a plain array that is reset and reused.
+class SeriesBlock {
+  private:
+    uint8_t _data[SERIES_BLOCK_BYTES];
+    uint16_t _bitPos;
+    uint16_t _count;
+    uint32_t _firstTs;
+    uint32_t _lastTs;
+    int32_t _lastDelta;
+    uint32_t _lastBits;
+    uint8_t _leading;
+    uint8_t _trailing;
+
+    static const uint16_t kWorstSampleBits = 4 + 32 + 2 + 5 + 5 + 32;
+
+    void writeBits(uint32_t value, uint8_t nbits) {
+      while (nbits > 0) {
+        uint8_t freeBits = 8 - (_bitPos & 7);
+        uint8_t take = nbits < freeBits ? nbits : freeBits;
+        uint8_t chunk = (value >> (nbits - take)) & ((1u << take) - 1);
+        _data[_bitPos >> 3] |= chunk << (freeBits - take);
+        _bitPos += take;
+        nbits -= take;
+      }
+    }
+
+    void writeTimestamp(uint32_t ts) {
+      int32_t delta = (int32_t)(ts - _lastTs);
+      int32_t dod = delta - _lastDelta;
+      if (dod == 0) {
+        writeBits(0b0, 1);
+      } else if (dod >= -63 && dod <= 64) {
+        writeBits(0b10, 2);
+        writeBits((uint32_t)(dod + 63), 7);
+      } else if (dod >= -255 && dod <= 256) {
+        writeBits(0b110, 3);
+        writeBits((uint32_t)(dod + 255), 9);
+      } else if (dod >= -2047 && dod <= 2048) {
+        writeBits(0b1110, 4);
+        writeBits((uint32_t)(dod + 2047), 12);
+      } else {
+        writeBits(0b1111, 4);
+        writeBits((uint32_t)dod, 32);
+      }
+      _lastDelta = delta;
+      _lastTs = ts;
+    }
+
+    void writeValue(uint32_t bits) {
+      uint32_t x = bits ^ _lastBits;
+      _lastBits = bits;
+      if (x == 0) {
+        writeBits(0b0, 1);
+        return;
+      }
+
+      uint8_t leading = __builtin_clz(x);
+      uint8_t trailing = __builtin_ctz(x);
+      if (leading >= _leading && trailing >= _trailing) {
+        // Fits in the previous meaningful-bit window
+        writeBits(0b10, 2);
+        writeBits(x >> _trailing, 32 - _leading - _trailing);
+      } else {
+        uint8_t length = 32 - leading - trailing;
+        writeBits(0b11, 2);
+        writeBits(leading, 5);
+        writeBits(length - 1, 5);
+        writeBits(x >> trailing, length);
+        _leading = leading;
+        _trailing = trailing;
+      }
+    }
+
+  public:
+    SeriesBlock() { reset(); }
+
+    void reset() {
+      memset(_data, 0, sizeof(_data));
+      _bitPos = 0;
+      _count = 0;
+      _firstTs = 0;
+      _lastTs = 0;
+      _lastDelta = 0;
+      _lastBits = 0;
+      _leading = 0xFF; // Forces an explicit window on the first XOR
+      _trailing = 0;
+    }
+
+    // Returns false (and leaves the block untouched) when the sample may not fit
+    bool append(uint32_t ts, float value) {
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+
+      if (_count == 0) {
+        writeBits(ts, 32);
+        writeBits(bits, 32);
+        _firstTs = ts;
+        _lastTs = ts;
+        _lastBits = bits;
+        _count = 1;
+        return true;
+      }
+
+      if (_bitPos + kWorstSampleBits > SERIES_BLOCK_BYTES * 8) return false;
+
+      writeTimestamp(ts);
+      writeValue(bits);
+      _count++;
+      return true;
+    }
+
+    uint16_t getCount() { return _count; }
+    uint16_t getByteLength() { return (_bitPos + 7) >> 3; }
+    uint32_t getFirstTimestamp() { return _firstTs; }
+    const uint8_t* getData() { return _data; }
+};
+
+// --- Telemetry Series ---
+// Responsibilities: Double-buffered SeriesBlock per channel, Producer/consumer hand-off across cores
+// The sampling job appends into the active block; the network job takes the
+// sealed one. If the network falls behind, the oldest sealed block is dropped.
+class TelemetrySeries {
+  private:
+    SeriesBlock _blocks[2];
+    uint8_t _active;
+    bool _sealedReady;
+    uint32_t _droppedSamples;
+    portMUX_TYPE _lock;
+
+    void sealLocked() {
+      if (_blocks[_active].getCount() == 0) return;
+      if (_sealedReady) {
+        _droppedSamples += _blocks[_active ^ 1].getCount();
+      }
+      _active ^= 1;
+      _blocks[_active].reset();
+      _sealedReady = true;
+    }
+
+  public:
+    TelemetrySeries() : _active(0), _sealedReady(false), _droppedSamples(0) {
+      _lock = portMUX_INITIALIZER_UNLOCKED;
+    }
+
+    void add(uint32_t ts, float value) {
+      portENTER_CRITICAL(&_lock);
+      if (!_blocks[_active].append(ts, value)) {
+        sealLocked();
+        _blocks[_active].append(ts, value);
+      }
+      portEXIT_CRITICAL(&_lock);
+    }
+
+    // Seal the active block if its first sample is older than maxAgeMs
+    void sealIfOlderThan(uint32_t nowMs, uint32_t maxAgeMs) {
+      portENTER_CRITICAL(&_lock);
+      SeriesBlock& active = _blocks[_active];
+      if (active.getCount() > 0 && (nowMs - active.getFirstTimestamp()) >= maxAgeMs) {
+        sealLocked();
+      }
+      portEXIT_CRITICAL(&_lock);
+    }
+
+    // Copy the sealed block out (caller-owned buffer). Returns false if none is ready.
+    bool takeSealed(SeriesBlock& out) {
+      bool ready;
+      portENTER_CRITICAL(&_lock);
+      ready = _sealedReady;
+      if (ready) {
+        out = _blocks[_active ^ 1];
+        _sealedReady = false;
+      }
+      portEXIT_CRITICAL(&_lock);
+      return ready;
+    }
+
+    uint32_t getDroppedSamples() { return _droppedSamples; }
+};
+
+#endif // SERIES_COMPRESSOR_H
@@ -5,12 +5,22 @@
   #include <WiFi.h>
   #include <HTTPClient.h>
   #include <ArduinoJson.h>
+  #include <mbedtls/base64.h>
 #endif
 #include "Config.h"
 #include "Managers.h"
+#include "Protocol.h"
+#include "TlsTransport.h"
+#include "CoapTransport.h"
+#include "LowPower.h"
+#include "DeviceClock.h"
+#include "TelemetryBus.h"
+#include "Log.h"
 
 // --- IoT Service ---
 // Responsibilities: WiFi Connection, Telemetry, Remote Commands
+// Reports go to the HTTP API, or with ENABLE_COAP to the CoAP gateway; both
+// carry the same JSON and get the same {command, commandId} back.
 class IoTService {
   private:
     const char* _ssid;
@@ -20,6 +30,84 @@ class IoTService {
     const char* _apiKey;
     PowerManager* _powerManager;
     SolarManager* _solarManager;
+    DeviceClock* _clock;
+    TelemetryBus* _bus;
+    SinkId _sink;
+
+    #if ENABLE_WIFI && ENABLE_COAP
+      CoapClient _coap;
+      char _coapPath[32];
+      char _coapQuery[64];
+      char _coapResponse[COAP_RESPONSE_BYTES + 1];
+    #elif ENABLE_WIFI && ENABLE_TLS
+      TlsSessionClient _tls; // Outlives each HTTPClient so the TLS session is reused
+    #endif
+
+    // Server command of the last response, and acknowledgements not yet delivered
+    // (kept until a report is accepted or refused with 4xx, so a failed POST does not lose them)
+    char _commandId[CMD_REF_BYTES];
+    CommandAck _unsentAcks[CMD_ACK_BATCH];
+    uint8_t _unsentAckCount;
+
+    // Session start/end events, kept like the acknowledgements until delivered
+    SessionEvent _unsentSessions[SESSION_EVENT_BATCH];
+    char _sessionIds[SESSION_EVENT_BATCH][9]; // Hex ids, valid until the payload is serialized
+    uint8_t _unsentSessionCount;
+
+    // Report accepted by the server (2xx)
+    void delivered() {
+      _unsentAckCount = 0;
+      _unsentSessionCount = 0;
+    }
+
+    // Report refused by the server (4xx): the same batch would be refused again
+    // and block every later report, so it is dropped. Transport errors and 5xx
+    // keep it for the next report.
+    void refused() {
+      for (uint8_t i = 0; i < _unsentAckCount; i++) {
+        LOG_W("Telemetry: dropped ack of command #%lu (%s)", (unsigned long)_unsentAcks[i].id,
+              ackResultName(_unsentAcks[i].result));
+      }
+      for (uint8_t i = 0; i < _unsentSessionCount; i++) {
+        LOG_W("Telemetry: dropped session %08lx %s event", (unsigned long)_unsentSessions[i].sessionId,
+              sessionEventName(_unsentSessions[i].type));
+      }
+      delivered();
+    }
+
+    // Commands that do not go through the PowerManager mailbox are acknowledged here
+    void ackNow(const char* ref) {
+      if (_unsentAckCount >= CMD_ACK_BATCH) return;
+      CommandAck& ack = _unsentAcks[_unsentAckCount++];
+      memset(&ack, 0, sizeof(ack));
+      ack.actuatedMs = millis();
+      ack.result = ACK_APPLIED;
+      strncpy(ack.ref, ref, sizeof(ack.ref) - 1);
+    }
+
+    #if ENABLE_WIFI && ENABLE_SERIES_UPLOAD
+      // Scratch buffers for the compressed series (one base64 buffer per channel,
+      // they must stay valid until the payload is serialized)
+      static const size_t kSeriesB64Bytes = 4 * ((SERIES_BLOCK_BYTES + 2) / 3) + 1;
+      SeriesBlock _seriesOut;
+      char _seriesB64[3][kSeriesB64Bytes];
+
+      // Attach the sealed block of one channel (if any) to the payload.
+      // A block is handed over once: if the POST fails, its samples are lost.
+      void appendSeries(JsonArray& series, const char* channel, TelemetrySeries* source, char* b64) {
+        source->sealIfOlderThan(millis(), SERIES_MAX_AGE_MS);
+        if (!source->takeSealed(_seriesOut)) return;
+
+        size_t written = 0;
+        mbedtls_base64_encode((unsigned char*)b64, kSeriesB64Bytes, &written,
+                              _seriesOut.getData(), _seriesOut.getByteLength());
+
+        JsonObject entry = series.add<JsonObject>();
+        entry["channel"] = channel;
+        entry["count"]   = _seriesOut.getCount();
+        entry["data"]    = (const char*)b64;
+      }
+    #endif
 
     // Build the full API endpoint URL
     String buildApiUrl() {
@@ -28,12 +116,41 @@ class IoTService {
 
   public:
     IoTService(const char* ssid, const char* pass, const char* baseUrl, int stationId, const char* apiKey, PowerManager* pm, SolarManager* sm)
-      : _ssid(ssid), _password(pass), _apiBaseUrl(baseUrl), _stationId(stationId), _apiKey(apiKey), _powerManager(pm), _solarManager(sm) {}
+      : _ssid(ssid), _password(pass), _apiBaseUrl(baseUrl), _stationId(stationId), _apiKey(apiKey), _powerManager(pm), _solarManager(sm), _clock(NULL),
+        _bus(NULL), _sink(-1)
+      #if ENABLE_WIFI && ENABLE_COAP
+        , _coap(COAP_SERVER, COAP_PORT)
+      #elif ENABLE_WIFI && ENABLE_TLS
+        , _tls(TLS_CA_CERT)
+      #endif
+      {
+        _commandId[0] = '\0';
+        _unsentAckCount = 0;
+        _unsentSessionCount = 0;
+        #if ENABLE_WIFI && ENABLE_COAP
+          snprintf(_coapPath, sizeof(_coapPath), "iot/stations/%d", stationId);
+          snprintf(_coapQuery, sizeof(_coapQuery), "key=%s", apiKey);
+        #endif
+      }
+
+    // Device time reference for the reports (optional). Call before begin().
+    void attachClock(DeviceClock* clock) {
+      _clock = clock;
+    }
+
+    // Report source: the newest snapshot on the bus. The sink takes every
+    // record and holds one, so a report is never older than one publish period
+    // and a slow POST only merges records. Call before the Scheduler starts.
+    void attachBus(TelemetryBus* bus) {
+      _bus = bus;
+      _sink = bus->subscribe("iot", TELEMETRY_PUBLISH_PERIOD_MS, 1, SINK_COALESCE);
+    }
 
     void begin() {
       #if ENABLE_WIFI
         WiFi.mode(WIFI_STA);
         WiFi.begin(_ssid, _password);
+        LowPower::configureWifi(); // Modem sleep + DTIM listen interval (ENABLE_LOW_POWER)
         Serial.print("Connecting to WiFi");
 
         // Wait for connection with timeout
@@ -49,7 +166,11 @@ class IoTService {
           Serial.print("IP address: ");
           Serial.println(WiFi.localIP());
           Serial.print("API endpoint: ");
-          Serial.println(buildApiUrl());
+          #if ENABLE_COAP
+            Serial.printf("coap://%s:%d/%s\n", COAP_SERVER, COAP_PORT, _coapPath);
+          #else
+            Serial.println(buildApiUrl());
+          #endif
         } else {
           Serial.println("\nWiFi connection failed!");
         }
@@ -68,109 +189,266 @@ class IoTService {
        #if ENABLE_WIFI
         // 1. Maintain Connection
         if (!isConnected()) {
-            Serial.println("WiFi disconnected, reconnecting...");
+            LOG_W("WiFi disconnected, reconnecting...");
             WiFi.reconnect();
             return; // Don't try to send if reconnecting
         }
 
-        // 2. Collect Data from Managers
-        float current = _powerManager->getCurrent();
-        String status = _powerManager->getStatusString();
-        float pvPower = _solarManager->getPvPower();
-        float battVoltage = _solarManager->getBattVoltage();
+        // 2. Latest snapshot from the bus (none yet: nothing to report)
+        TelemetryRecord record;
+        if (!_bus || !_bus->take(_sink, record)) return;
 
         // 3. Send & Receive
-        String cmd = sendTelemetryAndGetCommand(current, battVoltage * 10.0f, status, pvPower, battVoltage);
+        RemoteCommand cmd = sendTelemetryAndGetCommand(record.toReport());
 
         // 4. Act on Commands
-        if (cmd == "START") {
-            Serial.println("Received START command from server");
-            _powerManager->setChargingRequest(true);
-        } else if (cmd == "STOP") {
-            Serial.println("Received STOP command from server");
-            _powerManager->setChargingRequest(false);
+        switch (cmd) {
+          case CMD_START:
+            LOG_I("Received START command from server");
+            _powerManager->post(CMD_CHARGE_ON, CMD_SOURCE_SERVER, _commandId);
+            break;
+          case CMD_STOP:
+            LOG_I("Received STOP command from server");
+            _powerManager->post(CMD_CHARGE_OFF, CMD_SOURCE_SERVER, _commandId);
+            break;
+          #if ENABLE_CAPTURE
+          case CMD_CAPTURE:
+            LOG_I("Received CAPTURE command from server");
+            _powerManager->triggerCapture();
+            ackNow(_commandId);
+            break;
+          #endif
+          #if ENABLE_TRACE && ENABLE_MQTT
+          case CMD_TRACE:
+            LOG_I("Received TRACE command from server");
+            if (_powerManager->getTrace()) _powerManager->getTrace()->freeze(); // MQTTService uploads it
+            ackNow(_commandId);
+            break;
+          #endif
+          default:
+            break;
         }
        #endif
     }
 
-    String sendTelemetryAndGetCommand(float current, float voltage, String status, float pvPower, float battVoltage) {
+    RemoteCommand sendTelemetryAndGetCommand(const TelemetryReport& report) {
       #if ENABLE_WIFI
-      if (!isConnected()) return "NONE";
+      if (!isConnected()) return CMD_NONE;
 
-      HTTPClient http;
-      String url = buildApiUrl();
-      http.begin(url);
+      // Build JSON payload matching backend schema (see Protocol.h)
+      JsonDocument doc;
+      buildTelemetryDoc(doc, report, _stationId);
 
-      // Set headers - Content-Type and API Key for authentication
-      http.addHeader("Content-Type", "application/json");
-      http.addHeader("x-api-key", _apiKey);
+      #if ENABLE_COAP
+        // Datagram metrics (this request is counted next time)
+        JsonObject coap = doc["coap"].to<JsonObject>();
+        coap["requests"]        = _coap.getStats().requests;
+        coap["datagrams"]       = _coap.getStats().datagrams;
+        coap["retransmissions"] = _coap.getStats().retransmissions;
+        coap["timeouts"]        = _coap.getStats().timeouts;
+        coap["lastMs"]          = _coap.getStats().lastRttMs;
+      #elif ENABLE_TLS
+        // Handshake metrics (the handshake for this request is counted next time)
+        JsonObject tls = doc["tls"].to<JsonObject>();
+        tls["handshakes"] = _tls.getStats().handshakes;
+        tls["resumed"]    = _tls.getStats().resumed;
+        tls["failures"]   = _tls.getStats().failures;
+        tls["lastMs"]     = _tls.getStats().lastHandshakeMs;
+        tls["avgMs"]      = _tls.getAverageHandshakeMs();
+      #endif
 
-      // Build JSON payload matching backend schema
-      // Backend expects: voltage, current, power, temperature, status, deviceId
-      JsonDocument doc;
-      doc["voltage"]     = voltage;                    // V (scaled from battery voltage)
-      doc["current"]     = current;                    // A
-      doc["power"]       = (voltage * current) / 1000.0f; // kW
-      doc["pvPower"]     = pvPower;                    // W (solar power)
-      doc["battVoltage"] = battVoltage;                // V (battery voltage)
-      doc["deviceId"]    = "esp32-station-" + String(_stationId);
-
-      // Map status string to backend enum values
-      // Backend expects: AVAILABLE, OCCUPIED, RESERVED, MAINTENANCE, FAULT
-      if (status == "IDLE") {
-        doc["status"] = "AVAILABLE";
-      } else if (status == "CHARGING") {
-        doc["status"] = "OCCUPIED";
-      } else if (status == "FAULT") {
-        doc["status"] = "FAULT";
+      // Device time reference: series samples, acks and session events are device
+      // millis; clockMs (when synced) dates them instead of the server's receive time
+      int64_t nowUs = esp_timer_get_time();
+      doc["uptimeMs"] = (uint32_t)(nowUs / 1000); // millis()
+      if (_clock && _clock->isSynced()) {
+        doc["clockMs"] = _clock->toUnixMs(nowUs);
+        ClockStats cs = _clock->getStats();
+        JsonObject clock = doc["clock"].to<JsonObject>();
+        clock["syncs"]    = cs.syncs;
+        clock["steps"]    = cs.steps;
+        clock["errUs"]    = cs.lastErrorUs;
+        clock["driftPpb"] = cs.driftPpb;
+      }
+
+      // Telemetry bus sinks: records taken, dropped/merged under backpressure, queueing delay
+      if (_bus) {
+        JsonObject bus = doc["bus"].to<JsonObject>();
+        for (SinkId i = 0; i < (SinkId)_bus->getSinkCount(); i++) {
+          SinkStats st = _bus->getStats(i);
+          JsonObject sink = bus[_bus->getSinkName(i)].to<JsonObject>();
+          sink["out"]   = st.delivered;
+          sink["drop"]  = st.dropped;
+          sink["coal"]  = st.coalesced;
+          sink["lagMs"] = st.lastLagMs;
+        }
+      }
+
+      #if ENABLE_SERIES_UPLOAD
+        // Compressed high-resolution history; sample times are device millis
+        JsonArray series = doc["series"].to<JsonArray>();
+        appendSeries(series, "current",     _powerManager->getCurrentSeries(), _seriesB64[0]);
+        appendSeries(series, "pvPower",     _solarManager->getPvSeries(),      _seriesB64[1]);
+        appendSeries(series, "battVoltage", _solarManager->getBattSeries(),    _seriesB64[2]);
+      #endif
+
+      #if ENABLE_AGGREGATES
+        // Statistics over every sample since the previous report
+        JsonObject agg = doc["agg"].to<JsonObject>();
+        addWindowStats(agg, "current",     _powerManager->getCurrentAggregator()->take());
+        addWindowStats(agg, "pvPower",     _solarManager->getPvAggregator()->take());
+        addWindowStats(agg, "battVoltage", _solarManager->getBattAggregator()->take());
+      #endif
+
+      // Acknowledgements: ageMs lets the server date the actuation without a shared clock
+      CommandAck ack;
+      while (_unsentAckCount < CMD_ACK_BATCH && _powerManager->takeAck(CMD_SOURCE_SERVER, ack)) {
+        _unsentAcks[_unsentAckCount++] = ack;
+      }
+      if (_unsentAckCount > 0) {
+        uint32_t now = millis();
+        JsonArray acks = doc["acks"].to<JsonArray>();
+        for (uint8_t i = 0; i < _unsentAckCount; i++) {
+          JsonObject a = acks.add<JsonObject>();
+          a["commandId"] = (const char*)_unsentAcks[i].ref;
+          a["result"]    = ackResultName(_unsentAcks[i].result);
+          a["latencyMs"] = _unsentAcks[i].latencyMs;
+          a["ageMs"]     = now - _unsentAcks[i].actuatedMs;
+        }
       }
-      // If status doesn't match, let the backend infer from sensor data
+
+      #if ENABLE_SESSIONS
+        // Charging sessions detected on the device; the server opens/closes its rows from these
+        SessionEvent event;
+        while (_unsentSessionCount < SESSION_EVENT_BATCH && _powerManager->takeSessionEvent(event)) {
+          _unsentSessions[_unsentSessionCount++] = event;
+        }
+        if (_unsentSessionCount > 0) {
+          uint32_t now = millis();
+          JsonArray sessions = doc["sessions"].to<JsonArray>();
+          for (uint8_t i = 0; i < _unsentSessionCount; i++) {
+            const SessionEvent& e = _unsentSessions[i];
+            snprintf(_sessionIds[i], sizeof(_sessionIds[i]), "%08lx", (unsigned long)e.sessionId);
+            JsonObject o = sessions.add<JsonObject>();
+            o["id"]    = (const char*)_sessionIds[i];
+            o["event"] = sessionEventName(e.type);
+            o["ageMs"] = now - e.atMs;
+            if (e.type == SESSION_END) {
+              o["durationMs"] = e.durationMs;
+              o["peakA"]      = e.peakAmps;
+              o["avgA"]       = e.avgAmps;
+              o["energyWh"]   = e.energyWh;
+            }
+          }
+        }
+      #endif
 
       String jsonString;
       serializeJson(doc, jsonString);
 
-      Serial.print("Sending telemetry to: ");
-      Serial.println(url);
-      Serial.print("Payload: ");
-      Serial.println(jsonString);
+      #if ENABLE_COAP
+        return postCoap(jsonString);
+      #else
+        return postHttp(jsonString);
+      #endif
+      #else
+      return CMD_NONE;
+      #endif
+    }
+
+  private:
+    #if ENABLE_WIFI
+    // Server command of a response ({command, commandId}, see Protocol.h)
+    RemoteCommand readCommand(JsonDocument& resDoc) {
+      const char* id = extractCommandId(resDoc);
+      if (id) {
+        strncpy(_commandId, id, sizeof(_commandId) - 1);
+        _commandId[sizeof(_commandId) - 1] = '\0';
+      }
+      return parseServerCommand(extractCommand(resDoc));
+    }
+
+    #if ENABLE_COAP
+    RemoteCommand postCoap(const String& jsonString) {
+      uint32_t startMs = millis();
+      uint32_t datagrams = _coap.getStats().datagrams;
+      uint8_t code = _coap.post(_coapPath, _coapQuery, (const uint8_t*)jsonString.c_str(), jsonString.length(),
+                                _coapResponse, sizeof(_coapResponse));
+      RemoteCommand command = CMD_NONE;
+      _commandId[0] = '\0';
+      if (COAP_CODE_CLASS(code) != 2) {
+        LOG_W("Telemetry: CoAP %d.%02d", code >> 5, code & 0x1F); // 0.00: no response
+        if (COAP_CODE_CLASS(code) == 4) refused();
+        return command;
+      }
+      delivered();
+      LOG_I("Telemetry: CoAP 2.%02d, %u bytes in %lu datagrams, %lu ms", code & 0x1F, jsonString.length(),
+            _coap.getStats().datagrams - datagrams, millis() - startMs);
 
+      if (_coapResponse[0] != '\0') {
+        JsonDocument filter;
+        buildCommandFilter(filter);
+        JsonDocument resDoc;
+        if (!deserializeJson(resDoc, (const char*)_coapResponse, DeserializationOption::Filter(filter))) {
+          command = readCommand(resDoc);
+        }
+      }
+      return command;
+    }
+    #else
+    RemoteCommand postHttp(const String& jsonString) {
+      HTTPClient http;
+      String url = buildApiUrl();
+      #if ENABLE_TLS
+        http.begin(_tls, url);
+      #else
+        http.begin(url);
+      #endif
+
+      // Set headers - Content-Type and API Key for authentication
+      http.addHeader("Content-Type", "application/json");
+      http.addHeader("x-api-key", _apiKey);
+      http.addHeader("Prefer", PREFER_MINIMAL_HEADER); // 204 when there is no command
+
+      // Parse the response off the socket; HTTP/1.0 rules out chunked bodies
+      http.useHTTP10(true);
+
+      uint32_t startMs = millis();
       int httpResponseCode = http.POST(jsonString);
-      String command = "NONE";
+      RemoteCommand command = CMD_NONE;
+      _commandId[0] = '\0';
+      if (httpResponseCode >= 200 && httpResponseCode < 300) {
+        delivered();
+      } else if (httpResponseCode >= 400 && httpResponseCode < 500) {
+        refused();
+      }
 
-      if (httpResponseCode > 0) {
-        String response = http.getString();
-        Serial.print("Response (");
-        Serial.print(httpResponseCode);
-        Serial.print("): ");
-        Serial.println(response);
+      if (httpResponseCode == HTTP_CODE_NO_CONTENT) {
+        // Common case: nothing pending, no body to read
+        LOG_I("Telemetry: HTTP 204, %u bytes sent in %lu ms", jsonString.length(), millis() - startMs);
+      } else if (httpResponseCode > 0) {
+        LOG_I("Telemetry: HTTP %d, %u bytes sent in %lu ms", httpResponseCode,
+              jsonString.length(), millis() - startMs);
 
-        // Parse response for command
+        // Parse response for command, keeping only the command fields
+        JsonDocument filter;
+        buildCommandFilter(filter);
         JsonDocument resDoc;
-        DeserializationError error = deserializeJson(resDoc, response);
+        DeserializationError error = deserializeJson(resDoc, http.getStream(),
+                                                     DeserializationOption::Filter(filter));
 
         if (!error) {
-            // Check for command in response
-            if (resDoc.containsKey("command")) {
-                const char* cmd = resDoc["command"];
-                command = String(cmd);
-            }
-            // Also check nested in data object
-            if (resDoc["data"].containsKey("command")) {
-                const char* cmd = resDoc["data"]["command"];
-                command = String(cmd);
-            }
+            command = readCommand(resDoc);
         }
       } else {
-        Serial.print("HTTP Error: ");
-        Serial.println(httpResponseCode);
+        LOG_W("Telemetry: HTTP error %d", httpResponseCode);
       }
 
       http.end();
       return command;
-      #else
-      return "NONE";
-      #endif
     }
+    #endif
+    #endif
 };
 
 #endif // SERVICES_H
@@ -0,0 +1,145 @@
+#ifndef SESSION_DETECTOR_H
+#define SESSION_DETECTOR_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "MpscQueue.h"
+
+enum SessionEventType : uint8_t {
+  SESSION_START = 1,
+  SESSION_END
+};
+
+// Emitted by SessionDetector, uploaded by IoTService (ageMs is added on upload)
+struct SessionEvent {
+  uint32_t sessionId;  // Random per session: pairs START and END on the server
+  uint32_t atMs;       // millis() of the edge
+  uint32_t durationMs; // END only
+  float peakAmps;      // END only
+  float avgAmps;       // END only, time-weighted
+  float energyWh;      // END only, SESSION_SUPPLY_VOLTAGE x integral of I dt
+  SessionEventType type;
+};
+
+typedef MpscQueue<SessionEvent, SESSION_EVENT_QUEUE_SIZE> SessionEventQueue;
+
+inline const char* sessionEventName(SessionEventType type) {
+  return type == SESSION_START ? "START" : "END";
+}
+
+// --- Session Detector ---
+// Responsibilities: Current profile filter, Hysteresis, Minimum durations, Session summaries
+// Fed with every current sample (at the adaptive sampling interval). A session
+// opens once the low-pass filtered current has stayed above SESSION_START_AMPS
+// for SESSION_START_MS, and closes once it has stayed below SESSION_END_AMPS
+// for SESSION_END_MS. Both edges are dated back to the first sample past the
+// threshold, so a spike does not open a session and a pause does not split one.
+// Peak, average and energy come from the raw samples between the two edges.
+class SessionDetector {
+  private:
+    float _filtered;
+    uint32_t _lastMs;
+    bool _hasSample;
+
+    bool _active;
+    bool _hasEdge;       // Threshold crossed, waiting for the minimum duration
+    uint32_t _edgeMs;    // First sample past the threshold
+
+    uint32_t _sessionId;
+    uint32_t _startMs;
+    float _peak;
+    float _peakAtEdge;   // Peak up to the pending end edge
+    double _ampMs;       // Integral of I dt (A*ms) since the start edge (float loses
+    double _ampMsAtEdge; // small increments after a few hours), up to the pending end edge
+
+    SessionEventQueue _events;
+    uint32_t _dropped;
+
+    void emit(const SessionEvent& e) {
+      if (!_events.push(e)) _dropped++;
+    }
+
+  public:
+    SessionDetector() : _filtered(0.0f), _lastMs(0), _hasSample(false), _active(false), _hasEdge(false),
+                        _edgeMs(0), _sessionId(0), _startMs(0), _peak(0.0f), _peakAtEdge(0.0f), _ampMs(0.0),
+                        _ampMsAtEdge(0.0), _dropped(0) {}
+
+    // One current sample (Power job)
+    void add(float amps, uint32_t now) {
+      uint32_t dt = _hasSample ? now - _lastMs : 0;
+      _lastMs = now;
+      if (!_hasSample) {
+        _filtered = amps;
+        _hasSample = true;
+      } else {
+        _filtered += (float)dt / (SESSION_FILTER_TAU_MS + dt) * (amps - _filtered); // Time-aware EWMA
+      }
+
+      if (!_active) {
+        if (_filtered <= SESSION_START_AMPS) {
+          _hasEdge = false; // Spike over
+          return;
+        }
+        if (!_hasEdge) {
+          _hasEdge = true;
+          _edgeMs = now;
+          _peak = 0.0f;
+          _ampMs = 0.0;
+        } else {
+          _ampMs += amps * dt;
+        }
+        if (amps > _peak) _peak = amps;
+        if (now - _edgeMs >= SESSION_START_MS) {
+          _active = true;
+          _hasEdge = false;
+          _startMs = _edgeMs;
+          _sessionId = esp_random();
+          SessionEvent e = {};
+          e.type = SESSION_START;
+          e.sessionId = _sessionId;
+          e.atMs = _startMs;
+          emit(e);
+        }
+        return;
+      }
+
+      // Samples after a pending end edge still count if the pause turns out to be
+      // one; the END summary uses the snapshot taken at the edge
+      _ampMs += amps * dt;
+      if (amps > _peak) _peak = amps;
+      if (_filtered >= SESSION_END_AMPS) {
+        _hasEdge = false; // Pause over
+        return;
+      }
+      if (!_hasEdge) {
+        _hasEdge = true;
+        _edgeMs = now;
+        _peakAtEdge = _peak;
+        _ampMsAtEdge = _ampMs;
+      }
+      if (now - _edgeMs >= SESSION_END_MS) {
+        _active = false;
+        _hasEdge = false;
+        SessionEvent e;
+        e.type = SESSION_END;
+        e.sessionId = _sessionId;
+        e.atMs = _edgeMs;
+        e.durationMs = _edgeMs - _startMs;
+        e.peakAmps = _peakAtEdge;
+        e.avgAmps = e.durationMs ? (float)(_ampMsAtEdge / e.durationMs) : 0.0f;
+        e.energyWh = (float)(_ampMsAtEdge / 3600000.0 * SESSION_SUPPLY_VOLTAGE);
+        emit(e);
+      }
+    }
+
+    // Next event (one consumer task)
+    bool take(SessionEvent& out) {
+      return _events.pop(out);
+    }
+
+    bool isActive() { return _active; }
+    float getFiltered() { return _filtered; }
+    uint32_t getDropped() { return _dropped; }
+};
+
+#endif // SESSION_DETECTOR_H
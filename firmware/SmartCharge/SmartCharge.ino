@@ -3,6 +3,11 @@
 #include "Managers.h"
 #include "Services.h"
 #include "MQTTService.h"
+#include "Scheduler.h"
+#include "LowPower.h"
+#include "DeviceClock.h"
+#include "TelemetryBus.h"
+#include "Log.h"
 
 // --- 1. Drivers Layer ---
 RelayDriver boxRelay(PIN_RELAY_MAIN);
@@ -11,6 +16,8 @@ ButtonDriver button(PIN_BUTTON_IN);
 LedDriver statusLed(PIN_BUTTON_LED);
 CurrentSensorDriver acs(PIN_SENSOR_ACS, ACS_ZERO_VOLTAGE, ACS_SENSITIVITY);
 SolarDriver solarDriver;
+TraceRecorder inputTrace; // Driver inputs for host replay (tools/replay)
+DeviceClock deviceClock;  // SNTP-disciplined time for sample timestamps
 
 // --- 2. Managers Layer ---
 // Inject Drivers into Managers
@@ -18,25 +25,42 @@ PowerManager powerManager(&boxRelay, &fanRelay, &acs);
 InterfaceManager interfaceManager(&button, &statusLed, &powerManager);
 SolarManager solarManager(&solarDriver);
 
+// Station snapshots, posted once and fanned out to the Services at their own rates
+TelemetryBus telemetryBus;
+TelemetryPublisher telemetryPublisher(&powerManager, &solarManager, &telemetryBus);
+
 // --- 3. Services Layer ---
 // Inject Managers into Services
-IoTService iotService(WIFI_SSID, WIFI_PASSWORD, API_BASE_URL, STATION_ID, IOT_API_KEY, &powerManager, &solarManager);
+IoTService iotService(WIFI_SSID, WIFI_PASSWORD, API_URL, STATION_ID, IOT_API_KEY, &powerManager, &solarManager);
 #if ENABLE_MQTT
   MQTTService mqttService(&powerManager, &solarManager);
 #endif
 
-// --- FreeRTOS Task Handles ---
-TaskHandle_t TaskHardwareHandle;
-TaskHandle_t TaskNetworkHandle;
-
-// --- Task Definitions ---
-void TaskHardware(void *pvParameters);
-void TaskNetwork(void *pvParameters);
+// --- 4. Scheduler ---
+Scheduler scheduler;
+Logger logger;
+DutyMonitor dutyMonitor(&scheduler);
 
 void setup() {
   Serial.begin(115200);
   delay(1000);
   Serial.println("\n--- SmartCharge NEO Booting ---");
+  logger.begin(); // Prints the log of the previous boot after a crash
+  LowPower::begin(); // Light sleep between jobs (ENABLE_LOW_POWER)
+
+  #if ENABLE_TRACE
+    powerManager.attachTrace(&inputTrace); // Commands, state snapshots, current sensor
+    button.attachTrace(&inputTrace);
+    solarDriver.attachTrace(&inputTrace);
+  #endif
+  #if ENABLE_CLOCK_SYNC
+    telemetryPublisher.attachClock(&deviceClock); // Sample timestamps
+    iotService.attachClock(&deviceClock);         // Report time reference
+  #endif
+  iotService.attachBus(&telemetryBus);
+  #if ENABLE_MQTT
+    mqttService.attachBus(&telemetryBus);
+  #endif
   
   // Initialize Layers
   // Managers will initialize their own drivers if needed, or we explicitly do it here?
@@ -46,6 +70,9 @@ void setup() {
   interfaceManager.begin();
   solarManager.begin();
   iotService.begin();
+  #if ENABLE_WIFI && ENABLE_CLOCK_SYNC
+    deviceClock.begin(); // SNTP starts once Wi-Fi is up
+  #endif
   #if ENABLE_MQTT
     mqttService.begin();
   #endif
@@ -53,53 +80,45 @@ void setup() {
   // --- Boot Self-Test ---
   #if ENABLE_RELAYS
     Serial.println("Self-Test: Main Relay ON (2s)...");
-    boxRelay.on();
-    delay(2000);
-    boxRelay.off();
+    powerManager.selfTestMainRelay(2000);
     Serial.println("Self-Test: Main Relay OFF");
   #endif
 
-  // Create Tasks
-  xTaskCreatePinnedToCore(
-    TaskHardware,   "HardwareLoop",   4096,   NULL,   2,   &TaskHardwareHandle,   1
-  );
+  // Register Jobs (period, deadline, core). Priorities are rate-monotonic.
+  scheduler.addUpdate("Interface", &interfaceManager, HARDWARE_LOOP_DELAY, 0, HARDWARE_CORE, 4096); // Button & LED
+  scheduler.addUpdate("Power",     &powerManager,     HARDWARE_LOOP_DELAY, 0, HARDWARE_CORE, 4096); // Relays & Sensor
+  #if ENABLE_SOLAR
+    scheduler.addUpdate("Solar",   &solarManager,     SOLAR_READ_PERIOD,   0, HARDWARE_CORE, 4096); // Modbus Reading
+  #endif
+  scheduler.addUpdate("Telemetry", &telemetryPublisher, TELEMETRY_PUBLISH_PERIOD_MS, 0, HARDWARE_CORE, 3072); // Snapshot -> bus
 
   #if ENABLE_WIFI
-    xTaskCreatePinnedToCore(
-      TaskNetwork,    "NetworkLoop",    8192,   NULL,   1,   &TaskNetworkHandle,    0
-    );
+    scheduler.addUpdate("IoT",     &iotService,       NETWORK_LOOP_DELAY,  0, NETWORK_CORE,  8192); // WiFi & HTTP Telemetry
+    #if ENABLE_MQTT
+      scheduler.addUpdate("MQTT",  &mqttService,      MQTT_LOOP_PERIOD,    0, NETWORK_CORE,  6144); // MQTT for Home Assistant
+    #endif
   #endif
-  
-  Serial.println("System Started via FreeRTOS (Layered Architecture)");
-}
 
-void loop() {
-  vTaskDelete(NULL); 
-}
+  scheduler.addBackground("Log", &logger, LOG_DRAIN_PERIOD, NETWORK_CORE, 3072); // Deferred Serial output
 
-// --- Task A: Hardware Loop (20ms, Core 1) ---
-// Handles Managers Updates
-void TaskHardware(void *pvParameters) {
-  for(;;) {
-    // Update Managers
-    interfaceManager.update(); // Handle Button & LED
-    powerManager.update();     // Handle Relays & Sensor
-    solarManager.update();     // Handle Modbus Reading (Check every 2s internally)
+  #if ENABLE_LOW_POWER
+    scheduler.addBackground("Duty", &dutyMonitor, PM_REPORT_PERIOD_MS, NETWORK_CORE, 3072); // Active/idle/sleep log
+    scheduler.setIdleSource(&powerManager); // No charge request, relays open, no current
+    scheduler.setIdlePeriod("Interface", PM_IDLE_PERIOD_MS);
+    scheduler.setIdlePeriod("Power",     PM_IDLE_PERIOD_MS);
+    scheduler.setIdlePeriod("MQTT",      PM_IDLE_PERIOD_MS);
+    scheduler.setIdlePeriod("Log",       PM_IDLE_PERIOD_MS);
+    #if ENABLE_BUTTON
+      scheduler.setWakePin("Interface", PIN_BUTTON_IN); // Button press releases it from light sleep
+    #endif
+    scheduler.setKeepAwake("Solar"); // Modbus UART must not sleep mid-transaction
+  #endif
 
-    vTaskDelay(pdMS_TO_TICKS(HARDWARE_LOOP_DELAY)); 
-  }
-}
+  scheduler.start();
 
-// --- Task B: Network Loop (5000ms, Core 0) ---
-// Handles Services Updates
-void TaskNetwork(void *pvParameters) {
-  for(;;) {
-    // Update Services
-    iotService.update(); // Handle WiFi & HTTP Telemetry
-    #if ENABLE_MQTT
-      mqttService.update(); // Handle MQTT for Home Assistant
-    #endif
+  Serial.println("System Started via FreeRTOS (Layered Architecture)");
+}
 
-    vTaskDelay(pdMS_TO_TICKS(NETWORK_LOOP_DELAY));
-  }
+void loop() {
+  vTaskDelete(NULL); 
 }
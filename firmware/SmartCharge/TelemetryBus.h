@@ -0,0 +1,212 @@
+#ifndef TELEMETRY_BUS_H
+#define TELEMETRY_BUS_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Protocol.h"
+#include "Managers.h"
+#include "DeviceClock.h"
+
+// One station snapshot on the bus. Self-contained: queued copies outlive the
+// producer's strings.
+struct TelemetryRecord {
+  uint32_t seq;
+  uint32_t publishedMs; // millis() when posted
+  float current;
+  float voltage;
+  float pvPower;
+  float battVoltage;
+  int64_t timestamp;    // Unix ms at acquisition, 0: unknown
+  bool relayOn;
+  char status[12];
+
+  // View for the Protocol.h builders (valid while this record is)
+  TelemetryReport toReport() const {
+    TelemetryReport r;
+    r.current     = current;
+    r.voltage     = voltage;
+    r.pvPower     = pvPower;
+    r.battVoltage = battVoltage;
+    r.status      = status;
+    r.relayOn     = relayOn;
+    r.timestamp   = timestamp;
+    return r;
+  }
+};
+
+// What a sink's queue does with a new record when it is full
+enum SinkPolicy : uint8_t {
+  SINK_DROP_NEWEST, // The new record is discarded
+  SINK_DROP_OLDEST, // The oldest queued record makes room
+  SINK_COALESCE     // The new record replaces the newest queued one (latest value wins)
+};
+
+// Per-sink counters (any task)
+struct SinkStats {
+  uint32_t offered;   // Records due at the sink's rate
+  uint32_t delivered; // Taken by the sink
+  uint32_t dropped;
+  uint32_t coalesced;
+  uint8_t depth;      // Queued now
+  uint8_t maxDepth;
+  uint32_t lastLagMs; // Publish -> take of the last delivered record
+};
+
+typedef int8_t SinkId; // -1: not subscribed
+
+// --- Telemetry Bus ---
+// Responsibilities: Fan-out of station snapshots, Per-sink rate, Per-sink backpressure
+// The producer posts each snapshot once; every sink has its own rate (records
+// in between are not offered to it), its own queue depth and its own policy
+// for a full queue. publish() only copies the record into the queues that are
+// due, under a per-sink spinlock, so it never waits for a sink: a sink that
+// falls behind loses or merges its own records and nobody else's. Sinks drain
+// their queue from their own job with take() and format the records themselves.
+// Subscribe every sink before the Scheduler starts.
+class TelemetryBus {
+  private:
+    struct Sink {
+      const char* name;
+      uint32_t periodMs;
+      uint8_t depth;
+      SinkPolicy policy;
+      bool hasOffered;
+      uint32_t lastOfferMs;
+      TelemetryRecord ring[TELEMETRY_SINK_DEPTH_MAX];
+      uint8_t head;  // Oldest record
+      uint8_t count;
+      SinkStats stats;
+      portMUX_TYPE lock;
+    };
+
+    Sink _sinks[TELEMETRY_MAX_SINKS];
+    uint8_t _sinkCount;
+    uint32_t _seq;
+
+    void offer(Sink& s, const TelemetryRecord& rec) {
+      portENTER_CRITICAL(&s.lock);
+      s.stats.offered++;
+      if (s.count < s.depth) {
+        s.ring[(s.head + s.count) % s.depth] = rec;
+        s.count++;
+      } else if (s.policy == SINK_DROP_OLDEST) {
+        s.ring[s.head] = rec; // Oldest slot becomes the newest
+        s.head = (s.head + 1) % s.depth;
+        s.stats.dropped++;
+      } else if (s.policy == SINK_COALESCE) {
+        s.ring[(s.head + s.count - 1) % s.depth] = rec;
+        s.stats.coalesced++;
+      } else {
+        s.stats.dropped++;
+      }
+      s.stats.depth = s.count;
+      if (s.count > s.stats.maxDepth) s.stats.maxDepth = s.count;
+      portEXIT_CRITICAL(&s.lock);
+    }
+
+  public:
+    TelemetryBus() : _sinkCount(0), _seq(0) {}
+
+    // Register a sink: one record every periodMs at most, `depth` queued
+    // (1..TELEMETRY_SINK_DEPTH_MAX). Returns -1 when there is no room.
+    SinkId subscribe(const char* name, uint32_t periodMs, uint8_t depth, SinkPolicy policy) {
+      if (_sinkCount >= TELEMETRY_MAX_SINKS || depth == 0 || depth > TELEMETRY_SINK_DEPTH_MAX) return -1;
+      Sink& s = _sinks[_sinkCount];
+      s.name = name;
+      s.periodMs = periodMs;
+      s.depth = depth;
+      s.policy = policy;
+      s.hasOffered = false;
+      s.lastOfferMs = 0;
+      s.head = 0;
+      s.count = 0;
+      memset(&s.stats, 0, sizeof(s.stats));
+      s.lock = portMUX_INITIALIZER_UNLOCKED;
+      return (SinkId)_sinkCount++;
+    }
+
+    // Post one snapshot (producer job). Sets seq and publishedMs.
+    void publish(TelemetryRecord& rec) {
+      uint32_t now = millis();
+      rec.seq = ++_seq;
+      rec.publishedMs = now;
+      for (uint8_t i = 0; i < _sinkCount; i++) {
+        Sink& s = _sinks[i];
+        // Half a producer period of slack: a 5 s sink fed every 1 s gets every 5th record
+        if (s.hasOffered && now - s.lastOfferMs + TELEMETRY_PUBLISH_PERIOD_MS / 2 < s.periodMs) continue;
+        s.hasOffered = true;
+        s.lastOfferMs = now;
+        offer(s, rec);
+      }
+    }
+
+    // Oldest queued record of this sink (the sink's own job)
+    bool take(SinkId id, TelemetryRecord& out) {
+      if (id < 0 || id >= (SinkId)_sinkCount) return false;
+      Sink& s = _sinks[id];
+      portENTER_CRITICAL(&s.lock);
+      bool ok = s.count > 0;
+      if (ok) {
+        out = s.ring[s.head];
+        s.head = (s.head + 1) % s.depth;
+        s.count--;
+        s.stats.delivered++;
+        s.stats.depth = s.count;
+      }
+      portEXIT_CRITICAL(&s.lock);
+      if (ok) s.stats.lastLagMs = millis() - out.publishedMs;
+      return ok;
+    }
+
+    uint8_t getSinkCount() { return _sinkCount; }
+
+    const char* getSinkName(SinkId id) {
+      return id >= 0 && id < (SinkId)_sinkCount ? _sinks[id].name : "";
+    }
+
+    SinkStats getStats(SinkId id) {
+      SinkStats stats;
+      memset(&stats, 0, sizeof(stats));
+      if (id < 0 || id >= (SinkId)_sinkCount) return stats;
+      portENTER_CRITICAL(&_sinks[id].lock);
+      stats = _sinks[id].stats;
+      portEXIT_CRITICAL(&_sinks[id].lock);
+      return stats;
+    }
+};
+
+// --- Telemetry Publisher ---
+// Responsibilities: Snapshot the Managers once per period and post it on the bus
+// Registered as a job on the hardware core; the only producer of the bus.
+class TelemetryPublisher {
+  private:
+    PowerManager* _powerManager;
+    SolarManager* _solarManager;
+    TelemetryBus* _bus;
+    DeviceClock* _clock;
+
+  public:
+    TelemetryPublisher(PowerManager* pm, SolarManager* sm, TelemetryBus* bus)
+      : _powerManager(pm), _solarManager(sm), _bus(bus), _clock(NULL) {}
+
+    // Device timestamps for the records (optional). Call before the Scheduler starts.
+    void attachClock(DeviceClock* clock) {
+      _clock = clock;
+    }
+
+    void update() {
+      TelemetryRecord rec;
+      rec.current     = _powerManager->getCurrent();
+      rec.pvPower     = _solarManager->getPvPower();
+      rec.battVoltage = _solarManager->getBattVoltage();
+      rec.voltage     = rec.battVoltage * 10.0f; // Scaled voltage
+      rec.relayOn     = _powerManager->getChargingRequest();
+      rec.timestamp   = _clock ? _clock->toUnixMs(_powerManager->getCurrentSampledUs()) : 0;
+      String status = _powerManager->getStatusString();
+      strncpy(rec.status, status.c_str(), sizeof(rec.status) - 1);
+      rec.status[sizeof(rec.status) - 1] = '\0';
+      _bus->publish(rec);
+    }
+};
+
+#endif // TELEMETRY_BUS_H
@@ -0,0 +1,263 @@
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#include "Config.h"
+
+#if ENABLE_TLS
+#include <WiFi.h>
+#include "Log.h"
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/version.h>
+#include <mbedtls/x509_crt.h>
+
+// mbedTLS 3 (ESP-IDF 5) hides struct members behind MBEDTLS_PRIVATE()
+#if MBEDTLS_VERSION_MAJOR >= 3
+  #define TLS_FIELD(x) MBEDTLS_PRIVATE(x)
+#else
+  #define TLS_FIELD(x) x
+#endif
+
+// Handshake metrics (reported with telemetry / MQTT state)
+struct TlsStats {
+  uint32_t handshakes;       // Successful handshakes (full + resumed)
+  uint32_t resumed;          // Abbreviated handshakes from the cached session
+  uint32_t failures;         // Failed handshakes
+  uint32_t lastHandshakeMs;
+  uint32_t totalHandshakeMs;
+};
+
+// --- TLS Session Client ---
+// Responsibilities: TLS over a WiFiClient, Pinned CA, Session resumption across reconnects
+// Drop-in WiFiClient for HTTPClient::begin(client, url) and PubSubClient::setClient().
+// Unlike WiFiClientSecure, the mbedTLS context lives as long as the service, and the
+// session negotiated by the last handshake (session ID or RFC 5077 ticket) is offered
+// on the next connect, so every request/reconnect after the first skips the
+// certificate chain and key exchange.
+class TlsSessionClient : public WiFiClient {
+  private:
+    WiFiClient _tcp;
+    const char* _caPem;
+    uint32_t _timeoutMs;
+
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_x509_crt _ca;
+    mbedtls_ssl_config _conf;
+    mbedtls_ssl_context _ssl;
+    mbedtls_ssl_session _session;
+
+    bool _configured;
+    bool _hasSession;
+    bool _connected;
+    int _peeked; // -1 = nothing peeked
+    TlsStats _stats;
+
+    static int bioSend(void* ctx, const unsigned char* buf, size_t len) {
+      WiFiClient* tcp = static_cast<WiFiClient*>(ctx);
+      if (!tcp->connected()) return MBEDTLS_ERR_NET_CONN_RESET;
+      size_t n = tcp->write(buf, len);
+      return n > 0 ? (int)n : MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    static int bioRecv(void* ctx, unsigned char* buf, size_t len) {
+      WiFiClient* tcp = static_cast<WiFiClient*>(ctx);
+      if (!tcp->available()) {
+        return tcp->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+      }
+      int n = tcp->read(buf, len);
+      return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    static bool wouldBlock(int ret) {
+      return ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    // One-time mbedTLS setup: RNG, pinned CA, client config
+    bool configure() {
+      if (_configured) return true;
+
+      mbedtls_entropy_init(&_entropy);
+      mbedtls_ctr_drbg_init(&_drbg);
+      mbedtls_x509_crt_init(&_ca);
+      mbedtls_ssl_config_init(&_conf);
+      mbedtls_ssl_init(&_ssl);
+      mbedtls_ssl_session_init(&_session);
+
+      const char* pers = "smartcharge";
+      if (mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+                                (const unsigned char*)pers, strlen(pers)) != 0) return false;
+
+      // Only this CA is trusted (the PEM parser needs the terminating NUL)
+      if (mbedtls_x509_crt_parse(&_ca, (const unsigned char*)_caPem, strlen(_caPem) + 1) != 0) {
+        LOG_E("TLS: invalid CA certificate");
+        return false;
+      }
+
+      if (mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT) != 0) return false;
+      mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+      mbedtls_ssl_conf_ca_chain(&_conf, &_ca, NULL);
+      mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+      #if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+      #endif
+      #if MBEDTLS_VERSION_MAJOR >= 3
+        // Resumption below relies on TLS 1.2 session semantics
+        mbedtls_ssl_conf_max_tls_version(&_conf, MBEDTLS_SSL_VERSION_TLS1_2);
+      #endif
+
+      if (mbedtls_ssl_setup(&_ssl, &_conf) != 0) return false;
+      _configured = true;
+      return true;
+    }
+
+    int connectTls(const char* host, uint16_t port, int32_t timeoutMs) {
+      stop();
+      if (!configure()) return 0;
+      if (!_tcp.connect(host, port, timeoutMs)) return 0;
+
+      mbedtls_ssl_session_reset(&_ssl);
+      mbedtls_ssl_set_hostname(&_ssl, host);
+      mbedtls_ssl_set_bio(&_ssl, &_tcp, bioSend, bioRecv, NULL);
+
+      bool offered = _hasSession && mbedtls_ssl_set_session(&_ssl, &_session) == 0;
+
+      uint32_t start = millis();
+      int ret;
+      while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+        if (!wouldBlock(ret) || millis() - start > (uint32_t)timeoutMs) {
+          LOG_W("TLS: handshake failed, err=-0x%x", -ret);
+          _stats.failures++;
+          _tcp.stop();
+          return 0;
+        }
+        vTaskDelay(1);
+      }
+
+      uint32_t elapsed = millis() - start;
+      _stats.handshakes++;
+      _stats.lastHandshakeMs = elapsed;
+      _stats.totalHandshakeMs += elapsed;
+
+      // Keep the negotiated session for the next connect. The master secret
+      // only survives the handshake unchanged when the server resumed our session.
+      mbedtls_ssl_session fresh;
+      mbedtls_ssl_session_init(&fresh);
+      if (mbedtls_ssl_get_session(&_ssl, &fresh) == 0) {
+        if (offered && memcmp(fresh.TLS_FIELD(master), _session.TLS_FIELD(master),
+                              sizeof(fresh.TLS_FIELD(master))) == 0) {
+          _stats.resumed++;
+        }
+        mbedtls_ssl_session_free(&_session);
+        _session = fresh; // Takes ownership of the ticket/peer data
+        _hasSession = true;
+      } else {
+        mbedtls_ssl_session_free(&fresh);
+      }
+
+      _connected = true;
+      return 1;
+    }
+
+  public:
+    TlsSessionClient(const char* caPem) : _caPem(caPem), _timeoutMs(TLS_HANDSHAKE_TIMEOUT_MS) {
+      _configured = false;
+      _hasSession = false;
+      _connected = false;
+      _peeked = -1;
+      memset(&_stats, 0, sizeof(_stats));
+    }
+
+    int connect(IPAddress ip, uint16_t port) { return connectTls(ip.toString().c_str(), port, _timeoutMs); }
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) { return connectTls(ip.toString().c_str(), port, timeout); }
+    int connect(const char* host, uint16_t port) { return connectTls(host, port, _timeoutMs); }
+    int connect(const char* host, uint16_t port, int32_t timeout) { return connectTls(host, port, timeout); }
+
+    size_t write(const uint8_t* buf, size_t size) {
+      if (!_connected) return 0;
+      size_t done = 0;
+      uint32_t start = millis();
+      while (done < size) {
+        int ret = mbedtls_ssl_write(&_ssl, buf + done, size - done);
+        if (ret > 0) {
+          done += ret;
+        } else if (wouldBlock(ret) && millis() - start < _timeoutMs) {
+          vTaskDelay(1);
+        } else {
+          stop();
+          break;
+        }
+      }
+      return done;
+    }
+
+    size_t write(uint8_t b) { return write(&b, 1); }
+
+    int available() {
+      if (!_connected) return 0;
+      if (mbedtls_ssl_get_bytes_avail(&_ssl) == 0 && _tcp.available()) {
+        // Let mbedTLS decrypt the next record without consuming application data
+        int ret = mbedtls_ssl_read(&_ssl, NULL, 0);
+        if (ret < 0 && !wouldBlock(ret)) {
+          stop();
+          return 0;
+        }
+      }
+      return (int)mbedtls_ssl_get_bytes_avail(&_ssl) + (_peeked >= 0 ? 1 : 0);
+    }
+
+    int read(uint8_t* buf, size_t size) {
+      if (size == 0) return 0;
+      int got = 0;
+      if (_peeked >= 0) {
+        buf[got++] = (uint8_t)_peeked;
+        _peeked = -1;
+      }
+      if (!_connected || (size_t)got == size) return got > 0 ? got : -1;
+
+      int ret = mbedtls_ssl_read(&_ssl, buf + got, size - got);
+      if (ret > 0) return got + ret;
+      if (!wouldBlock(ret)) stop(); // 0 or CLOSE_NOTIFY: peer closed
+      return got > 0 ? got : -1;
+    }
+
+    int read() {
+      uint8_t b;
+      return read(&b, 1) == 1 ? b : -1;
+    }
+
+    int peek() {
+      if (_peeked < 0) {
+        int b = read();
+        _peeked = b;
+      }
+      return _peeked;
+    }
+
+    void flush() {}
+
+    void stop() {
+      if (_connected) {
+        mbedtls_ssl_close_notify(&_ssl);
+        _connected = false;
+      }
+      _peeked = -1;
+      _tcp.stop();
+    }
+
+    uint8_t connected() {
+      return _connected && (_tcp.connected() || available() > 0);
+    }
+
+    const TlsStats& getStats() { return _stats; }
+
+    uint32_t getAverageHandshakeMs() {
+      return _stats.handshakes ? _stats.totalHandshakeMs / _stats.handshakes : 0;
+    }
+};
+#endif // ENABLE_TLS
+
+#endif // TLS_TRANSPORT_H
@@ -0,0 +1,202 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// --- Trace Format ---
+// Every driver-level input the control loop consumes, one fixed 12-byte record
+// each (little-endian on the wire, see MQTTService::publishTraceChunk()):
+//
+//   type         arg                   a           b
+//   ADC          samples in the burst  -           sum of the raw ADC values
+//   BUTTON       pin level             -           -
+//   MODBUS       ModbusMaster result   reg 0       reg 1 | reg 2 << 16
+//   MODBUS_EXT   -                     reg 3       reg 4 | reg 5 << 16
+//   COMMAND      action | source << 4  -           command id
+//   CAPTURE      0 = arm, 1 = trigger  -           -
+//   STATE        TRACE_STATE_* flags   -           -
+//
+// ADC and MODBUS records are pulled by the Managers: a replayed read gets the
+// newest record due at its time (or the previous one again when the device had
+// not read yet). BUTTON, COMMAND and CAPTURE are pushed into the system and are
+// replayed at their timestamp. A STATE snapshot every TRACE_SNAPSHOT_MS lets a
+// replay start anywhere in the (wrapped) ring and check its outputs.
+enum TraceType : uint8_t {
+  TRACE_ADC = 1,
+  TRACE_BUTTON,
+  TRACE_MODBUS,
+  TRACE_MODBUS_EXT,
+  TRACE_COMMAND,
+  TRACE_CAPTURE,
+  TRACE_STATE
+};
+
+#define TRACE_STATE_REQUESTED 0x01 // PowerManager charging request
+#define TRACE_STATE_CUTOFF    0x02 // Safety cutoff
+#define TRACE_STATE_MAIN      0x04 // Main relay closed
+#define TRACE_STATE_FAN       0x08 // Fan relay closed
+
+#define TRACE_FORMAT_VERSION 1
+
+struct TraceRecord {
+  uint32_t t;    // millis()
+  uint8_t type;  // TraceType
+  uint8_t arg;
+  uint16_t a;
+  uint32_t b;
+};
+static_assert(sizeof(TraceRecord) == 12, "TraceRecord must stay 12 bytes");
+
+// --- Trace Recorder ---
+// Responsibilities: Flight recorder of driver inputs, Frozen read-out, Replay source
+// On the device the drivers call record() from any task; the ring always holds
+// the newest TRACE_RING_RECORDS inputs. freeze() stops recording so the ring
+// can be uploaded chunk by chunk, release() resumes (inputs in between are
+// counted as missed). Built with TRACE_REPLAY (tools/replay) the same object
+// is loaded with a downloaded trace and the drivers take() their inputs from it.
+class TraceRecorder {
+  private:
+    TraceRecord _ring[TRACE_RING_RECORDS];
+    uint32_t _written;   // Records ever written (ring position = _written % size)
+    uint32_t _missed;    // Records not written while frozen
+    volatile bool _frozen;
+    portMUX_TYPE _lock;
+
+    #if TRACE_REPLAY
+      const TraceRecord* _replay;
+      uint32_t _replayCount;
+      uint32_t _cursor[TRACE_STATE + 1]; // Next record per type
+      TraceRecord _last[TRACE_STATE + 1]; // Last pulled record per type (t = 0: none)
+      uint32_t _offSchedule; // Pulled reads the device did not make at that time
+
+      // Move the type's cursor onto its next record. False when exhausted.
+      bool seek(uint8_t type) {
+        if (type > TRACE_STATE) return false;
+        uint32_t& i = _cursor[type];
+        while (i < _replayCount && _replay[i].type != type) i++;
+        return i < _replayCount;
+      }
+    #endif
+
+  public:
+    TraceRecorder() : _written(0), _missed(0), _frozen(false) {
+      _lock = portMUX_INITIALIZER_UNLOCKED;
+      #if TRACE_REPLAY
+        _replay = NULL;
+        _replayCount = 0;
+        _offSchedule = 0;
+      #endif
+    }
+
+    // Append one input (drivers, PowerManager). Never blocks for more than a copy.
+    void record(uint8_t type, uint8_t arg, uint16_t a = 0, uint32_t b = 0) {
+      #if ENABLE_TRACE && !TRACE_REPLAY
+        TraceRecord r;
+        r.t = millis();
+        r.type = type;
+        r.arg = arg;
+        r.a = a;
+        r.b = b;
+        portENTER_CRITICAL(&_lock);
+        if (_frozen) {
+          _missed++;
+        } else {
+          _ring[_written % TRACE_RING_RECORDS] = r;
+          _written++;
+        }
+        portEXIT_CRITICAL(&_lock);
+      #else
+        (void)type; (void)arg; (void)a; (void)b; // Replay reads its inputs from the trace
+      #endif
+    }
+
+    // Stop recording for a read-out. Returns false if already frozen.
+    bool freeze() {
+      portENTER_CRITICAL(&_lock);
+      bool wasFrozen = _frozen;
+      _frozen = true;
+      portEXIT_CRITICAL(&_lock);
+      return !wasFrozen;
+    }
+
+    void release() {
+      _frozen = false;
+    }
+
+    bool isFrozen() { return _frozen; }
+
+    // Records available while frozen
+    uint32_t getCount() {
+      return _written < TRACE_RING_RECORDS ? _written : TRACE_RING_RECORDS;
+    }
+
+    uint32_t getMissed() { return _missed; }
+
+    // Copy up to max records, oldest first, starting at offset. Only while frozen.
+    uint16_t readChunk(uint32_t offset, TraceRecord* out, uint16_t max) {
+      uint32_t count = getCount();
+      if (!_frozen || offset >= count) return 0;
+      uint32_t first = _written - count;
+      uint16_t n = 0;
+      while (n < max && offset + n < count) {
+        out[n] = _ring[(first + offset + n) % TRACE_RING_RECORDS];
+        n++;
+      }
+      return n;
+    }
+
+    #if TRACE_REPLAY
+    // Host side: serve the records of a downloaded trace (not copied)
+    void load(const TraceRecord* records, uint32_t count) {
+      _replay = records;
+      _replayCount = count;
+      for (uint8_t i = 0; i <= TRACE_STATE; i++) {
+        _cursor[i] = 0;
+        _last[i].t = 0;
+      }
+      _offSchedule = 0;
+    }
+
+    // Pulled inputs (ADC, MODBUS): the newest record recorded by millis(). With
+    // the recorded schedule that is the record of this very read; otherwise the
+    // previous value is held (or the next record used if there is none yet).
+    bool take(uint8_t type, TraceRecord& out) {
+      if (type > TRACE_STATE) return false;
+      uint32_t now = millis();
+      TraceRecord next;
+      bool due = false;
+      while (takeDue(type, now, next)) due = true;
+      if (due) {
+        _last[type] = next;
+      } else if (_last[type].t == 0) {
+        if (!seek(type)) return false;
+        _last[type] = _replay[_cursor[type]++];
+      }
+      if (_last[type].t != now) _offSchedule++;
+      out = _last[type];
+      return true;
+    }
+
+    // Records of a type not consumed yet
+    uint32_t remaining(uint8_t type) {
+      uint32_t n = 0;
+      for (uint32_t i = seek(type) ? _cursor[type] : _replayCount; i < _replayCount; i++) {
+        if (_replay[i].type == type) n++;
+      }
+      return n;
+    }
+
+    // Reads that did not line up with a recorded read (0 = same schedule as the device)
+    uint32_t getOffSchedule() { return _offSchedule; }
+
+    // Next record of a type if it is due at `now` (pushed inputs: BUTTON, COMMAND, ...)
+    bool takeDue(uint8_t type, uint32_t now, TraceRecord& out) {
+      if (!seek(type) || (int32_t)(_replay[_cursor[type]].t - now) > 0) return false;
+      out = _replay[_cursor[type]++];
+      return true;
+    }
+    #endif
+};
+
+#endif // TRACE_RECORDER_H
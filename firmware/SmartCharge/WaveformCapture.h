@@ -0,0 +1,129 @@
+#ifndef WAVEFORM_CAPTURE_H
+#define WAVEFORM_CAPTURE_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// --- Waveform Capture ---
+// Responsibilities: Pre-trigger history of raw ADC samples, Burst capture at max rate, Chunked read-out
+// State is handed across cores without locks: the network side only moves
+// IDLE -> ARMED and READY -> IDLE, the sampling side only moves ARMED -> CAPTURING -> READY.
+// Each sample keeps the time since the previous one (us, saturating), so gaps
+// between ADC bursts are visible in the uploaded waveform.
+class WaveformCapture {
+  public:
+    enum State : uint8_t { IDLE, ARMED, CAPTURING, READY };
+
+  private:
+    uint16_t _raw[CAPTURE_SAMPLES];
+    uint16_t _dtUs[CAPTURE_SAMPLES];
+    uint16_t _head;           // Next write index
+    uint16_t _filled;         // Valid samples in the ring
+    uint16_t _postRemaining;  // Samples still to record after the trigger
+    uint16_t _triggerOffset;  // Trigger position in the read-out order
+    uint16_t _zeroRaw;
+    uint16_t _thresholdRaw;   // 0 = manual trigger only
+    uint32_t _lastSampleUs;
+    uint32_t _triggerMs;
+    volatile State _state;
+    volatile bool _triggerRequested;
+
+    void fire() {
+      _state = CAPTURING;
+      _triggerMs = millis();
+      // Position of the trigger sample once the post-trigger samples are in
+      _triggerOffset = (_filled + CAPTURE_POST_SAMPLES <= CAPTURE_SAMPLES)
+        ? _filled - 1
+        : CAPTURE_SAMPLES - CAPTURE_POST_SAMPLES - 1;
+      _postRemaining = CAPTURE_POST_SAMPLES;
+    }
+
+  public:
+    WaveformCapture() {
+      _head = 0;
+      _filled = 0;
+      _postRemaining = 0;
+      _triggerOffset = 0;
+      _zeroRaw = 0;
+      _thresholdRaw = 0;
+      _lastSampleUs = 0;
+      _triggerMs = 0;
+      _state = IDLE;
+      _triggerRequested = false;
+    }
+
+    // Start recording pre-trigger history. deltaRaw = 0 disables the threshold trigger.
+    bool arm(uint16_t zeroRaw, uint16_t deltaRaw) {
+      if (_state != IDLE) return false;
+      _head = 0;
+      _filled = 0;
+      _zeroRaw = zeroRaw;
+      _thresholdRaw = deltaRaw;
+      _triggerRequested = false;
+      _lastSampleUs = micros();
+      _state = ARMED;
+      return true;
+    }
+
+    // Manual trigger (MQTT/server command). Fires once the pre-trigger history is full.
+    void trigger() {
+      _triggerRequested = true;
+    }
+
+    // Called by the sensor driver for every raw ADC sample
+    void push(uint16_t raw) {
+      if (_state != ARMED && _state != CAPTURING) return;
+
+      uint32_t now = micros();
+      uint32_t dt = now - _lastSampleUs;
+      _lastSampleUs = now;
+
+      _raw[_head] = raw;
+      _dtUs[_head] = dt > 0xFFFF ? 0xFFFF : dt;
+      _head = (_head + 1) % CAPTURE_SAMPLES;
+      if (_filled < CAPTURE_SAMPLES) _filled++;
+
+      if (_state == ARMED) {
+        bool overThreshold = _thresholdRaw && abs((int)raw - (int)_zeroRaw) > _thresholdRaw;
+        bool manual = _triggerRequested && _filled >= CAPTURE_PRE_SAMPLES;
+        if (overThreshold || manual) {
+          fire();
+        }
+      } else if (--_postRemaining == 0) {
+        _state = READY;
+      }
+    }
+
+    bool isArmed() { return _state == ARMED; }
+    bool isCapturing() { return _state == CAPTURING; }
+    bool isReady() { return _state == READY; }
+    State getState() { return _state; }
+
+    // --- Read-out (only valid while READY) ---
+    uint16_t getSampleCount() { return _filled; }
+    uint16_t getTriggerOffset() { return _triggerOffset; }
+    uint32_t getTriggerMillis() { return _triggerMs; }
+
+    // Copy up to maxCount samples starting at `offset` (oldest first) as
+    // little-endian (raw, dtUs) uint16 pairs. Returns the number of samples copied.
+    uint16_t readChunk(uint16_t offset, uint8_t* out, uint16_t maxCount) {
+      if (_state != READY || offset >= _filled) return 0;
+      uint16_t start = _filled < CAPTURE_SAMPLES ? 0 : _head;
+      uint16_t count = _filled - offset < maxCount ? _filled - offset : maxCount;
+      for (uint16_t i = 0; i < count; i++) {
+        uint16_t idx = (start + offset + i) % CAPTURE_SAMPLES;
+        out[i * 4 + 0] = _raw[idx] & 0xFF;
+        out[i * 4 + 1] = _raw[idx] >> 8;
+        out[i * 4 + 2] = _dtUs[idx] & 0xFF;
+        out[i * 4 + 3] = _dtUs[idx] >> 8;
+      }
+      return count;
+    }
+
+    // Upload finished: allow the next capture
+    void release() {
+      if (_state == READY) _state = IDLE;
+    }
+};
+
+#endif // WAVEFORM_CAPTURE_H
@@ -0,0 +1,157 @@
+#ifndef WINDOW_AGGREGATOR_H
+#define WINDOW_AGGREGATOR_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Protocol.h"
+
+// --- P-Square Quantile Estimator ---
+// Responsibilities: Streaming estimate of one quantile in constant memory
+// Jain & Chlamtac's P² algorithm: five markers (min, p/2, p, (1+p)/2, max) whose
+// heights are adjusted with a piecewise-parabolic fit as samples arrive. Until
+// five samples have been seen the exact order statistic is returned.
+class P2Quantile {
+  private:
+    float _p;
+    float _q[5];   // Marker heights
+    int32_t _n[5]; // Actual marker positions
+    float _np[5];  // Desired marker positions
+    float _dn[5];  // Desired position increments
+    uint32_t _count;
+
+    float parabolic(int i, int d) {
+      return _q[i] + (float)d / (_n[i + 1] - _n[i - 1]) *
+             ((_n[i] - _n[i - 1] + d) * (_q[i + 1] - _q[i]) / (_n[i + 1] - _n[i]) +
+              (_n[i + 1] - _n[i] - d) * (_q[i] - _q[i - 1]) / (_n[i] - _n[i - 1]));
+    }
+
+    float linear(int i, int d) {
+      return _q[i] + d * (_q[i + d] - _q[i]) / (_n[i + d] - _n[i]);
+    }
+
+  public:
+    P2Quantile(float p) : _p(p) {
+      reset();
+    }
+
+    void reset() {
+      _count = 0;
+      for (int i = 0; i < 5; i++) _n[i] = i;
+      _np[0] = 0; _np[1] = 2 * _p; _np[2] = 4 * _p; _np[3] = 2 + 2 * _p; _np[4] = 4;
+      _dn[0] = 0; _dn[1] = _p / 2; _dn[2] = _p; _dn[3] = (1 + _p) / 2; _dn[4] = 1;
+    }
+
+    void add(float x) {
+      // Initialisation: keep the first five samples sorted
+      if (_count < 5) {
+        int i = _count++;
+        while (i > 0 && _q[i - 1] > x) {
+          _q[i] = _q[i - 1];
+          i--;
+        }
+        _q[i] = x;
+        return;
+      }
+      _count++;
+
+      // Locate the cell containing x, extending the extremes if needed
+      int k;
+      if (x < _q[0]) {
+        _q[0] = x;
+        k = 0;
+      } else if (x >= _q[4]) {
+        _q[4] = x;
+        k = 3;
+      } else {
+        k = 0;
+        while (x >= _q[k + 1]) k++;
+      }
+
+      for (int i = k + 1; i < 5; i++) _n[i]++;
+      for (int i = 0; i < 5; i++) _np[i] += _dn[i];
+
+      // Move the middle markers towards their desired positions
+      for (int i = 1; i <= 3; i++) {
+        float d = _np[i] - _n[i];
+        if ((d >= 1 && _n[i + 1] - _n[i] > 1) || (d <= -1 && _n[i - 1] - _n[i] < -1)) {
+          int step = d > 0 ? 1 : -1;
+          float q = parabolic(i, step);
+          _q[i] = (_q[i - 1] < q && q < _q[i + 1]) ? q : linear(i, step);
+          _n[i] += step;
+        }
+      }
+    }
+
+    float get() {
+      if (_count == 0) return 0.0f;
+      if (_count < 5) {
+        int idx = (int)(_p * (_count - 1) + 0.5f);
+        return _q[idx];
+      }
+      return _q[2];
+    }
+};
+
+// --- Window Aggregator ---
+// Responsibilities: Per-window statistics of one channel at the acquisition rate
+// Fed by a Manager on every sample (hardware task); the network task takes the
+// statistics once per report, which also starts the next window. Mean and
+// variance use Welford's update, p50/p95 come from P² estimators.
+class WindowAggregator {
+  private:
+    uint32_t _count;
+    float _min;
+    float _max;
+    float _mean;
+    float _m2;
+    P2Quantile _p50;
+    P2Quantile _p95;
+    portMUX_TYPE _lock;
+
+    void resetLocked() {
+      _count = 0;
+      _min = 0.0f;
+      _max = 0.0f;
+      _mean = 0.0f;
+      _m2 = 0.0f;
+      _p50.reset();
+      _p95.reset();
+    }
+
+  public:
+    WindowAggregator() : _p50(0.50f), _p95(0.95f) {
+      _lock = portMUX_INITIALIZER_UNLOCKED;
+      resetLocked();
+    }
+
+    void add(float x) {
+      portENTER_CRITICAL(&_lock);
+      _count++;
+      if (_count == 1 || x < _min) _min = x;
+      if (_count == 1 || x > _max) _max = x;
+      float delta = x - _mean;
+      _mean += delta / _count;
+      _m2 += delta * (x - _mean);
+      _p50.add(x);
+      _p95.add(x);
+      portEXIT_CRITICAL(&_lock);
+    }
+
+    // Statistics of the current window; starts a new one
+    WindowStats take() {
+      WindowStats s;
+      portENTER_CRITICAL(&_lock);
+      s.count    = _count;
+      s.min      = _min;
+      s.max      = _max;
+      s.mean     = _mean;
+      s.variance = _count > 1 ? _m2 / (_count - 1) : 0.0f;
+      s.p50      = _p50.get();
+      s.p95      = _p95.get();
+      resetLocked();
+      portEXIT_CRITICAL(&_lock);
+      return s;
+    }
+};
+
+#endif // WINDOW_AGGREGATOR_H
@@ -0,0 +1,1008 @@
+// SmartCharge NEO - Simulated station fleet load generator
+//
+// Runs thousands of simulated stations on one epoll event loop against a local
+// Next.js instance (POST /api/iot/stations/[id]), a local MQTT broker and the
+// CoAP gateway (scripts/coap-gateway.ts). Payloads and command handling come
+// from the firmware itself (firmware/SmartCharge/Protocol.h, Coap.h), so the
+// server sees exactly what an ESP32 sends.
+//
+// Per transport the results include packets and bytes on the air per delivered
+// report (IPv4: TCP segments from TCP_INFO plus 52 header bytes each, UDP
+// datagrams plus 28), so HTTP and CoAP can be compared on the same stand-in.
+//
+// Build (Linux, ArduinoJson 7 from the Arduino libraries folder):
+//   g++ -O2 -std=c++17 -I../../SmartCharge -I$HOME/Arduino/libraries/ArduinoJson/src loadgen.cpp -o loadgen
+//
+// Stations must exist with deviceId "esp32-station-<id>" (npx tsx prisma/seed-fleet.ts <count>).
+//
+// Example: 2000 HTTP stations every 5 s, 500 MQTT stations, 20 commands/s, 120 s:
+//   ./loadgen --stations 2000 --mqtt-stations 500 --interval-ms 5000 --cmd-rate 20 --duration 120
+//
+// HTTP vs CoAP (gateway: npm run coap), 5% datagram loss each way:
+//   ./loadgen --stations 200 --coap-stations 200 --coap-loss 5 --duration 120
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <linux/tcp.h> // TCP_INFO with segment/byte counters (glibc's copy is older)
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "Coap.h"
+#include "Protocol.h"
+
+// --- Options ---
+struct Options {
+  std::string host = "127.0.0.1";
+  int httpPort = 3000;
+  int mqttPort = 1883;
+  int coapPort = COAP_PORT;
+  std::string apiKey = "smartcharge-neo-secret-key-2024"; // IOT_API_KEY in Config.h
+  int stations = 100;         // HTTP stations
+  int mqttStations = 0;       // MQTT stations
+  int coapStations = 0;       // CoAP stations (ENABLE_COAP)
+  double coapLoss = 0.0;      // Percent of datagrams dropped, each direction
+  int firstId = 1;            // First station ID
+  int intervalMs = 5000;      // NETWORK_LOOP_DELAY
+  int mqttIntervalMs = 5000;  // MQTTService::_publishInterval
+  double cmdRate = 0.0;       // Commands per second across the fleet
+  int durationS = 60;
+  int timeoutMs = 10000;      // Per HTTP request
+};
+
+static Options opt;
+
+static uint64_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+// Wall clock for report timestamps (stands in for the station's DeviceClock)
+static int64_t unixMs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// --- Metrics ---
+struct LatencyStat {
+  const char* name;
+  std::vector<uint32_t> samples; // us
+  uint64_t ok = 0;
+  uint64_t errors = 0;
+
+  explicit LatencyStat(const char* statName) : name(statName) {}
+
+  void record(uint64_t us) {
+    samples.push_back(us > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)us);
+    ok++;
+  }
+
+  void print(double seconds) {
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) -> double {
+      if (samples.empty()) return 0.0;
+      size_t i = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+      return samples[i] / 1000.0;
+    };
+    uint64_t total = ok + errors;
+    printf("%-16s n=%-8llu rate=%8.1f/s err=%6.2f%%  p50=%8.2fms p90=%8.2fms p99=%8.2fms max=%8.2fms\n",
+           name, (unsigned long long)total, total / seconds,
+           total ? 100.0 * errors / total : 0.0,
+           pct(0.50), pct(0.90), pct(0.99), samples.empty() ? 0.0 : samples.back() / 1000.0);
+  }
+};
+
+static LatencyStat statTelemetry{"telemetry POST"};
+static LatencyStat statCommandPost{"command POST"};
+static LatencyStat statHttpDelivery{"cmd->device HTTP"};
+static LatencyStat statMqttPublish{"state publish"};
+static LatencyStat statMqttDelivery{"cmd->device MQTT"};
+static LatencyStat statCoapTelemetry{"telemetry CoAP"};
+static LatencyStat statCoapDelivery{"cmd->device CoAP"};
+static uint64_t connectFailures = 0;
+static uint64_t timeouts = 0;
+
+// Packets and bytes on the air for telemetry, failed attempts included
+struct WireStat {
+  const char* name;
+  uint64_t packets = 0;
+  uint64_t bytes = 0; // IP + transport headers included
+
+  explicit WireStat(const char* statName) : name(statName) {}
+
+  void print(const LatencyStat& delivered) {
+    if (packets == 0) return;
+    double reports = delivered.ok ? (double)delivered.ok : 1.0;
+    printf("%-16s packets/report=%6.2f  bytes/report=%8.1f\n", name, packets / reports, bytes / reports);
+  }
+};
+
+static const int kTcpHeaderBytes = 20 + 20 + 12; // IPv4 + TCP + timestamps option
+static const int kUdpHeaderBytes = 20 + 8;       // IPv4 + UDP
+static WireStat wireHttp{"wire HTTP"};
+static WireStat wireCoap{"wire CoAP"};
+
+// --- Event Loop ---
+struct Handler {
+  virtual void onEvent(uint32_t events) = 0;
+  virtual ~Handler() {}
+};
+
+struct Timer {
+  uint64_t at;
+  uint32_t gen;
+  void (*fn)(void* ctx, uint32_t gen);
+  void* ctx;
+  bool operator>(const Timer& o) const { return at > o.at; }
+};
+
+static int epfd = -1;
+static std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+
+static void schedule(uint64_t at, void (*fn)(void*, uint32_t), void* ctx, uint32_t gen) {
+  timers.push(Timer{at, gen, fn, ctx});
+}
+
+static int openSocket(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void watch(int fd, Handler* h, uint32_t events, bool add) {
+  epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = h;
+  epoll_ctl(epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+}
+
+// --- Minimal HTTP/1.1 exchange (one connection per request, like HTTPClient + http.end()) ---
+struct HttpExchange : Handler {
+  int fd = -1;
+  uint32_t gen = 0;
+  std::string out;
+  size_t sent = 0;
+  std::string in;
+  uint64_t startUs = 0;
+  const char* extraHeaders = ""; // Complete header lines ("Name: value\r\n")
+  WireStat* wire = nullptr;      // Segments of this exchange are counted here
+
+  virtual void onResponse(int status, const std::string& body) = 0;
+  virtual void onFailure() = 0;
+
+  bool busy() { return fd >= 0; }
+
+  void start(const char* path, const std::string& body) {
+    char head[512];
+    int n = snprintf(head, sizeof(head),
+                     "POST %s HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: application/json\r\n"
+                     "x-api-key: %s\r\n%sContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     path, opt.host.c_str(), opt.httpPort, opt.apiKey.c_str(), extraHeaders, body.size());
+    out.assign(head, n);
+    out += body;
+    sent = 0;
+    in.clear();
+    startUs = nowUs();
+    gen++;
+
+    fd = openSocket(opt.httpPort);
+    if (fd < 0) {
+      connectFailures++;
+      onFailure();
+      return;
+    }
+    watch(fd, this, EPOLLOUT | EPOLLIN, true);
+    schedule(startUs + (uint64_t)opt.timeoutMs * 1000, &HttpExchange::onTimeout, this, gen);
+  }
+
+  static void onTimeout(void* ctx, uint32_t gen) {
+    HttpExchange* self = static_cast<HttpExchange*>(ctx);
+    if (self->fd < 0 || self->gen != gen) return;
+    timeouts++;
+    self->finish(false);
+  }
+
+  void finish(bool complete) {
+    if (wire) {
+      // Handshake, data and ACKs so far; our FIN and its ACK are still to come
+      tcp_info info;
+      socklen_t len = sizeof(info);
+      memset(&info, 0, sizeof(info));
+      if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+        uint64_t segments = (uint64_t)info.tcpi_segs_out + info.tcpi_segs_in + 2;
+        wire->packets += segments;
+        wire->bytes += info.tcpi_bytes_acked + info.tcpi_bytes_received + segments * kTcpHeaderBytes;
+      }
+    }
+    close(fd);
+    fd = -1;
+    if (!complete) {
+      onFailure();
+      return;
+    }
+
+    int status = 0;
+    if (sscanf(in.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+      onFailure();
+      return;
+    }
+    size_t bodyAt = in.find("\r\n\r\n");
+    std::string body = bodyAt == std::string::npos ? "" : in.substr(bodyAt + 4);
+    if (in.find("Transfer-Encoding: chunked") != std::string::npos ||
+        in.find("transfer-encoding: chunked") != std::string::npos) {
+      body = dechunk(body);
+    }
+    onResponse(status, body);
+  }
+
+  static std::string dechunk(const std::string& raw) {
+    std::string body;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+      size_t eol = raw.find("\r\n", pos);
+      if (eol == std::string::npos) break;
+      size_t len = strtoul(raw.c_str() + pos, NULL, 16);
+      if (len == 0) break;
+      body.append(raw, eol + 2, len);
+      pos = eol + 2 + len + 2;
+    }
+    return body;
+  }
+
+  void onEvent(uint32_t events) override {
+    if (fd < 0) return;
+    if (events & EPOLLOUT) {
+      if (sent == 0) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+          connectFailures++;
+          finish(false);
+          return;
+        }
+      }
+      ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+      if (n > 0) sent += n;
+      if (sent == out.size()) watch(fd, this, EPOLLIN, false);
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      char buf[4096];
+      for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+          in.append(buf, n);
+        } else if (n == 0) {
+          finish(true); // Connection: close -> EOF ends the response
+          return;
+        } else {
+          if (errno != EAGAIN && errno != EWOULDBLOCK) finish(false);
+          return;
+        }
+      }
+    }
+  }
+};
+
+// --- Simulated PowerManager state shared by the HTTP and MQTT stations ---
+struct SimPower {
+  bool relayOn = false;
+  float current = 0.0f;
+  float battVoltage = 12.6f;
+  float pvPower = 0.0f;
+
+  void step(std::mt19937& rng) {
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    current = relayOn ? 2.4f + noise(rng) : 0.0f;
+    battVoltage = std::min(14.4f, std::max(11.5f, battVoltage + noise(rng) * 0.1f));
+    pvPower = std::max(0.0f, pvPower + noise(rng) * 20.0f);
+  }
+
+  TelemetryReport report() {
+    TelemetryReport r;
+    r.current = current;
+    r.pvPower = pvPower;
+    r.battVoltage = battVoltage;
+    r.voltage = battVoltage * 10.0f;
+    r.status = relayOn ? "CHARGING" : "AVAILABLE"; // PowerManager::getStatusString()
+    r.relayOn = relayOn;
+    r.timestamp = unixMs();
+    return r;
+  }
+
+  void apply(RemoteCommand cmd) {
+    if (cmd == CMD_START) relayOn = true;
+    if (cmd == CMD_STOP) relayOn = false;
+  }
+};
+
+static std::mt19937 rng(42);
+
+// --- Polled Station: report and command handling of IoTService (HTTP and CoAP) ---
+struct PolledStation {
+  int id;
+  SimPower power;
+  std::deque<uint64_t> issuedCommands; // Creation times of commands POSTed for this station
+  struct Ack { std::string commandId; uint64_t appliedUs; };
+  std::vector<Ack> acks;  // Not yet accepted by the server (like IoTService::_unsentAcks)
+  size_t acksInFlight = 0;
+  LatencyStat* delivery;
+
+  PolledStation(int stationId, LatencyStat* deliveryStat) : id(stationId), delivery(deliveryStat) {}
+  virtual ~PolledStation() {}
+
+  std::string nextReport() {
+    power.step(rng);
+    JsonDocument doc;
+    buildTelemetryDoc(doc, power.report(), id);
+    acksInFlight = acks.size();
+    if (!acks.empty()) {
+      // The simulated relay switches as soon as the command is applied
+      JsonArray arr = doc["acks"].to<JsonArray>();
+      for (const Ack& a : acks) {
+        JsonObject o = arr.add<JsonObject>();
+        o["commandId"] = a.commandId.c_str();
+        o["result"]    = "APPLIED";
+        o["latencyMs"] = 0;
+        o["ageMs"]     = (uint32_t)((nowUs() - a.appliedUs) / 1000);
+      }
+    }
+    std::string body;
+    serializeJson(doc, body);
+    return body;
+  }
+
+  // Report accepted; body is {command, commandId} or empty
+  void delivered(const std::string& body) {
+    acks.erase(acks.begin(), acks.begin() + acksInFlight);
+    acksInFlight = 0;
+    if (body.empty()) return; // No command pending
+
+    JsonDocument res;
+    if (deserializeJson(res, body)) return;
+    RemoteCommand cmd = parseServerCommand(extractCommand(res));
+    if (cmd != CMD_NONE) {
+      power.apply(cmd);
+      const char* commandId = extractCommandId(res);
+      if (commandId) acks.push_back({commandId, nowUs()});
+      if (!issuedCommands.empty()) {
+        delivery->record(nowUs() - issuedCommands.front());
+        issuedCommands.pop_front();
+      }
+    }
+  }
+};
+
+// --- HTTP Station (IoTService) ---
+struct HttpStation : HttpExchange, PolledStation {
+  char path[64];
+
+  explicit HttpStation(int stationId) : PolledStation(stationId, &statHttpDelivery) {
+    snprintf(path, sizeof(path), "/api/iot/stations/%d", id);
+    extraHeaders = "Prefer: " PREFER_MINIMAL_HEADER "\r\n"; // Like IoTService: 204 without a command
+    wire = &wireHttp;
+  }
+
+  static void tick(void* ctx, uint32_t) {
+    HttpStation* self = static_cast<HttpStation*>(ctx);
+    uint64_t next = nowUs() + (uint64_t)opt.intervalMs * 1000;
+    if (!self->busy()) {
+      self->start(self->path, self->nextReport());
+    } else {
+      statTelemetry.errors++; // Previous report still in flight: the device would have blocked
+    }
+    schedule(next, &HttpStation::tick, self, 0);
+  }
+
+  void onResponse(int status, const std::string& body) override {
+    if (status < 200 || status >= 300) {
+      statTelemetry.errors++;
+      return;
+    }
+    statTelemetry.record(nowUs() - startUs);
+    delivered(status == 204 ? std::string() : body);
+  }
+
+  void onFailure() override { statTelemetry.errors++; }
+};
+
+// --- CoAP Station (IoTService with ENABLE_COAP, see CoapTransport.h) ---
+// Confirmable POST with the firmware's timeouts and block size; --coap-loss
+// drops datagrams on the way out and in to exercise retransmission.
+struct CoapStation : Handler, PolledStation {
+  int fd = -1;
+  uint32_t gen = 0;
+  bool busy = false;
+  uint64_t startUs = 0;
+  uint16_t messageId;
+  uint8_t token[4];
+  uint8_t szx = COAP_BLOCK_SZX;
+  char idText[12];         // Last Uri-Path segment
+  char query[96];
+
+  std::string body;        // Report being sent
+  size_t offset = 0;       // First byte of the current block
+  size_t chunk = 0;
+  bool blockwise = false;
+  uint16_t currentId = 0;  // Message ID awaiting its ACK
+  uint8_t attempt = 0;
+  uint64_t ackTimeoutUs = 0;
+  uint8_t tx[COAP_HEADER_BYTES + COAP_MAX_TOKEN + 128 + 1024];
+  size_t txLen = 0;
+
+  explicit CoapStation(int stationId) : PolledStation(stationId, &statCoapDelivery) {
+    messageId = (uint16_t)rng();
+    snprintf(idText, sizeof(idText), "%d", id);
+    snprintf(query, sizeof(query), "key=%s", opt.apiKey.c_str());
+  }
+
+  bool open() {
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.coapPort);
+    inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    watch(fd, this, EPOLLIN, true);
+    return true;
+  }
+
+  static bool lost() {
+    return opt.coapLoss > 0 && std::uniform_real_distribution<double>(0, 100)(rng) < opt.coapLoss;
+  }
+
+  static void tick(void* ctx, uint32_t) {
+    CoapStation* self = static_cast<CoapStation*>(ctx);
+    uint64_t next = nowUs() + (uint64_t)opt.intervalMs * 1000;
+    if (self->fd < 0 && !self->open()) {
+      connectFailures++;
+      statCoapTelemetry.errors++;
+    } else if (!self->busy) {
+      self->body = self->nextReport();
+      self->busy = true;
+      self->startUs = nowUs();
+      self->offset = 0;
+      self->blockwise = self->body.size() > coapBlockSize(self->szx);
+      uint32_t t = (uint32_t)rng();
+      memcpy(self->token, &t, sizeof(self->token));
+      self->sendBlock();
+    } else {
+      statCoapTelemetry.errors++; // Previous report still in flight: the device would have blocked
+    }
+    schedule(next, &CoapStation::tick, self, 0);
+  }
+
+  void sendBlock() {
+    chunk = std::min(blockwise ? coapBlockSize(szx) : body.size(), body.size() - offset);
+    bool more = offset + chunk < body.size();
+    currentId = messageId++;
+
+    CoapWriter w(tx, sizeof(tx));
+    w.header(COAP_CON, COAP_POST, currentId, token, sizeof(token));
+    w.option(COAP_OPT_URI_PATH, "iot");
+    w.option(COAP_OPT_URI_PATH, "stations");
+    w.option(COAP_OPT_URI_PATH, idText);
+    w.optionUint(COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_JSON);
+    w.option(COAP_OPT_URI_QUERY, query);
+    if (blockwise) {
+      w.optionUint(COAP_OPT_BLOCK1, coapBlock1(offset / coapBlockSize(szx), more, szx));
+      if (offset == 0) w.optionUint(COAP_OPT_SIZE1, body.size());
+    }
+    w.payload((const uint8_t*)body.data() + offset, chunk);
+    txLen = w.length();
+
+    attempt = 0;
+    ackTimeoutUs = (COAP_ACK_TIMEOUT_MS + rng() % (COAP_ACK_TIMEOUT_MS / 2 + 1)) * 1000ull;
+    transmit();
+  }
+
+  void transmit() {
+    wireCoap.packets++;
+    wireCoap.bytes += txLen + kUdpHeaderBytes;
+    if (!lost()) send(fd, tx, txLen, 0);
+    gen++;
+    schedule(nowUs() + ackTimeoutUs, &CoapStation::onTimeout, this, gen);
+  }
+
+  static void onTimeout(void* ctx, uint32_t gen) {
+    CoapStation* self = static_cast<CoapStation*>(ctx);
+    if (!self->busy || self->gen != gen) return;
+    if (self->attempt < COAP_MAX_RETRANSMIT) {
+      self->attempt++;
+      self->ackTimeoutUs *= 2;
+      self->transmit();
+      return;
+    }
+    timeouts++;
+    self->finish(false, CoapView());
+  }
+
+  void onEvent(uint32_t) override {
+    uint8_t rx[1500];
+    for (;;) {
+      ssize_t n = recv(fd, rx, sizeof(rx), 0);
+      if (n < 0) return; // EAGAIN, or ICMP unreachable: the retransmission timer handles it
+      wireCoap.packets++;
+      wireCoap.bytes += n + kUdpHeaderBytes;
+      CoapView res;
+      if (lost() || !busy || !coapParse(rx, n, res)) continue;
+      if (res.type != COAP_ACK || res.messageId != currentId || res.code == COAP_EMPTY) continue;
+      if (res.tokenLength != sizeof(token) || memcmp(res.token, token, sizeof(token)) != 0) continue;
+
+      gen++; // Cancel the retransmission timer
+      if (blockwise && res.code == COAP_CONTINUE && offset + chunk < body.size()) {
+        offset += chunk;
+        const uint8_t* value;
+        uint16_t vlen;
+        if (coapFindOption(res, COAP_OPT_BLOCK1, value, vlen) && (coapUint(value, vlen) & 0x07) < szx) {
+          szx = coapUint(value, vlen) & 0x07; // Gateway asked for smaller blocks
+        }
+        sendBlock();
+        continue;
+      }
+      finish(COAP_CODE_CLASS(res.code) == 2, res);
+    }
+  }
+
+  void finish(bool ok, const CoapView& res) {
+    busy = false;
+    if (!ok) {
+      statCoapTelemetry.errors++;
+      return;
+    }
+    statCoapTelemetry.record(nowUs() - startUs);
+    delivered(std::string((const char*)res.payload, res.payloadLength));
+  }
+};
+
+// --- Command issuer (POST /api/stations/[id]/command) ---
+struct CommandPost : HttpExchange {
+  PolledStation* target = nullptr;
+  bool free = true;
+
+  void send(PolledStation* station) {
+    target = station;
+    free = false;
+    char path[64];
+    snprintf(path, sizeof(path), "/api/stations/%d/command", station->id);
+    start(path, station->power.relayOn ? "{\"command\":\"STOP\"}" : "{\"command\":\"START\"}");
+  }
+
+  void onResponse(int status, const std::string&) override {
+    free = true;
+    if (status < 200 || status >= 300) {
+      statCommandPost.errors++;
+      return;
+    }
+    statCommandPost.record(nowUs() - startUs);
+    target->issuedCommands.push_back(startUs);
+  }
+
+  void onFailure() override {
+    free = true;
+    statCommandPost.errors++;
+  }
+};
+
+// --- Minimal MQTT 3.1.1 client (QoS 0, like PubSubClient) ---
+static void putLength(std::string& s, size_t len) {
+  do {
+    uint8_t b = len % 128;
+    len /= 128;
+    if (len) b |= 0x80;
+    s.push_back((char)b);
+  } while (len);
+}
+
+static void putString(std::string& s, const std::string& v) {
+  s.push_back((char)(v.size() >> 8));
+  s.push_back((char)(v.size() & 0xFF));
+  s += v;
+}
+
+static std::string packet(uint8_t header, const std::string& body) {
+  std::string p(1, (char)header);
+  putLength(p, body.size());
+  return p + body;
+}
+
+struct MqttClient : Handler {
+  int fd = -1;
+  std::string clientId;
+  std::string willTopic;
+  std::string out;
+  std::string in;
+  bool connected = false;
+  uint16_t nextPacketId = 1;
+
+  virtual void onConnected() = 0;
+  virtual void onPublish(const std::string& topic, const std::string& payload) = 0;
+
+  void open() {
+    fd = openSocket(opt.mqttPort);
+    if (fd < 0) {
+      connectFailures++;
+      return;
+    }
+    std::string body;
+    putString(body, "MQTT");
+    body.push_back(4);                                  // Protocol level 3.1.1
+    body.push_back(willTopic.empty() ? 0x02 : 0x26);    // Clean session (+ retained QoS 0 will)
+    body.push_back(0);
+    body.push_back(15);                                 // Keep-alive 15 s (PubSubClient default)
+    putString(body, clientId);
+    if (!willTopic.empty()) {
+      putString(body, willTopic);
+      putString(body, "offline");
+    }
+    out = packet(0x10, body);
+    in.clear();
+    watch(fd, this, EPOLLIN | EPOLLOUT, true);
+  }
+
+  void publish(const std::string& topic, const std::string& payload, bool retain = false) {
+    std::string body;
+    putString(body, topic);
+    body += payload;
+    queue(packet(retain ? 0x31 : 0x30, body));
+  }
+
+  void subscribe(const std::string& topic) {
+    std::string body;
+    body.push_back((char)(nextPacketId >> 8));
+    body.push_back((char)(nextPacketId & 0xFF));
+    nextPacketId++;
+    putString(body, topic);
+    body.push_back(0);
+    queue(packet(0x82, body));
+  }
+
+  void ping() { queue(std::string("\xC0\x00", 2)); }
+
+  void queue(const std::string& p) {
+    if (fd < 0) return;
+    bool idle = out.empty();
+    out += p;
+    if (idle) flush();
+  }
+
+  void flush() {
+    while (!out.empty()) {
+      ssize_t n = send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+      if (n <= 0) break;
+      out.erase(0, n);
+    }
+    watch(fd, this, out.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT), false);
+  }
+
+  void drop() {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    connected = false;
+  }
+
+  void onEvent(uint32_t events) override {
+    if (fd < 0) return;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+      connectFailures++;
+      drop();
+      return;
+    }
+    if (events & EPOLLOUT) flush();
+    if (events & EPOLLIN) {
+      char buf[4096];
+      for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+          in.append(buf, n);
+        } else {
+          if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) drop();
+          break;
+        }
+      }
+      parse();
+    }
+  }
+
+  void parse() {
+    for (;;) {
+      // Fixed header + variable-length remaining length
+      size_t len = 0, mul = 1, pos = 1;
+      if (in.size() < 2) return;
+      uint8_t b;
+      do {
+        if (pos >= in.size()) return;
+        b = in[pos++];
+        len += (b & 0x7F) * mul;
+        mul *= 128;
+      } while (b & 0x80);
+      if (in.size() < pos + len) return;
+
+      uint8_t type = (uint8_t)in[0] >> 4;
+      std::string body = in.substr(pos, len);
+      in.erase(0, pos + len);
+
+      if (type == 2) { // CONNACK
+        if (body.size() >= 2 && body[1] == 0) {
+          connected = true;
+          onConnected();
+        } else {
+          connectFailures++;
+          drop();
+          return;
+        }
+      } else if (type == 3 && body.size() >= 2) { // PUBLISH (QoS 0)
+        size_t tlen = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+        onPublish(body.substr(2, tlen), body.substr(2 + tlen));
+      }
+    }
+  }
+};
+
+static std::string stationTopic(int id, const char* leaf) {
+  return "smartcharge/station" + std::to_string(id) + "/" + leaf;
+}
+
+// --- MQTT Station (MQTTService) ---
+struct MqttStation : MqttClient {
+  int id;
+  SimPower power;
+  uint64_t lastCommandSentUs = 0; // Set by the commander, same process clock
+
+  explicit MqttStation(int stationId) : id(stationId) {
+    clientId = "loadgen-station" + std::to_string(id);
+    willTopic = stationTopic(id, "availability");
+  }
+
+  void onConnected() override {
+    publish(willTopic, "online", true);
+    subscribe(stationTopic(id, "set"));
+  }
+
+  void publishState() {
+    JsonDocument doc;
+    buildStateDoc(doc, power.report());
+    std::string payload;
+    serializeJson(doc, payload);
+    uint64_t start = nowUs();
+    publish(stationTopic(id, "state"), payload);
+    statMqttPublish.record(nowUs() - start); // Time the publish blocks the caller
+  }
+
+  void onPublish(const std::string&, const std::string& payload) override {
+    RemoteCommand cmd = parseMqttCommand(payload.c_str());
+    if (cmd == CMD_NONE) return;
+    power.apply(cmd);
+    if (lastCommandSentUs) {
+      statMqttDelivery.record(nowUs() - lastCommandSentUs);
+      lastCommandSentUs = 0;
+    }
+    publishState(); // Home Assistant expects the new relay state right away
+  }
+
+  static void tick(void* ctx, uint32_t) {
+    MqttStation* self = static_cast<MqttStation*>(ctx);
+    if (self->fd < 0) {
+      self->open(); // Reconnect, like MQTTService::update()
+    } else if (self->connected) {
+      self->power.step(rng);
+      self->publishState();
+      self->ping();
+    } else {
+      statMqttPublish.errors++;
+    }
+    schedule(nowUs() + (uint64_t)opt.mqttIntervalMs * 1000, &MqttStation::tick, self, 0);
+  }
+};
+
+// Home Assistant stand-in that toggles MQTT stations
+struct MqttCommander : MqttClient {
+  MqttCommander() { clientId = "loadgen-commander"; }
+  void onConnected() override {}
+  void onPublish(const std::string&, const std::string&) override {}
+
+  void toggle(MqttStation* station) {
+    if (!connected) {
+      statMqttDelivery.errors++;
+      return;
+    }
+    station->lastCommandSentUs = nowUs();
+    publish(stationTopic(station->id, "set"), station->power.relayOn ? "OFF" : "ON");
+  }
+};
+
+static std::vector<HttpStation*> httpStations;
+static std::vector<MqttStation*> mqttStations;
+static std::vector<CoapStation*> coapStations;
+static std::vector<CommandPost*> commandPosts;
+static MqttCommander* commander = nullptr;
+
+static void commandTick(void*, uint32_t) {
+  std::uniform_int_distribution<int> pick(0, 1 << 30);
+  size_t polled = httpStations.size() + coapStations.size();
+  size_t total = polled + mqttStations.size();
+  if (total > 0) {
+    size_t i = pick(rng) % total;
+    if (i < polled) {
+      PolledStation* station = i < httpStations.size() ? (PolledStation*)httpStations[i]
+                                                       : coapStations[i - httpStations.size()];
+      auto slot = std::find_if(commandPosts.begin(), commandPosts.end(), [](CommandPost* c) { return c->free; });
+      if (slot != commandPosts.end()) {
+        (*slot)->send(station);
+      } else {
+        statCommandPost.errors++;
+      }
+    } else {
+      commander->toggle(mqttStations[i - polled]);
+    }
+  }
+  schedule(nowUs() + (uint64_t)(1e6 / opt.cmdRate), &commandTick, nullptr, 0);
+}
+
+static void usage() {
+  printf("usage: loadgen [--host 127.0.0.1] [--http-port 3000] [--mqtt-port 1883] [--coap-port 5683]\n"
+         "               [--api-key KEY] [--stations N] [--mqtt-stations N] [--coap-stations N]\n"
+         "               [--first-id 1] [--interval-ms 5000] [--mqtt-interval-ms 5000] [--cmd-rate PER_S]\n"
+         "               [--coap-loss PERCENT] [--duration S] [--timeout-ms 10000]\n");
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) return false;
+    const char* v = argv[++i];
+    if (a == "--host") opt.host = v;
+    else if (a == "--http-port") opt.httpPort = atoi(v);
+    else if (a == "--mqtt-port") opt.mqttPort = atoi(v);
+    else if (a == "--coap-port") opt.coapPort = atoi(v);
+    else if (a == "--api-key") opt.apiKey = v;
+    else if (a == "--stations") opt.stations = atoi(v);
+    else if (a == "--mqtt-stations") opt.mqttStations = atoi(v);
+    else if (a == "--coap-stations") opt.coapStations = atoi(v);
+    else if (a == "--coap-loss") opt.coapLoss = atof(v);
+    else if (a == "--first-id") opt.firstId = atoi(v);
+    else if (a == "--interval-ms") opt.intervalMs = atoi(v);
+    else if (a == "--mqtt-interval-ms") opt.mqttIntervalMs = atoi(v);
+    else if (a == "--cmd-rate") opt.cmdRate = atof(v);
+    else if (a == "--duration") opt.durationS = atoi(v);
+    else if (a == "--timeout-ms") opt.timeoutMs = atoi(v);
+    else return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) {
+    usage();
+    return 1;
+  }
+
+  // Thousands of sockets: lift the descriptor limit as far as allowed
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  uint64_t t0 = nowUs();
+
+  // Spread first reports over one interval, like a fleet that booted at random times
+  std::uniform_int_distribution<uint64_t> httpPhase(0, (uint64_t)opt.intervalMs * 1000);
+  for (int i = 0; i < opt.stations; i++) {
+    HttpStation* s = new HttpStation(opt.firstId + i);
+    httpStations.push_back(s);
+    schedule(t0 + httpPhase(rng), &HttpStation::tick, s, 0);
+  }
+
+  std::uniform_int_distribution<uint64_t> mqttPhase(0, (uint64_t)opt.mqttIntervalMs * 1000);
+  for (int i = 0; i < opt.mqttStations; i++) {
+    MqttStation* s = new MqttStation(opt.firstId + opt.stations + i);
+    mqttStations.push_back(s);
+    s->open();
+    schedule(t0 + mqttPhase(rng), &MqttStation::tick, s, 0);
+  }
+
+  for (int i = 0; i < opt.coapStations; i++) {
+    CoapStation* s = new CoapStation(opt.firstId + opt.stations + opt.mqttStations + i);
+    coapStations.push_back(s);
+    schedule(t0 + httpPhase(rng), &CoapStation::tick, s, 0);
+  }
+
+  if (opt.cmdRate > 0) {
+    for (int i = 0; i < 64; i++) commandPosts.push_back(new CommandPost());
+    if (!mqttStations.empty()) {
+      commander = new MqttCommander();
+      commander->open();
+    }
+    schedule(t0 + 1000000, &commandTick, nullptr, 0);
+  }
+
+  printf("loadgen: %d HTTP + %d MQTT + %d CoAP stations, report every %d ms, %.1f cmd/s, %d s\n",
+         opt.stations, opt.mqttStations, opt.coapStations, opt.intervalMs, opt.cmdRate, opt.durationS);
+
+  uint64_t end = t0 + (uint64_t)opt.durationS * 1000000;
+  uint64_t nextProgress = t0 + 5000000;
+  epoll_event events[256];
+
+  while (nowUs() < end) {
+    uint64_t now = nowUs();
+    while (!timers.empty() && timers.top().at <= now) {
+      Timer t = timers.top();
+      timers.pop();
+      t.fn(t.ctx, t.gen);
+    }
+
+    int timeoutMs = 100;
+    if (!timers.empty()) {
+      uint64_t wait = timers.top().at > now ? timers.top().at - now : 0;
+      timeoutMs = (int)std::min<uint64_t>(wait / 1000, 100);
+    }
+
+    int n = epoll_wait(epfd, events, 256, timeoutMs);
+    for (int i = 0; i < n; i++) {
+      static_cast<Handler*>(events[i].data.ptr)->onEvent(events[i].events);
+    }
+
+    if (now >= nextProgress) {
+      nextProgress += 5000000;
+      printf("[%4.0fs] telemetry ok=%llu err=%llu  coap ok=%llu err=%llu  mqtt publishes=%llu  "
+             "connect-fail=%llu timeouts=%llu\n",
+             (now - t0) / 1e6, (unsigned long long)statTelemetry.ok, (unsigned long long)statTelemetry.errors,
+             (unsigned long long)statCoapTelemetry.ok, (unsigned long long)statCoapTelemetry.errors,
+             (unsigned long long)statMqttPublish.ok, (unsigned long long)connectFailures,
+             (unsigned long long)timeouts);
+      fflush(stdout);
+    }
+  }
+
+  double seconds = (nowUs() - t0) / 1e6;
+  printf("\n--- Results (%.1f s) ---\n", seconds);
+  statTelemetry.print(seconds);
+  statCommandPost.print(seconds);
+  statHttpDelivery.print(seconds);
+  statMqttPublish.print(seconds);
+  statMqttDelivery.print(seconds);
+  statCoapTelemetry.print(seconds);
+  statCoapDelivery.print(seconds);
+  wireHttp.print(statTelemetry);
+  wireCoap.print(statCoapTelemetry);
+  printf("connect failures: %llu  timeouts: %llu\n",
+         (unsigned long long)connectFailures, (unsigned long long)timeouts);
+  return 0;
+}
@@ -0,0 +1,21 @@
+// Firmware configuration for modbus_bench: include before any firmware header.
+// The Solar path runs on the real (shimmed) bus; the other drivers are off.
+#ifndef BENCH_CONFIG_H
+#define BENCH_CONFIG_H
+
+#include "Config.h"
+
+#undef ENABLE_RELAYS
+#undef ENABLE_SENSORS
+#undef ENABLE_BUTTON
+#undef ENABLE_LED
+#undef ENABLE_SOLAR
+#undef ENABLE_TRACE
+#define ENABLE_RELAYS  0
+#define ENABLE_SENSORS 0
+#define ENABLE_BUTTON  0
+#define ENABLE_LED     0
+#define ENABLE_SOLAR   1
+#define ENABLE_TRACE   0
+
+#endif // BENCH_CONFIG_H
@@ -0,0 +1,139 @@
+// SmartCharge NEO - RS485/Modbus polling benchmark against the EPEVER simulator
+//
+// Runs the firmware's own Solar path (SolarManager -> SolarDriver ->
+// ModbusMaster transaction, firmware/SmartCharge) on the host against a serial
+// device, normally the pty of modbus_sim. Two modes:
+//   job        SolarManager::update() released every --period ms on absolute
+//              times like the Solar job, adaptive polling included (default)
+//   saturate   SolarDriver::readData() back to back: the bus's ceiling
+// Results: transactions per second by result code, bus utilisation (bytes on
+// the wire x 10 bits / baud, and the share of time a transaction holds the
+// half-duplex bus including turnaround and timeouts), and the blocking time of
+// each transaction and job release, worst case included. A timeout blocks the
+// Solar job for ModbusMaster's full 2 s response timeout.
+//
+// Build (Linux, ArduinoJson 7 from the Arduino libraries folder):
+//   g++ -O2 -std=c++17 -I. -Ishim -I../replay/shim -I../../SmartCharge -I$HOME/Arduino/libraries/ArduinoJson/src modbus_bench.cpp -o modbus_bench
+//
+// Examples (simulator: ./modbus_sim --link /tmp/epever --profile profiles/clear-day.txt --loop):
+//   ./modbus_bench /tmp/epever --duration 120              Solar job as on the station
+//   ./modbus_bench /tmp/epever --saturate --duration 10    Transactions/s ceiling
+
+#include "bench_config.h" // First: switches the firmware headers to the bench build
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Managers.h"
+
+// --- Options ---
+struct Options {
+  std::string port;
+  double durationSec = 60;
+  uint32_t periodMs = SOLAR_READ_PERIOD; // Job release period
+  bool saturate = false;
+};
+
+static Options opt;
+
+static double pct(std::vector<uint32_t>& samples, double p) {
+  if (samples.empty()) return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t i = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+  return samples[i] / 1000.0;
+}
+
+static const char* resultName(int code) {
+  switch (code) {
+    case ModbusMaster::ku8MBSuccess:            return "ok";
+    case ModbusMaster::ku8MBIllegalFunction:    return "illegal function";
+    case ModbusMaster::ku8MBIllegalDataAddress: return "illegal address";
+    case ModbusMaster::ku8MBIllegalDataValue:   return "illegal value";
+    case ModbusMaster::ku8MBSlaveDeviceFailure: return "slave failure";
+    case ModbusMaster::ku8MBInvalidSlaveID:     return "wrong slave";
+    case ModbusMaster::ku8MBInvalidFunction:    return "wrong function";
+    case ModbusMaster::ku8MBResponseTimedOut:   return "timeout";
+    case ModbusMaster::ku8MBInvalidCRC:         return "crc";
+    default:                                    return "other";
+  }
+}
+
+static void usage() {
+  fprintf(stderr, "usage: modbus_bench <serial device> [--duration s] [--period ms] [--saturate]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&]() -> const char* {
+      if (i + 1 >= argc) usage();
+      return argv[++i];
+    };
+    if (a == "--duration") opt.durationSec = atof(next());
+    else if (a == "--period") opt.periodMs = atoi(next());
+    else if (a == "--saturate") opt.saturate = true;
+    else if (a[0] != '-' && opt.port.empty()) opt.port = a;
+    else usage();
+  }
+  if (opt.port.empty() || opt.durationSec <= 0 || opt.periodMs == 0) usage();
+
+  benchSerialPath() = opt.port;
+  SolarDriver driver;
+  SolarManager solar(&driver);
+  solar.begin(); // Serial2 at RS485_BAUDRATE, slave MODBUS_SLAVE_ID
+
+  printf("bench: %s, %u baud, slave %d, %s, %.0f s\n", opt.port.c_str(), Serial2.getBaud(), MODBUS_SLAVE_ID,
+         opt.saturate ? "saturate (readData back to back)" : "job (SolarManager::update)", opt.durationSec);
+  if (!opt.saturate) printf("job period %u ms\n", opt.periodMs);
+
+  // Job releases: absolute times like vTaskDelayUntil (an overrun releases at once)
+  std::vector<uint32_t> releaseUs;
+  uint32_t misses = 0;
+  uint64_t t0 = benchNowUs();
+  uint64_t end = t0 + (uint64_t)(opt.durationSec * 1e6);
+  uint64_t release = t0;
+  while (benchNowUs() < end) {
+    uint64_t start = benchNowUs();
+    if (opt.saturate) {
+      driver.readData();
+    } else {
+      benchSleepUntilUs(release);
+      start = benchNowUs();
+      solar.update();
+      release += opt.periodMs * 1000ull;
+    }
+    uint64_t took = benchNowUs() - start;
+    releaseUs.push_back((uint32_t)took);
+    if (!opt.saturate && took > opt.periodMs * 1000ull) misses++;
+  }
+  double seconds = (benchNowUs() - t0) / 1e6;
+
+  ModbusCounters& mb = benchModbus();
+  BusCounters& bus = benchBus();
+  uint64_t busyUs = 0;
+  for (uint32_t us : mb.blockUs) busyUs += us;
+  double wireSec = (bus.txBytes + bus.rxBytes) * rtu::charUs(Serial2.getBaud()) / 1e6;
+
+  printf("transactions %llu (%.1f/s):", (unsigned long long)mb.transactions, mb.transactions / seconds);
+  for (int code = 0; code < 256; code++) {
+    if (mb.results[code]) printf(" %s %llu", resultName(code), (unsigned long long)mb.results[code]);
+  }
+  printf("\nok %.1f/s", mb.results[ModbusMaster::ku8MBSuccess] / seconds);
+  if (!opt.saturate && !releaseUs.empty()) printf(", polled on %.0f%% of job releases", 100.0 * mb.transactions / releaseUs.size());
+  printf("\n");
+  printf("bus utilisation %.2f%% on the wire (tx %llu B, rx %llu B), %.2f%% held by transactions\n",
+         100.0 * wireSec / seconds, (unsigned long long)bus.txBytes, (unsigned long long)bus.rxBytes,
+         100.0 * busyUs / 1e6 / seconds);
+  printf("transaction blocking p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms\n", pct(mb.blockUs, 0.50),
+         pct(mb.blockUs, 0.90), pct(mb.blockUs, 0.99), pct(mb.blockUs, 1.0));
+  printf("%s releases %zu: p50=%.2fms p99=%.2fms max=%.2fms",
+         opt.saturate ? "readData" : "job", releaseUs.size(), pct(releaseUs, 0.50), pct(releaseUs, 0.99),
+         pct(releaseUs, 1.0));
+  if (!opt.saturate) printf(", over the %u ms period %u", opt.periodMs, misses);
+  printf("\n");
+  return 0;
+}
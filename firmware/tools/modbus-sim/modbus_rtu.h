@@ -0,0 +1,36 @@
+// Modbus RTU framing shared by the EPEVER slave simulator and the bench master
+#ifndef MODBUS_RTU_H
+#define MODBUS_RTU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace rtu {
+
+static const uint8_t kReadHoldingRegisters = 0x03;
+static const uint8_t kReadInputRegisters   = 0x04;
+
+static const uint8_t kIllegalFunction    = 0x01;
+static const uint8_t kIllegalDataAddress = 0x02;
+static const uint8_t kIllegalDataValue   = 0x03;
+static const uint8_t kSlaveDeviceFailure = 0x04;
+
+// CRC-16/MODBUS (poly 0xA001 reflected, init 0xFFFF), sent low byte first
+inline uint16_t crc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+// One 8N1 character on the wire (start + 8 data + stop)
+inline uint32_t charUs(uint32_t baud) { return 10000000u / baud; }
+
+// Inter-frame silence (t3.5); fixed at 1750 us above 19200 baud (Modbus over serial line, 2.5.1.1)
+inline uint32_t frameGapUs(uint32_t baud) { return baud > 19200 ? 1750 : 35000000u / baud; }
+
+} // namespace rtu
+
+#endif // MODBUS_RTU_H
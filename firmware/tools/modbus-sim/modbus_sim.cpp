@@ -0,0 +1,518 @@
+// SmartCharge NEO - EPEVER charge controller simulator (Modbus RTU slave on a pty)
+//
+// Creates a pseudo-terminal and answers Modbus RTU requests on it like an
+// EPEVER LS-B/Tracer controller on the RS485 bus: read input registers (0x04)
+// for the real-time block at 0x3100, status at 0x3200, and read holding
+// registers (0x03) for a few settings. Register values follow a profile over
+// time: a script of key frames (interpolated), or the Modbus responses of a
+// station trace (tools/replay --write-bin) played back as recorded.
+//
+// Replies are paced at the configured baud rate, so a master on the other end
+// sees the same wire time as on the real bus. Faults can be injected per
+// request: extra response latency, corrupted CRC, no answer (master timeout)
+// and slave-failure exceptions.
+//
+// Build (Linux):
+//   g++ -O2 -std=c++17 -I../replay/shim -I../../SmartCharge modbus_sim.cpp -o modbus_sim
+//
+// Examples:
+//   ./modbus_sim --link /tmp/epever --profile profiles/clear-day.txt --loop
+//   ./modbus_sim --link /tmp/epever --trace trace.bin --latency 15:10 --crc 2 --timeout 1
+// then point a master at /tmp/epever (115200 8N1, slave 1), e.g. modbus_bench.
+//
+// Profile script: one key frame per line, "<seconds> <field>=<value> ...".
+// Fields are engineering units (pv_v, pv_a, pv_w, batt_v, batt_a, batt_w,
+// load_v, load_a, load_w, batt_temp, dev_temp, soc, batt_status,
+// charge_status) or raw registers ("0x3100=1840"). Values carry over to later
+// frames; pv_w/batt_w default to V x A of the same frame.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TraceRecorder.h" // TraceRecord layout of the recorded profiles
+#include "modbus_rtu.h"
+
+// --- Options ---
+struct Options {
+  std::string link;        // Symlink to the pty slave
+  std::string profile;     // Key frame script
+  std::string trace;       // Recorded profile (.bin)
+  bool loop = false;       // Restart the profile at its end
+  uint32_t baud = 115200;
+  uint8_t slave = 1;
+  uint32_t latencyMs = 0;  // Processing time before the reply
+  uint32_t jitterMs = 0;   // Plus uniform 0..jitter
+  double crcPct = 0;       // Replies sent with a broken CRC
+  double timeoutPct = 0;   // Requests left unanswered
+  double exceptionPct = 0; // Replies with exception 04 (slave device failure)
+  uint32_t seed = 1;
+  int statsSec = 10;       // Periodic counters (0: only on exit)
+};
+
+static Options opt;
+
+static uint64_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static void sleepUs(uint64_t us) {
+  timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+// --- Register Map ---
+struct Field {
+  const char* name;
+  uint16_t reg;
+  bool wide;    // 32-bit, low word first
+  double scale; // Register units per engineering unit
+};
+
+static const Field kFields[] = {
+  { "pv_v",          0x3100, false, 100 },
+  { "pv_a",          0x3101, false, 100 },
+  { "pv_w",          0x3102, true,  100 },
+  { "batt_v",        0x3104, false, 100 },
+  { "batt_a",        0x3105, false, 100 },
+  { "batt_w",        0x3106, true,  100 },
+  { "load_v",        0x310C, false, 100 },
+  { "load_a",        0x310D, false, 100 },
+  { "load_w",        0x310E, true,  100 },
+  { "batt_temp",     0x3110, false, 100 },
+  { "dev_temp",      0x3111, false, 100 },
+  { "soc",           0x311A, false, 1 },
+  { "batt_status",   0x3200, false, 1 },
+  { "charge_status", 0x3201, false, 1 },
+};
+
+static const Field* findField(const std::string& name) {
+  for (const Field& f : kFields) {
+    if (name == f.name) return &f;
+  }
+  return nullptr;
+}
+
+// Key frame: register (low word for wide values) -> value in register units
+struct Value {
+  double v;
+  bool wide;
+};
+typedef std::map<uint16_t, Value> Frame;
+
+struct KeyFrame {
+  double t; // s since start
+  Frame values;
+};
+
+struct Profile {
+  std::vector<KeyFrame> frames;
+  bool interpolate = true;
+
+  double length() const { return frames.empty() ? 0 : frames.back().t; }
+
+  // Register values at t (s)
+  Frame at(double t) const {
+    if (frames.empty()) return Frame();
+    if (opt.loop && length() > 0) t = fmod(t, length());
+    size_t i = 0;
+    while (i + 1 < frames.size() && frames[i + 1].t <= t) i++;
+    if (!interpolate || i + 1 >= frames.size() || t < frames[i].t) return frames[i].values;
+
+    const KeyFrame& a = frames[i];
+    const KeyFrame& b = frames[i + 1];
+    double k = (t - a.t) / (b.t - a.t);
+    Frame out = a.values;
+    for (auto& kv : out) {
+      auto nb = b.values.find(kv.first);
+      if (nb != b.values.end()) kv.second.v += (nb->second.v - kv.second.v) * k;
+    }
+    return out;
+  }
+};
+
+// Registers served without a profile value (a healthy 12 V system at night)
+static Frame defaults() {
+  Frame f;
+  f[0x3104] = { 1280, false }; // 12.80 V
+  f[0x310C] = { 1280, false };
+  f[0x3110] = { 2500, false }; // 25.00 C
+  f[0x3111] = { 2500, false };
+  f[0x311A] = { 80, false };   // 80 %
+  for (const Field& fd : kFields) f.insert({ fd.reg, { 0, fd.wide } });
+  return f;
+}
+
+// Holding registers (0x03): battery type 1 (sealed), capacity 100 Ah
+static const std::map<uint16_t, uint16_t> kHolding = { { 0x9000, 1 }, { 0x9001, 100 } };
+
+static bool loadScript(const std::string& path, Profile& profile) {
+  std::ifstream in(path);
+  if (!in) return false;
+  Frame carry;
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) line.resize(hash);
+    std::istringstream words(line);
+    KeyFrame kf;
+    if (!(words >> kf.t)) continue; // Blank or comment
+    Frame set;
+    std::string word;
+    while (words >> word) {
+      size_t eq = word.find('=');
+      if (eq == std::string::npos) {
+        fprintf(stderr, "%s:%d: expected field=value, got '%s'\n", path.c_str(), lineNo, word.c_str());
+        return false;
+      }
+      std::string name = word.substr(0, eq);
+      double value = atof(word.c_str() + eq + 1);
+      if (name.compare(0, 2, "0x") == 0) {
+        set[(uint16_t)strtoul(name.c_str(), NULL, 16)] = { value, false };
+      } else if (const Field* f = findField(name)) {
+        set[f->reg] = { value * f->scale, f->wide };
+      } else {
+        fprintf(stderr, "%s:%d: unknown field '%s'\n", path.c_str(), lineNo, name.c_str());
+        return false;
+      }
+    }
+    // Power defaults to V x A (registers are x100 each, power x100 too)
+    if (!set.count(0x3102) && (set.count(0x3100) || set.count(0x3101))) {
+      Frame merged = carry;
+      for (auto& kv : set) merged[kv.first] = kv.second;
+      set[0x3102] = { merged[0x3100].v * merged[0x3101].v / 100, true };
+    }
+    if (!set.count(0x3106) && (set.count(0x3104) || set.count(0x3105))) {
+      Frame merged = carry;
+      for (auto& kv : set) merged[kv.first] = kv.second;
+      set[0x3106] = { merged[0x3104].v * merged[0x3105].v / 100, true };
+    }
+    for (auto& kv : set) carry[kv.first] = kv.second;
+    kf.values = carry;
+    if (!profile.frames.empty() && kf.t <= profile.frames.back().t) {
+      fprintf(stderr, "%s:%d: times must increase\n", path.c_str(), lineNo);
+      return false;
+    }
+    profile.frames.push_back(kf);
+  }
+  profile.interpolate = true;
+  return !profile.frames.empty();
+}
+
+// Successful 0x3100 reads of a station trace, at their recorded times
+static bool loadTrace(const std::string& path, Profile& profile) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  std::vector<TraceRecord> records;
+  TraceRecord r;
+  while (in.read((char*)&r, sizeof(r))) records.push_back(r);
+
+  bool haveStart = false;
+  uint32_t t0 = 0;
+  for (size_t i = 0; i + 1 < records.size(); i++) {
+    const TraceRecord& rec = records[i];
+    if (rec.type != TRACE_MODBUS || rec.arg != 0) continue;
+    const TraceRecord* ext = nullptr;
+    for (size_t j = i + 1; j < records.size() && !ext; j++) {
+      if (records[j].type == TRACE_MODBUS_EXT) ext = &records[j];
+      else if (records[j].type == TRACE_MODBUS) break;
+    }
+    if (!ext) continue;
+    if (!haveStart) {
+      t0 = rec.t;
+      haveStart = true;
+    }
+    KeyFrame kf;
+    kf.t = (rec.t - t0) / 1000.0;
+    if (!profile.frames.empty() && kf.t <= profile.frames.back().t) continue;
+    kf.values[0x3100] = { (double)rec.a, false };
+    kf.values[0x3101] = { (double)(rec.b & 0xFFFF), false };
+    kf.values[0x3102] = { (double)((rec.b >> 16) | ((uint32_t)ext->a << 16)), true };
+    kf.values[0x3104] = { (double)(ext->b & 0xFFFF), false };
+    kf.values[0x3105] = { (double)(ext->b >> 16), false };
+    profile.frames.push_back(kf);
+  }
+  profile.interpolate = false; // Hold each response until the next one, as the station saw them
+  return !profile.frames.empty();
+}
+
+// Expand a frame into 16-bit registers
+static std::map<uint16_t, uint16_t> registers(const Frame& frame) {
+  std::map<uint16_t, uint16_t> regs;
+  for (const auto& kv : frame) {
+    double v = std::max(0.0, std::round(kv.second.v));
+    uint32_t raw = v > 4294967295.0 ? 0xFFFFFFFFu : (uint32_t)v;
+    if (kv.second.wide) {
+      regs[kv.first] = raw & 0xFFFF;
+      regs[kv.first + 1] = raw >> 16;
+    } else {
+      regs[kv.first] = raw > 0xFFFF ? 0xFFFF : raw;
+    }
+  }
+  return regs;
+}
+
+// --- Counters ---
+struct Stats {
+  uint64_t frames = 0;      // Complete frames seen on the bus
+  uint64_t badFrames = 0;   // Too short or CRC error (ignored, like a real slave)
+  uint64_t otherSlave = 0;
+  uint64_t requests = 0;
+  uint64_t replies = 0;
+  uint64_t exceptions = 0;  // Protocol exceptions (illegal function/address/value)
+  uint64_t injectedCrc = 0;
+  uint64_t injectedTimeouts = 0;
+  uint64_t injectedFailures = 0;
+  uint64_t bytesIn = 0;
+  uint64_t bytesOut = 0;
+};
+
+static Stats stats;
+static volatile sig_atomic_t stop = 0;
+
+static void printStats(double seconds) {
+  printf("%8.1f s: frames %llu (bad %llu, other slaves %llu), requests %llu, replies %llu, exceptions %llu, "
+         "injected crc %llu timeouts %llu failures %llu, bytes in %llu out %llu\n",
+         seconds, (unsigned long long)stats.frames, (unsigned long long)stats.badFrames,
+         (unsigned long long)stats.otherSlave, (unsigned long long)stats.requests,
+         (unsigned long long)stats.replies, (unsigned long long)stats.exceptions,
+         (unsigned long long)stats.injectedCrc, (unsigned long long)stats.injectedTimeouts,
+         (unsigned long long)stats.injectedFailures, (unsigned long long)stats.bytesIn,
+         (unsigned long long)stats.bytesOut);
+  fflush(stdout);
+}
+
+// --- Slave ---
+static std::mt19937 rng;
+
+static bool chance(double pct) {
+  return pct > 0 && std::uniform_real_distribution<double>(0, 100)(rng) < pct;
+}
+
+static std::vector<uint8_t> exception(uint8_t function, uint8_t code) {
+  stats.exceptions++;
+  return { opt.slave, (uint8_t)(function | 0x80), code };
+}
+
+// Reply PDU+address for one request (CRC appended by the caller), empty: no reply
+static std::vector<uint8_t> handle(const uint8_t* req, size_t len, const Profile& profile, double t) {
+  uint8_t function = req[1];
+  if (function != rtu::kReadInputRegisters && function != rtu::kReadHoldingRegisters) {
+    return exception(function, rtu::kIllegalFunction);
+  }
+  if (len != 8) return exception(function, rtu::kIllegalDataValue);
+  uint16_t start = (req[2] << 8) | req[3];
+  uint16_t count = (req[4] << 8) | req[5];
+  if (count < 1 || count > 125) return exception(function, rtu::kIllegalDataValue);
+
+  std::map<uint16_t, uint16_t> regs;
+  if (function == rtu::kReadInputRegisters) {
+    Frame frame = defaults();
+    for (const auto& kv : profile.at(t)) frame[kv.first] = kv.second;
+    regs = registers(frame);
+  } else {
+    regs = kHolding;
+  }
+
+  std::vector<uint8_t> out = { opt.slave, function, (uint8_t)(count * 2) };
+  for (uint16_t i = 0; i < count; i++) {
+    auto it = regs.find((uint16_t)(start + i));
+    if (it == regs.end()) return exception(function, rtu::kIllegalDataAddress);
+    out.push_back(it->second >> 8);
+    out.push_back(it->second & 0xFF);
+  }
+  return out;
+}
+
+// endUs: when the last request byte was on the wire
+static void onFrame(int fd, const uint8_t* req, size_t len, const Profile& profile, uint64_t startUs, uint64_t endUs) {
+  stats.frames++;
+  if (len < 4 || rtu::crc16(req, len - 2) != (req[len - 2] | (req[len - 1] << 8))) {
+    stats.badFrames++;
+    return;
+  }
+  if (req[0] != opt.slave) {
+    stats.otherSlave++; // Broadcast (0) is write-only: never answered either
+    return;
+  }
+  stats.requests++;
+  if (chance(opt.timeoutPct)) {
+    stats.injectedTimeouts++;
+    return;
+  }
+
+  std::vector<uint8_t> reply;
+  if (chance(opt.exceptionPct)) {
+    stats.injectedFailures++;
+    reply = { opt.slave, (uint8_t)(req[1] | 0x80), rtu::kSlaveDeviceFailure };
+  } else {
+    reply = handle(req, len, profile, (endUs - startUs) / 1e6);
+  }
+  uint16_t crc = rtu::crc16(reply.data(), reply.size());
+  reply.push_back(crc & 0xFF);
+  reply.push_back(crc >> 8);
+  if (chance(opt.crcPct)) {
+    stats.injectedCrc++;
+    reply.back() ^= 0x5A;
+  }
+
+  // t3.5 to see the end of the request, turnaround, then the reply's wire time:
+  // the last byte lands when it would on RS485
+  uint64_t latencyUs = opt.latencyMs * 1000ull;
+  if (opt.jitterMs) latencyUs += std::uniform_int_distribution<uint32_t>(0, opt.jitterMs * 1000)(rng);
+  uint64_t due = endUs + rtu::frameGapUs(opt.baud) + latencyUs + reply.size() * rtu::charUs(opt.baud);
+  uint64_t now = nowUs();
+  if (due > now) sleepUs(due - now);
+
+  if (write(fd, reply.data(), reply.size()) == (ssize_t)reply.size()) {
+    stats.replies++;
+    stats.bytesOut += reply.size();
+  }
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: modbus_sim [--link path] [--profile script | --trace trace.bin] [--loop]\n"
+          "                  [--baud n] [--slave id] [--latency ms[:jitter]] [--crc pct]\n"
+          "                  [--timeout pct] [--exception pct] [--seed n] [--stats sec]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&]() -> const char* {
+      if (i + 1 >= argc) usage();
+      return argv[++i];
+    };
+    if (a == "--link") opt.link = next();
+    else if (a == "--profile") opt.profile = next();
+    else if (a == "--trace") opt.trace = next();
+    else if (a == "--loop") opt.loop = true;
+    else if (a == "--baud") opt.baud = atoi(next());
+    else if (a == "--slave") opt.slave = atoi(next());
+    else if (a == "--latency") {
+      const char* v = next();
+      opt.latencyMs = atoi(v);
+      if (const char* colon = strchr(v, ':')) opt.jitterMs = atoi(colon + 1);
+    }
+    else if (a == "--crc") opt.crcPct = atof(next());
+    else if (a == "--timeout") opt.timeoutPct = atof(next());
+    else if (a == "--exception") opt.exceptionPct = atof(next());
+    else if (a == "--seed") opt.seed = atoi(next());
+    else if (a == "--stats") opt.statsSec = atoi(next());
+    else usage();
+  }
+  if (opt.baud == 0 || (!opt.profile.empty() && !opt.trace.empty())) usage();
+  rng.seed(opt.seed);
+
+  Profile profile;
+  if (!opt.profile.empty() && !loadScript(opt.profile, profile)) {
+    fprintf(stderr, "cannot load profile %s\n", opt.profile.c_str());
+    return 2;
+  }
+  if (!opt.trace.empty() && !loadTrace(opt.trace, profile)) {
+    fprintf(stderr, "no Modbus responses in %s\n", opt.trace.c_str());
+    return 2;
+  }
+
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  const char* ptyName = ptsname(fd);
+
+  // Raw line discipline (no echo, no CR/LF mapping). The simulator keeps the
+  // slave end open too, so masters can come and go without EIO on this side.
+  int keep = open(ptyName, O_RDWR | O_NOCTTY);
+  termios tio;
+  if (keep < 0 || tcgetattr(keep, &tio) != 0) {
+    perror(ptyName);
+    return 1;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(keep, TCSANOW, &tio);
+
+  if (!opt.link.empty()) {
+    unlink(opt.link.c_str());
+    if (symlink(ptyName, opt.link.c_str()) != 0) {
+      perror(opt.link.c_str());
+      return 1;
+    }
+  }
+  printf("EPEVER simulator on %s%s%s, slave %u, %u baud, profile: %s (%zu frames, %.1f s%s)\n",
+         ptyName, opt.link.empty() ? "" : " -> ", opt.link.c_str(), opt.slave, opt.baud,
+         !opt.profile.empty() ? opt.profile.c_str() : !opt.trace.empty() ? opt.trace.c_str() : "defaults",
+         profile.frames.size(), profile.length(), opt.loop ? ", looped" : "");
+  fflush(stdout);
+
+  signal(SIGINT, [](int) { stop = 1; });
+  signal(SIGTERM, [](int) { stop = 1; });
+
+  // A frame ends after t3.5 of silence
+  uint64_t gapUs = rtu::frameGapUs(opt.baud);
+  uint8_t frame[256];
+  size_t frameLen = 0;
+  uint64_t firstByteUs = 0;
+  uint64_t lastByteUs = 0;
+  uint64_t startUs = nowUs();
+  uint64_t nextStatsUs = startUs + opt.statsSec * 1000000ull;
+
+  while (!stop) {
+    pollfd p = { fd, POLLIN, 0 };
+    uint64_t waitUs = frameLen ? gapUs : 100000;
+    timespec ts = { 0, (long)waitUs * 1000 };
+    int n = ppoll(&p, 1, &ts, NULL);
+    uint64_t now = nowUs();
+
+    if (n > 0 && (p.revents & POLLIN)) {
+      uint8_t buf[256];
+      ssize_t got = read(fd, buf, sizeof(buf));
+      if (got > 0) {
+        stats.bytesIn += got;
+        if (!frameLen) firstByteUs = now;
+        for (ssize_t i = 0; i < got; i++) {
+          if (frameLen < sizeof(frame)) frame[frameLen++] = buf[i];
+        }
+        lastByteUs = now;
+      }
+    } else if (frameLen && now - lastByteUs >= gapUs) {
+      // The pty delivers a request at once; on the bus it takes len characters
+      uint64_t wireEndUs = std::max(lastByteUs, firstByteUs + frameLen * rtu::charUs(opt.baud));
+      onFrame(fd, frame, frameLen, profile, startUs, wireEndUs);
+      frameLen = 0;
+    }
+
+    if (opt.statsSec > 0 && now >= nextStatsUs) {
+      printStats((now - startUs) / 1e6);
+      nextStatsUs += opt.statsSec * 1000000ull;
+    }
+  }
+
+  printStats((nowUs() - startUs) / 1e6);
+  if (!opt.link.empty()) unlink(opt.link.c_str());
+  close(keep);
+  close(fd);
+  return 0;
+}
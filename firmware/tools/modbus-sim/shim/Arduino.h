@@ -0,0 +1,162 @@
+// Host stand-in for the Arduino-ESP32 core for modbus_bench: real time, and
+// Serial2 on a tty (the simulator's pty). Writes are paced like the UART: flush()
+// returns once the bytes would have left the wire at the configured baud.
+// Everything else matches tools/replay/shim/Arduino.h.
+#ifndef BENCH_ARDUINO_H
+#define BENCH_ARDUINO_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+
+#include "modbus_rtu.h"
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define SERIAL_8N1 0x800001c
+
+using std::abs;
+
+// --- Clock (monotonic, since the first call) ---
+inline uint64_t benchNowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+inline uint64_t benchEpochUs() {
+  static uint64_t epoch = benchNowUs();
+  return epoch;
+}
+inline uint64_t benchUptimeUs() {
+  uint64_t epoch = benchEpochUs(); // Before now: the first call sets it
+  return benchNowUs() - epoch;
+}
+inline unsigned long micros() { return (unsigned long)benchUptimeUs(); }
+inline unsigned long millis() { return (unsigned long)(benchUptimeUs() / 1000); }
+inline int64_t esp_timer_get_time() { return (int64_t)benchUptimeUs(); }
+inline void benchSleepUntilUs(uint64_t due) {
+  for (uint64_t now = benchNowUs(); now < due; now = benchNowUs()) {
+    uint64_t us = due - now;
+    timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+  }
+}
+inline void delay(unsigned long ms) { benchSleepUntilUs(benchNowUs() + ms * 1000ull); }
+
+// --- GPIO / ADC (only the RS485 DE pin is driven) ---
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return HIGH; }
+inline int analogRead(int) { return 0; }
+inline void analogWrite(int, int) {}
+
+// --- Hardware RNG ---
+inline uint32_t esp_random() {
+  static uint32_t x = 2463534242u; // xorshift32
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+// --- FreeRTOS critical sections (single-threaded bench) ---
+typedef struct { uint32_t owner; uint32_t count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+inline void portENTER_CRITICAL(portMUX_TYPE*) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE*) {}
+
+class String : public std::string {
+  public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+};
+
+// --- Serial2 on a tty ---
+// Bytes on the wire in both directions (bus utilisation)
+struct BusCounters {
+  uint64_t txBytes;
+  uint64_t rxBytes;
+};
+inline BusCounters& benchBus() {
+  static BusCounters counters = { 0, 0 };
+  return counters;
+}
+// Device opened by Serial2.begin() (set by the bench before SolarDriver::begin())
+inline std::string& benchSerialPath() {
+  static std::string path;
+  return path;
+}
+
+class HardwareSerial {
+  private:
+    int _fd = -1;
+    uint32_t _baud = 0;
+    uint64_t _txDoneUs = 0; // Last written byte leaves the wire
+
+  public:
+    void begin(unsigned long baud, uint32_t = SERIAL_8N1, int = -1, int = -1) {
+      _baud = baud;
+      _fd = open(benchSerialPath().c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+      if (_fd < 0) {
+        perror(benchSerialPath().c_str());
+        exit(1);
+      }
+      termios tio;
+      if (tcgetattr(_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(_fd, TCSANOW, &tio);
+      }
+    }
+
+    // A UART FIFO read never blocks; here an empty one waits up to one
+    // character time so ModbusMaster's polling loop does not spin a host core
+    int available() {
+      int n = 0;
+      ioctl(_fd, FIONREAD, &n);
+      if (n > 0) return n;
+      pollfd p = { _fd, POLLIN, 0 };
+      timespec ts = { 0, (long)rtu::charUs(_baud) * 1000 };
+      if (ppoll(&p, 1, &ts, NULL) > 0) ioctl(_fd, FIONREAD, &n);
+      return n;
+    }
+
+    int read() {
+      uint8_t b;
+      if (::read(_fd, &b, 1) != 1) return -1;
+      benchBus().rxBytes++;
+      return b;
+    }
+
+    size_t write(uint8_t b) {
+      if (::write(_fd, &b, 1) != 1) return 0;
+      uint64_t now = benchNowUs();
+      _txDoneUs = (_txDoneUs > now ? _txDoneUs : now) + rtu::charUs(_baud);
+      benchBus().txBytes++;
+      return 1;
+    }
+
+    // Wait for the transmission to complete (what the ESP32 core does)
+    void flush() { benchSleepUntilUs(_txDoneUs); }
+
+    uint32_t getBaud() { return _baud; }
+};
+inline HardwareSerial Serial2;
+
+#endif // BENCH_ARDUINO_H
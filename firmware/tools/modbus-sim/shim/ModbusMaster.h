@@ -0,0 +1,125 @@
+// Host build of the ModbusMaster transaction path (4-20ma/ModbusMaster 2.0.1,
+// the library the firmware links) for modbus_bench. readInputRegisters()
+// follows the library step by step: drain RX, preTransmission, write, flush,
+// postTransmission, then busy-poll the UART until the response is complete,
+// its header or CRC is wrong, or ku16MBResponseTimeout has passed. Each
+// transaction is timed and counted for the bench.
+#ifndef BENCH_MODBUS_MASTER_H
+#define BENCH_MODBUS_MASTER_H
+
+#include <Arduino.h>
+#include <vector>
+
+// Per-transaction results (read by modbus_bench)
+struct ModbusCounters {
+  uint64_t transactions;
+  uint64_t results[256];          // By result code
+  std::vector<uint32_t> blockUs;  // Duration of each transaction
+};
+inline ModbusCounters& benchModbus() {
+  static ModbusCounters counters = {};
+  return counters;
+}
+
+class ModbusMaster {
+  public:
+    static const uint8_t ku8MBIllegalFunction    = 0x01;
+    static const uint8_t ku8MBIllegalDataAddress = 0x02;
+    static const uint8_t ku8MBIllegalDataValue   = 0x03;
+    static const uint8_t ku8MBSlaveDeviceFailure = 0x04;
+    static const uint8_t ku8MBSuccess            = 0x00;
+    static const uint8_t ku8MBInvalidSlaveID     = 0xE0;
+    static const uint8_t ku8MBInvalidFunction    = 0xE1;
+    static const uint8_t ku8MBResponseTimedOut   = 0xE2;
+    static const uint8_t ku8MBInvalidCRC         = 0xE3;
+
+    static const uint16_t ku16MBResponseTimeout = 2000; // ms
+    static const uint8_t ku8MaxBufferSize = 64;
+
+  private:
+    uint8_t _u8MBSlave = 0;
+    HardwareSerial* _serial = nullptr;
+    void (*_preTransmission)() = nullptr;
+    void (*_postTransmission)() = nullptr;
+    uint16_t _u16ResponseBuffer[ku8MaxBufferSize] = {};
+
+    uint8_t transaction(uint8_t function, uint16_t address, uint16_t qty) {
+      uint64_t startUs = benchNowUs();
+      uint8_t adu[256];
+      uint8_t size = 0;
+      adu[size++] = _u8MBSlave;
+      adu[size++] = function;
+      adu[size++] = address >> 8;
+      adu[size++] = address & 0xFF;
+      adu[size++] = qty >> 8;
+      adu[size++] = qty & 0xFF;
+      uint16_t crc = rtu::crc16(adu, size);
+      adu[size++] = crc & 0xFF;
+      adu[size++] = crc >> 8;
+
+      // Flush stale bytes (e.g. a reply that came after the last timeout)
+      while (_serial->read() != -1) {}
+
+      if (_preTransmission) _preTransmission();
+      for (uint8_t i = 0; i < size; i++) _serial->write(adu[i]);
+      size = 0;
+      _serial->flush();
+      if (_postTransmission) _postTransmission();
+
+      uint8_t status = ku8MBSuccess;
+      uint8_t bytesLeft = 8;
+      uint32_t start = millis();
+      while (bytesLeft && !status) {
+        if (_serial->available()) {
+          adu[size++] = _serial->read();
+          bytesLeft--;
+        }
+        if (size == 5) {
+          if (adu[0] != _u8MBSlave) {
+            status = ku8MBInvalidSlaveID;
+            break;
+          }
+          if ((adu[1] & 0x7F) != function) {
+            status = ku8MBInvalidFunction;
+            break;
+          }
+          if (adu[1] & 0x80) {
+            status = adu[2]; // Modbus exception code
+            break;
+          }
+          bytesLeft = adu[2]; // Byte count; 2 were read already, 2 CRC bytes follow
+        }
+        if (millis() - start > ku16MBResponseTimeout) status = ku8MBResponseTimedOut;
+      }
+
+      if (!status && size >= 5) {
+        uint16_t got = rtu::crc16(adu, size - 2);
+        if ((got & 0xFF) != adu[size - 2] || (got >> 8) != adu[size - 1]) status = ku8MBInvalidCRC;
+      }
+      if (!status) {
+        for (uint8_t i = 0; i < (adu[2] >> 1) && i < ku8MaxBufferSize; i++) {
+          _u16ResponseBuffer[i] = (adu[2 * i + 3] << 8) | adu[2 * i + 4];
+        }
+      }
+
+      ModbusCounters& c = benchModbus();
+      c.transactions++;
+      c.results[status]++;
+      c.blockUs.push_back((uint32_t)(benchNowUs() - startUs));
+      return status;
+    }
+
+  public:
+    void begin(uint8_t slave, HardwareSerial& serial) {
+      _u8MBSlave = slave;
+      _serial = &serial;
+    }
+    void preTransmission(void (*fn)()) { _preTransmission = fn; }
+    void postTransmission(void (*fn)()) { _postTransmission = fn; }
+
+    uint8_t readInputRegisters(uint16_t address, uint16_t qty) { return transaction(0x04, address, qty); }
+    uint8_t readHoldingRegisters(uint16_t address, uint16_t qty) { return transaction(0x03, address, qty); }
+    uint16_t getResponseBuffer(uint8_t i) { return i < ku8MaxBufferSize ? _u16ResponseBuffer[i] : 0xFFFF; }
+};
+
+#endif // BENCH_MODBUS_MASTER_H
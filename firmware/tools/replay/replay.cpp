@@ -0,0 +1,362 @@
+// SmartCharge NEO - Host replay of a recorded input trace
+//
+// Feeds the driver inputs recorded on a station (firmware/SmartCharge/TraceRecorder.h)
+// back through the firmware's own PowerManager, InterfaceManager and SolarManager
+// on a simulated clock, as fast as the host runs. The drivers are built with
+// TRACE_REPLAY, so ADC bursts, button edges and Modbus responses come from the
+// trace; server/MQTT commands and capture requests are posted at their recorded
+// time. The state snapshots in the trace are compared against the replayed
+// state, and every output change goes into a digest for regression checks.
+//
+// Build (Linux, ArduinoJson 7 from the Arduino libraries folder):
+//   g++ -O2 -std=c++17 -Ishim -I../../SmartCharge -I$HOME/Arduino/libraries/ArduinoJson/src replay.cpp -o replay
+//
+// Download a trace (send TRACE on the command topic, or a TRACE DeviceCommand),
+// stop mosquitto_sub once the last chunk (offset + records = total) is in:
+//   mosquitto_sub -h <broker> -t smartcharge/station1/trace > trace.jsonl
+//
+// Examples:
+//   ./replay trace.jsonl --events                 Print every output change
+//   ./replay trace.jsonl --write-bin trace.bin    Keep the records as a fixture
+//   ./replay trace.bin --repeat 1000              Benchmark the control loop
+//   ./replay trace.bin --expect 9c1f02a4          Exit 1 if the outputs changed
+
+#include "replay_config.h" // First: switches the firmware headers to replay mode
+
+#include <time.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ArduinoJson.h>
+#include "Managers.h"
+
+// --- Options ---
+struct Options {
+  std::string input;     // .jsonl (MQTT chunks) or .bin (raw records)
+  std::string writeBin;  // Save the reassembled records
+  int repeat = 1;        // Replays of the same trace (benchmark)
+  bool events = false;   // Print output changes
+  std::string expect;    // Expected digest (hex)
+};
+
+static Options opt;
+
+static uint64_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+// --- Trace Loading ---
+static int b64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+static std::vector<uint8_t> b64Decode(const char* s) {
+  std::vector<uint8_t> out;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (; *s; s++) {
+    int v = b64Value(*s);
+    if (v < 0) continue; // Padding
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back((uint8_t)(acc >> bits));
+    }
+  }
+  return out;
+}
+
+// One JSON chunk per line, as published by MQTTService::publishTraceChunk()
+static bool loadChunks(const std::string& path, std::vector<TraceRecord>& records) {
+  std::ifstream in(path);
+  if (!in) return false;
+
+  std::map<uint32_t, std::vector<TraceRecord>> chunks; // offset -> records (duplicates collapse)
+  uint32_t total = 0, missed = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t start = line.find('{'); // Tolerates "topic payload" lines (mosquitto_sub -v)
+    if (start == std::string::npos) continue;
+    JsonDocument doc;
+    if (deserializeJson(doc, line.c_str() + start)) continue;
+    if ((int)(doc["version"] | 0) != TRACE_FORMAT_VERSION) {
+      fprintf(stderr, "skipping chunk with trace format version %d\n", (int)(doc["version"] | 0));
+      continue;
+    }
+    std::vector<uint8_t> raw = b64Decode(doc["data"] | "");
+    std::vector<TraceRecord> recs(raw.size() / sizeof(TraceRecord));
+    memcpy(recs.data(), raw.data(), recs.size() * sizeof(TraceRecord));
+    chunks[doc["offset"] | 0u] = recs;
+    total = doc["total"] | 0u;
+    missed = doc["missed"] | 0u;
+  }
+
+  records.clear();
+  for (auto& c : chunks) {
+    if (c.first != records.size()) {
+      fprintf(stderr, "gap in trace: records %zu-%u missing\n", records.size(), c.first - 1);
+      return false;
+    }
+    records.insert(records.end(), c.second.begin(), c.second.end());
+  }
+  if (records.size() != total) {
+    fprintf(stderr, "incomplete trace: %zu of %u records\n", records.size(), total);
+    return false;
+  }
+  if (missed) printf("note: %u inputs were not recorded during earlier uploads\n", missed);
+  return true;
+}
+
+static bool loadBin(const std::string& path, std::vector<TraceRecord>& records) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  std::vector<char> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  records.resize(raw.size() / sizeof(TraceRecord));
+  memcpy(records.data(), raw.data(), records.size() * sizeof(TraceRecord));
+  return true;
+}
+
+// --- Station ---
+// The Drivers and Managers wired as in SmartCharge.ino
+struct Station {
+  RelayDriver mainRelay;
+  RelayDriver fanRelay;
+  ButtonDriver button;
+  LedDriver led;
+  CurrentSensorDriver acs;
+  SolarDriver solar;
+  PowerManager power;
+  InterfaceManager ui;
+  SolarManager solarManager;
+  TraceRecorder trace;
+
+  Station()
+    : mainRelay(PIN_RELAY_MAIN), fanRelay(PIN_RELAY_FAN), button(PIN_BUTTON_IN),
+      led(PIN_BUTTON_LED), acs(PIN_SENSOR_ACS, ACS_ZERO_VOLTAGE, ACS_SENSITIVITY),
+      power(&mainRelay, &fanRelay, &acs), ui(&button, &led, &power), solarManager(&solar) {}
+};
+
+struct Result {
+  uint32_t ticks = 0;
+  uint32_t simulatedMs = 0;
+  uint32_t commands = 0;
+  uint32_t acks = 0;
+  uint32_t sessions = 0;     // Session start/end events
+  uint32_t checks = 0;       // State snapshots compared
+  uint32_t mismatches = 0;
+  uint32_t firstMismatchMs = 0;
+  uint32_t outputChanges = 0;
+  uint32_t offSchedule = 0;
+  uint32_t unusedAdc = 0;
+  uint32_t unusedModbus = 0;
+  uint32_t mainSwitches = 0;
+  uint32_t fanSwitches = 0;
+  uint32_t digest = 2166136261u; // FNV-1a over output changes, acks and session events
+};
+
+static void mix(Result& r, uint32_t v) {
+  for (int i = 0; i < 4; i++) r.digest = (r.digest ^ ((v >> (i * 8)) & 0xFF)) * 16777619u;
+}
+
+static const char* stateString(uint8_t flags) {
+  static char buf[32];
+  snprintf(buf, sizeof(buf), "%s%s%s%s",
+           flags & TRACE_STATE_REQUESTED ? "requested " : "",
+           flags & TRACE_STATE_CUTOFF ? "cutoff " : "",
+           flags & TRACE_STATE_MAIN ? "main " : "",
+           flags & TRACE_STATE_FAN ? "fan " : "");
+  return buf[0] ? buf : "idle ";
+}
+
+// Replay from the first state snapshot to the last record
+static bool replay(const std::vector<TraceRecord>& records, bool printEvents, Result& res) {
+  size_t first = 0;
+  while (first < records.size() && records[first].type != TRACE_STATE) first++;
+  if (first == records.size()) {
+    fprintf(stderr, "trace has no state snapshot to start from\n");
+    return false;
+  }
+  const TraceRecord& start = records[first];
+  const uint32_t t0 = start.t;
+  const uint32_t tEnd = records.back().t;
+
+  Station* s = new Station();
+  s->trace.load(records.data() + first + 1, records.size() - first - 1);
+  s->power.attachTrace(&s->trace);
+  s->button.attachTrace(&s->trace);
+  s->solar.attachTrace(&s->trace);
+
+  // Recorded state at the start: relays as they were, request re-posted
+  replayClockMs() = t0;
+  s->mainRelay.setState(start.arg & TRACE_STATE_MAIN);
+  s->fanRelay.setState(start.arg & TRACE_STATE_FAN);
+  s->power.begin();
+  s->ui.begin();
+  s->solarManager.begin();
+  if (start.arg & TRACE_STATE_REQUESTED) s->power.post(CMD_CHARGE_ON, CMD_SOURCE_LOCAL);
+
+  uint8_t lastState = start.arg;
+  uint32_t lastSolar = t0 - SOLAR_READ_PERIOD;
+  for (uint32_t now = t0; (int32_t)(now - tEnd) <= 0; now += HARDWARE_LOOP_DELAY) {
+    replayClockMs() = now;
+
+    // Pushed inputs due by this tick
+    TraceRecord rec;
+    while (s->trace.takeDue(TRACE_COMMAND, now, rec)) {
+      s->power.post((CommandAction)(rec.arg & 0x0F), (CommandSource)(rec.arg >> 4));
+      res.commands++;
+    }
+    while (s->trace.takeDue(TRACE_CAPTURE, now, rec)) {
+      if (rec.arg) s->power.triggerCapture(); else s->power.armCapture();
+    }
+
+    // Jobs in Scheduler order
+    s->ui.update();
+    s->power.update();
+    if (now - lastSolar >= SOLAR_READ_PERIOD) {
+      s->solarManager.update();
+      lastSolar = now;
+    }
+    res.ticks++;
+
+    // Outputs: acknowledgements, state changes, and the upload the Services would do
+    CommandAck ack;
+    for (uint8_t src = 0; src < CMD_ACK_SOURCES; src++) {
+      while (s->power.takeAck((CommandSource)src, ack)) {
+        res.acks++;
+        mix(res, now - t0);
+        mix(res, ack.result);
+        if (printEvents) printf("%10u ack %s after %u ms\n", now - t0, ackResultName(ack.result), ack.latencyMs);
+      }
+    }
+    SessionEvent session;
+    while (s->power.takeSessionEvent(session)) {
+      res.sessions++;
+      mix(res, session.atMs - t0);
+      mix(res, session.type);
+      if (printEvents) {
+        if (session.type == SESSION_START) {
+          printf("%10u session start at +%u\n", now - t0, session.atMs - t0);
+        } else {
+          printf("%10u session end at +%u: %.1f s, peak %.2f A, avg %.2f A, %.2f Wh\n", now - t0,
+                 session.atMs - t0, session.durationMs / 1000.0, session.peakAmps, session.avgAmps, session.energyWh);
+        }
+      }
+    }
+    if (s->power.getCapture()->isReady()) s->power.getCapture()->release();
+
+    uint8_t state = s->power.getTraceState();
+    if (state != lastState) {
+      res.outputChanges++;
+      mix(res, now - t0);
+      mix(res, state);
+      if (printEvents) printf("%10u state %s\n", now - t0, stateString(state));
+      lastState = state;
+    }
+
+    // Check points recorded on the device
+    while (s->trace.takeDue(TRACE_STATE, now, rec)) {
+      res.checks++;
+      if (rec.arg != state) {
+        if (!res.mismatches) res.firstMismatchMs = now - t0;
+        res.mismatches++;
+        if (printEvents) {
+          printf("%10u MISMATCH recorded %s", now - t0, stateString(rec.arg));
+          printf("replayed %s\n", stateString(state));
+        }
+      }
+    }
+  }
+
+  res.simulatedMs = tEnd - t0;
+  res.offSchedule = s->trace.getOffSchedule();
+  res.unusedAdc = s->trace.remaining(TRACE_ADC);
+  res.unusedModbus = s->trace.remaining(TRACE_MODBUS);
+  res.mainSwitches = s->power.getMainSwitchCount();
+  res.fanSwitches = s->power.getFanSwitchCount();
+  delete s;
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: replay <trace.jsonl|trace.bin> [--events] [--write-bin file] [--repeat n] [--expect digest]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&]() -> const char* {
+      if (i + 1 >= argc) usage();
+      return argv[++i];
+    };
+    if (a == "--events") opt.events = true;
+    else if (a == "--write-bin") opt.writeBin = next();
+    else if (a == "--repeat") opt.repeat = atoi(next());
+    else if (a == "--expect") opt.expect = next();
+    else if (a[0] != '-' && opt.input.empty()) opt.input = a;
+    else usage();
+  }
+  if (opt.input.empty() || opt.repeat < 1) usage();
+
+  std::vector<TraceRecord> records;
+  bool isBin = opt.input.size() > 4 && opt.input.compare(opt.input.size() - 4, 4, ".bin") == 0;
+  if (!(isBin ? loadBin(opt.input, records) : loadChunks(opt.input, records))) {
+    fprintf(stderr, "cannot load %s\n", opt.input.c_str());
+    return 2;
+  }
+
+  uint32_t counts[TRACE_STATE + 1] = { 0 };
+  for (const TraceRecord& r : records) {
+    if (r.type <= TRACE_STATE) counts[r.type]++;
+  }
+  printf("trace: %zu records over %.1f s (adc %u, button %u, modbus %u, commands %u, capture %u, snapshots %u)\n",
+         records.size(), records.empty() ? 0.0 : (records.back().t - records.front().t) / 1000.0,
+         counts[TRACE_ADC], counts[TRACE_BUTTON], counts[TRACE_MODBUS], counts[TRACE_COMMAND],
+         counts[TRACE_CAPTURE], counts[TRACE_STATE]);
+
+  if (!opt.writeBin.empty()) {
+    std::ofstream out(opt.writeBin, std::ios::binary);
+    out.write((const char*)records.data(), records.size() * sizeof(TraceRecord));
+    printf("wrote %s\n", opt.writeBin.c_str());
+  }
+
+  Result res;
+  uint64_t startUs = nowUs();
+  for (int i = 0; i < opt.repeat; i++) {
+    res = Result();
+    if (!replay(records, opt.events && i == 0, res)) return 2;
+  }
+  double wallMs = (nowUs() - startUs) / 1000.0 / opt.repeat;
+
+  printf("replayed %.1f s in %.3f ms per run (%.0fx real time, %.0f ns per tick, %d runs)\n",
+         res.simulatedMs / 1000.0, wallMs, wallMs > 0 ? res.simulatedMs / wallMs : 0.0,
+         res.ticks ? wallMs * 1e6 / res.ticks : 0.0, opt.repeat);
+  printf("commands %u, acks %u, session events %u, output changes %u, switches main %u fan %u\n",
+         res.commands, res.acks, res.sessions, res.outputChanges, res.mainSwitches, res.fanSwitches);
+  printf("check points %u, mismatches %u", res.checks, res.mismatches);
+  if (res.mismatches) printf(" (first at +%u ms)", res.firstMismatchMs);
+  printf("\nreads off the recorded schedule %u, unconsumed adc %u modbus %u\n", res.offSchedule, res.unusedAdc, res.unusedModbus);
+  printf("digest %08x\n", res.digest);
+
+  if (!opt.expect.empty() && strtoul(opt.expect.c_str(), NULL, 16) != res.digest) {
+    fprintf(stderr, "digest mismatch: expected %s\n", opt.expect.c_str());
+    return 1;
+  }
+  return res.mismatches ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+// Host stand-in for the Arduino-ESP32 core, just enough for the Managers and
+// Drivers under TRACE_REPLAY. Time is the replay's simulated clock: nothing
+// here reads a real pin or sleeps.
+#ifndef REPLAY_ARDUINO_H
+#define REPLAY_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define SERIAL_8N1 0x800001c
+
+using std::abs;
+
+// --- Simulated clock (advanced by replay.cpp) ---
+inline uint32_t& replayClockMs() {
+  static uint32_t now = 0;
+  return now;
+}
+inline unsigned long millis() { return replayClockMs(); }
+inline unsigned long micros() { return replayClockMs() * 1000UL; }
+inline int64_t esp_timer_get_time() { return (int64_t)replayClockMs() * 1000; }
+inline void delay(unsigned long ms) { replayClockMs() += ms; } // Setup-only paths (not replayed)
+
+// --- GPIO / ADC (inputs come from the trace) ---
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return HIGH; }
+inline int analogRead(int) { return 0; }
+inline void analogWrite(int, int) {}
+
+// --- Hardware RNG (session ids): fixed sequence so replays repeat ---
+inline uint32_t esp_random() {
+  static uint32_t x = 2463534242u; // xorshift32
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+// --- FreeRTOS critical sections (single-threaded replay) ---
+typedef struct { uint32_t owner; uint32_t count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+inline void portENTER_CRITICAL(portMUX_TYPE*) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE*) {}
+
+class String : public std::string {
+  public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+};
+
+class HardwareSerial {
+  public:
+    void begin(unsigned long, uint32_t = SERIAL_8N1, int = -1, int = -1) {}
+};
+inline HardwareSerial Serial2;
+
+#endif // REPLAY_ARDUINO_H
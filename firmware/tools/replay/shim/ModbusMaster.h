@@ -0,0 +1,20 @@
+// Host stand-in for ModbusMaster: under TRACE_REPLAY the SolarDriver takes its
+// responses from the trace and never starts a transaction
+#ifndef REPLAY_MODBUS_MASTER_H
+#define REPLAY_MODBUS_MASTER_H
+
+#include <Arduino.h>
+
+class ModbusMaster {
+  public:
+    static const uint8_t ku8MBSuccess = 0x00;
+    static const uint8_t ku8MBResponseTimedOut = 0xE2;
+
+    void begin(uint8_t, HardwareSerial&) {}
+    void preTransmission(void (*)()) {}
+    void postTransmission(void (*)()) {}
+    uint8_t readInputRegisters(uint16_t, uint16_t) { return ku8MBResponseTimedOut; }
+    uint16_t getResponseBuffer(uint8_t) { return 0; }
+};
+
+#endif // REPLAY_MODBUS_MASTER_H
@@ -0,0 +1,15 @@
+// Host stand-in for the NVS Preferences: relay switch counters start at zero
+#ifndef REPLAY_PREFERENCES_H
+#define REPLAY_PREFERENCES_H
+
+#include <stdint.h>
+
+class Preferences {
+  public:
+    bool begin(const char*, bool = false) { return false; }
+    void end() {}
+    uint32_t getUInt(const char*, uint32_t def = 0) { return def; }
+    size_t putUInt(const char*, uint32_t) { return 0; }
+};
+
+#endif // REPLAY_PREFERENCES_H
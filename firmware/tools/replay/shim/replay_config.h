@@ -0,0 +1,23 @@
+// Firmware configuration for the replay build: include before any firmware
+// header. Every input path the trace can carry is switched on; the network
+// Services are not part of the replay.
+#ifndef REPLAY_CONFIG_H
+#define REPLAY_CONFIG_H
+
+#define TRACE_REPLAY 1
+#include "Config.h"
+
+#undef ENABLE_RELAYS
+#undef ENABLE_SENSORS
+#undef ENABLE_BUTTON
+#undef ENABLE_LED
+#undef ENABLE_SOLAR
+#undef ENABLE_TRACE
+#define ENABLE_RELAYS  1
+#define ENABLE_SENSORS 1
+#define ENABLE_BUTTON  1
+#define ENABLE_LED     0
+#define ENABLE_SOLAR   1
+#define ENABLE_TRACE   1
+
+#endif // REPLAY_CONFIG_H
@@ -0,0 +1,15 @@
+// Host stand-in for the ESP32 GPIO registers written by RelayBank::apply()
+#ifndef REPLAY_GPIO_STRUCT_H
+#define REPLAY_GPIO_STRUCT_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t out_w1ts;
+  uint32_t out_w1tc;
+  struct { uint32_t val; } out1_w1ts, out1_w1tc;
+} gpio_dev_t;
+
+inline gpio_dev_t GPIO;
+
+#endif // REPLAY_GPIO_STRUCT_H
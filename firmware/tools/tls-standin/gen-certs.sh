@@ -0,0 +1,24 @@
+#!/bin/sh
+# Generates a throwaway CA and a server certificate for the local TLS stand-ins.
+# Usage: ./gen-certs.sh <server-ip>   (the IP the ESP32 connects to, e.g. 172.20.10.3)
+# Paste out/ca.pem into TLS_CA_CERT in firmware/SmartCharge/Config.h.
+set -e
+
+IP="${1:-127.0.0.1}"
+OUT="$(dirname "$0")/out"
+mkdir -p "$OUT"
+cd "$OUT"
+
+# EC keys keep the ESP32 handshake cheap (ECDSA verify instead of a 2048-bit RSA chain)
+openssl ecparam -name prime256v1 -genkey -noout -out ca.key
+openssl req -x509 -new -key ca.key -sha256 -days 825 -subj "/CN=SmartCharge Local CA" -out ca.pem
+
+openssl ecparam -name prime256v1 -genkey -noout -out server.key
+openssl req -new -key server.key -subj "/CN=$IP" -out server.csr
+printf "subjectAltName=IP:%s,DNS:%s\n" "$IP" "$IP" > server.ext
+openssl x509 -req -in server.csr -CA ca.pem -CAkey ca.key -CAcreateserial \
+  -days 825 -sha256 -extfile server.ext -out server.pem
+rm -f server.csr server.ext
+
+echo "CA:     $OUT/ca.pem"
+echo "Server: $OUT/server.pem / $OUT/server.key (CN=$IP)"
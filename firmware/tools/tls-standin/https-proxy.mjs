@@ -0,0 +1,70 @@
+// Local HTTPS stand-in: terminates TLS and forwards to the Next.js dev server.
+// Logs whether each connection resumed a TLS session (session ID or ticket).
+//
+// Usage: node https-proxy.mjs [listenPort=3443] [target=http://127.0.0.1:3000]
+// Certificates come from ./gen-certs.sh (out/server.pem, out/server.key).
+
+import { readFileSync } from 'node:fs'
+import { request } from 'node:http'
+import { createServer } from 'node:https'
+import { dirname, join } from 'node:path'
+import { fileURLToPath } from 'node:url'
+
+const here = dirname(fileURLToPath(import.meta.url))
+const port = parseInt(process.argv[2] ?? '3443', 10)
+const target = new URL(process.argv[3] ?? 'http://127.0.0.1:3000')
+
+// Node keeps a session-ID cache and issues RFC 5077 tickets by default
+const sessions = new Map()
+let handshakes = 0
+let resumed = 0
+
+const server = createServer(
+  {
+    key: readFileSync(join(here, 'out/server.key')),
+    cert: readFileSync(join(here, 'out/server.pem')),
+    maxVersion: 'TLSv1.2', // Matches the firmware's resumption mode
+  },
+  (req, res) => {
+    const upstream = request(
+      {
+        host: target.hostname,
+        port: target.port,
+        method: req.method,
+        path: req.url,
+        headers: req.headers,
+      },
+      (up) => {
+        res.writeHead(up.statusCode ?? 502, up.headers)
+        up.pipe(res)
+      }
+    )
+    upstream.on('error', () => {
+      res.writeHead(502)
+      res.end()
+    })
+    req.pipe(upstream)
+  }
+)
+
+// Session-ID resumption needs a server-side cache
+server.on('newSession', (id, data, cb) => {
+  sessions.set(id.toString('hex'), data)
+  cb()
+})
+server.on('resumeSession', (id, cb) => {
+  cb(null, sessions.get(id.toString('hex')) ?? null)
+})
+
+server.on('secureConnection', (socket) => {
+  handshakes++
+  if (socket.isSessionReused()) resumed++
+  console.log(
+    `[tls] ${socket.remoteAddress} ${socket.isSessionReused() ? 'RESUMED' : 'FULL'} ` +
+      `(handshakes=${handshakes} resumed=${resumed})`
+  )
+})
+
+server.listen(port, () => {
+  console.log(`HTTPS stand-in on :${port} -> ${target.origin}`)
+})
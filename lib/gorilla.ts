@@ -0,0 +1,86 @@
+// Decoder for the Gorilla-style series blocks produced by the ESP32
+// (firmware/SmartCharge/SeriesCompressor.h). Keep both sides in sync.
+//
+// Bit stream (MSB first):
+//   first sample : 32-bit timestamp (ms), 32-bit raw float
+//   timestamps   : delta-of-delta  '0' | '10'+7 | '110'+9 | '1110'+12 | '1111'+32 bits
+//   values       : XOR with previous '0' | '10' + bits in previous window
+//                  | '11' + 5-bit leading zeros + 5-bit (length - 1) + meaningful bits
+
+export interface SeriesSample {
+  t: number // device timestamp (ms)
+  v: number // value
+}
+
+class BitReader {
+  private pos = 0
+
+  constructor(private readonly data: Uint8Array) {}
+
+  readBit(): number {
+    const byte = this.pos >>> 3
+    if (byte >= this.data.length) {
+      throw new Error('Series block truncated')
+    }
+    const bit = (this.data[byte] >>> (7 - (this.pos & 7))) & 1
+    this.pos++
+    return bit
+  }
+
+  readBits(n: number): number {
+    let value = 0
+    for (let i = 0; i < n; i++) {
+      value = ((value << 1) | this.readBit()) >>> 0
+    }
+    return value
+  }
+}
+
+function bitsToFloat(bits: number): number {
+  const view = new DataView(new ArrayBuffer(4))
+  view.setUint32(0, bits >>> 0)
+  return view.getFloat32(0)
+}
+
+function readDeltaOfDelta(reader: BitReader): number {
+  if (reader.readBit() === 0) return 0
+  if (reader.readBit() === 0) return reader.readBits(7) - 63
+  if (reader.readBit() === 0) return reader.readBits(9) - 255
+  if (reader.readBit() === 0) return reader.readBits(12) - 2047
+  return reader.readBits(32) | 0
+}
+
+// Decode `count` samples from one block
+export function decodeSeriesBlock(data: Uint8Array, count: number): SeriesSample[] {
+  const samples: SeriesSample[] = []
+  if (count <= 0) return samples
+
+  const reader = new BitReader(data)
+  let ts = reader.readBits(32)
+  let bits = reader.readBits(32)
+  samples.push({ t: ts, v: bitsToFloat(bits) })
+
+  let delta = 0
+  let leading = 0
+  let trailing = 0
+
+  for (let i = 1; i < count; i++) {
+    delta = (delta + readDeltaOfDelta(reader)) | 0
+    ts = (ts + delta) >>> 0
+
+    if (reader.readBit() === 1) {
+      if (reader.readBit() === 1) {
+        leading = reader.readBits(5)
+        const length = reader.readBits(5) + 1
+        trailing = 32 - leading - length
+      }
+      const meaningful = reader.readBits(32 - leading - trailing)
+      const xor = trailing >= 32 ? 0 : (meaningful << trailing) >>> 0
+      bits = (bits ^ xor) >>> 0
+    }
+
+    samples.push({ t: ts, v: bitsToFloat(bits) })
+  }
+
+  return samples
+}
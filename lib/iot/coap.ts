@@ -0,0 +1,166 @@
+// CoAP (RFC 7252) message codec for the telemetry gateway (scripts/coap-gateway.ts),
+// with the Block1 option of block-wise transfers (RFC 7959). The firmware side
+// is firmware/SmartCharge/Coap.h; keep both in sync.
+//
+// Message: Ver(2) T(2) TKL(4) | Code (class.detail, 3+5 bits) | Message ID (16)
+//          | Token (0-8 bytes) | Options (delta-encoded) | 0xFF | Payload
+
+export const CoapType = {
+  CON: 0,
+  NON: 1,
+  ACK: 2,
+  RST: 3,
+} as const
+
+export const coapCode = (cls: number, detail: number) => (cls << 5) | detail
+
+export const CoapCode = {
+  EMPTY: 0,
+  POST: coapCode(0, 2),
+  CHANGED: coapCode(2, 4),
+  CONTINUE: coapCode(2, 31),
+  BAD_REQUEST: coapCode(4, 0),
+  UNAUTHORIZED: coapCode(4, 1),
+  FORBIDDEN: coapCode(4, 3),
+  NOT_FOUND: coapCode(4, 4),
+  METHOD_NOT_ALLOWED: coapCode(4, 5),
+  REQUEST_ENTITY_INCOMPLETE: coapCode(4, 8),
+  REQUEST_ENTITY_TOO_LARGE: coapCode(4, 13),
+  UNSUPPORTED_CONTENT_FORMAT: coapCode(4, 15),
+  INTERNAL_SERVER_ERROR: coapCode(5, 0),
+} as const
+
+export const CoapOption = {
+  URI_PATH: 11,
+  CONTENT_FORMAT: 12,
+  URI_QUERY: 15,
+  BLOCK1: 27,
+  SIZE1: 60,
+} as const
+
+export const COAP_FORMAT_JSON = 50
+
+export interface CoapOptionValue {
+  number: number
+  value: Buffer
+}
+
+export interface CoapMessage {
+  type: number
+  code: number
+  messageId: number
+  token: Buffer
+  options: CoapOptionValue[]
+  payload: Buffer
+}
+
+export interface Block1 {
+  num: number
+  more: boolean
+  szx: number // Block size = 2^(szx + 4), 16..1024 bytes
+}
+
+export function parseCoap(buf: Buffer): CoapMessage {
+  if (buf.length < 4) throw new Error('CoAP message too short')
+  const version = buf[0] >> 6
+  if (version !== 1) throw new Error(`Unsupported CoAP version ${version}`)
+  const type = (buf[0] >> 4) & 0x03
+  const tkl = buf[0] & 0x0f
+  if (tkl > 8 || 4 + tkl > buf.length) throw new Error('Invalid token length')
+
+  const msg: CoapMessage = {
+    type,
+    code: buf[1],
+    messageId: buf.readUInt16BE(2),
+    token: buf.subarray(4, 4 + tkl),
+    options: [],
+    payload: Buffer.alloc(0),
+  }
+
+  let pos = 4 + tkl
+  let number = 0
+  while (pos < buf.length) {
+    if (buf[pos] === 0xff) {
+      msg.payload = buf.subarray(pos + 1)
+      if (msg.payload.length === 0) throw new Error('Payload marker without payload')
+      break
+    }
+    let delta = buf[pos] >> 4
+    let length = buf[pos] & 0x0f
+    pos++
+    const extended = (nibble: number): number => {
+      if (nibble === 13) return buf[pos++] + 13
+      if (nibble === 14) {
+        const v = buf.readUInt16BE(pos) + 269
+        pos += 2
+        return v
+      }
+      if (nibble === 15) throw new Error('Reserved option nibble')
+      return nibble
+    }
+    delta = extended(delta)
+    length = extended(length)
+    if (pos + length > buf.length) throw new Error('Option overruns message')
+    number += delta
+    msg.options.push({ number, value: buf.subarray(pos, pos + length) })
+    pos += length
+  }
+  return msg
+}
+
+function optionHeader(value: number): { nibble: number; ext: number[] } {
+  if (value < 13) return { nibble: value, ext: [] }
+  if (value < 269) return { nibble: 13, ext: [value - 13] }
+  return { nibble: 14, ext: [(value - 269) >> 8, (value - 269) & 0xff] }
+}
+
+export function serializeCoap(msg: CoapMessage): Buffer {
+  const parts: Buffer[] = [
+    Buffer.from([
+      0x40 | (msg.type << 4) | msg.token.length,
+      msg.code,
+      msg.messageId >> 8,
+      msg.messageId & 0xff,
+    ]),
+    msg.token,
+  ]
+  let last = 0
+  for (const opt of [...msg.options].sort((a, b) => a.number - b.number)) {
+    const delta = optionHeader(opt.number - last)
+    const length = optionHeader(opt.value.length)
+    parts.push(Buffer.from([(delta.nibble << 4) | length.nibble, ...delta.ext, ...length.ext]), opt.value)
+    last = opt.number
+  }
+  if (msg.payload.length > 0) parts.push(Buffer.from([0xff]), msg.payload)
+  return Buffer.concat(parts)
+}
+
+// Minimal-length unsigned integer option value (0 -> empty)
+export function uintOption(value: number): Buffer {
+  const bytes: number[] = []
+  for (let v = value; v > 0; v = Math.floor(v / 256)) bytes.unshift(v & 0xff)
+  return Buffer.from(bytes)
+}
+
+export function readUintOption(value: Buffer): number {
+  return value.reduce((acc, b) => acc * 256 + b, 0)
+}
+
+export function getOption(msg: CoapMessage, number: number): Buffer | undefined {
+  return msg.options.find((o) => o.number === number)?.value
+}
+
+export function getOptionStrings(msg: CoapMessage, number: number): string[] {
+  return msg.options.filter((o) => o.number === number).map((o) => o.value.toString('utf8'))
+}
+
+export function parseBlock1(value: Buffer): Block1 {
+  const v = readUintOption(value)
+  return { num: Math.floor(v / 16), more: (v & 0x08) !== 0, szx: v & 0x07 }
+}
+
+export function block1Option(block: Block1): Buffer {
+  return uintOption(block.num * 16 + (block.more ? 0x08 : 0) + block.szx)
+}
+
+export const blockSize = (szx: number) => 1 << (szx + 4)
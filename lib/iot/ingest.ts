@@ -0,0 +1,380 @@
+// 设备遥测的校验与入库, HTTP 路由 (app/api/iot/stations/[id]/route.ts)
+// 与 CoAP 网关 (scripts/coap-gateway.ts) 共用, 两种传输方式行为一致
+
+import { prisma } from '@/lib/prisma'
+import { Prisma, StationStatus, TelemetryData } from '@prisma/client'
+import { z } from 'zod'
+import { decodeSeriesBlock } from '@/lib/gorilla'
+
+// 单通道在一个上报窗口内的统计量 (设备端按采样率计算)
+const windowStatsSchema = z.object({
+  n: z.number().int().min(1),
+  min: z.number(),
+  max: z.number(),
+  mean: z.number(),
+  var: z.number().min(0),
+  p50: z.number(),                                      // 流式估计 (P²)
+  p95: z.number(),
+})
+
+type WindowStats = z.infer<typeof windowStatsSchema>
+
+// IoT 数据验证 schema
+export const iotDataSchema = z.object({
+  // 传感器数据
+  voltage: z.number().min(0).max(500).optional(),      // 电压 V
+  current: z.number().min(-10).max(200).optional(),    // 电流 A (允许负值用于校准)
+  power: z.number().min(-10).max(100).optional(),      // 功率 kW
+  temperature: z.number().min(-40).max(100).optional(), // 温度 °C
+
+  // 太阳能数据 (来自 ESP32 EPEVER 控制器)
+  pvPower: z.number().min(0).max(10000).optional(),    // 光伏功率 W
+  battVoltage: z.number().min(0).max(60).optional(),   // 电池电压 V
+
+  // 可选：直接更新状态
+  status: z.enum(['AVAILABLE', 'OCCUPIED', 'RESERVED', 'MAINTENANCE', 'FAULT']).optional(),
+
+  // 设备标识 (用于验证)
+  deviceId: z.string().optional(),
+
+  // 设备时间 (SNTP 校准的设备时钟, 见 firmware DeviceClock.h)
+  timestamp: z.number().int().positive().optional(),    // 本条数据的采样时间 (Unix ms)
+  clockMs: z.number().int().positive().optional(),      // uptimeMs 时刻的设备时间 (Unix ms)
+
+  // 压缩的高分辨率时间序列 (Gorilla 编码, 见 lib/gorilla.ts)
+  uptimeMs: z.number().int().min(0).optional(),         // 设备发送时的 millis()
+  series: z.array(z.object({
+    channel: z.enum(['current', 'pvPower', 'battVoltage']),
+    count: z.number().int().min(1).max(4096),
+    data: z.string().max(8192),                         // base64
+  })).max(8).optional(),
+
+  // 命令确认: 继电器实际动作后由设备回报
+  acks: z.array(z.object({
+    commandId: z.string().min(1).max(64),
+    result: z.enum(['APPLIED', 'SUPERSEDED', 'REJECTED']),
+    latencyMs: z.number().int().min(0),               // 设备收到命令 -> 继电器动作
+    ageMs: z.number().int().min(0),                   // 动作发生在发送前多久
+  })).max(16).optional(),
+
+  // 设备端检测的充电会话事件 (滤波电流 + 迟滞 + 最短持续时间), 按发生顺序
+  sessions: z.array(z.object({
+    id: z.string().regex(/^[0-9a-f]{8}$/),              // 设备生成, 配对 START 与 END
+    event: z.enum(['START', 'END']),
+    ageMs: z.number().int().min(0),                   // 事件发生在发送前多久
+    durationMs: z.number().int().min(0).optional(),   // 以下仅 END
+    peakA: z.number().min(0).max(200).optional(),     // 峰值电流 A
+    avgA: z.number().min(0).max(200).optional(),      // 时间加权平均电流 A
+    energyWh: z.number().min(0).optional(),           // 电能 Wh (设备按标称电压计算)
+  })).max(8).optional(),
+
+  // 上报窗口统计 (两次上报之间的全部采样)
+  agg: z.object({
+    current: windowStatsSchema.optional(),
+    pvPower: windowStatsSchema.optional(),
+    battVoltage: windowStatsSchema.optional(),
+  }).optional(),
+})
+
+type SeriesChannel = 'current' | 'pvPower' | 'battVoltage'
+
+// 设备时间的可信范围: 比接收时间最多早 5 分钟 (重传), 最多晚 30 秒 (时钟误差)
+const DEVICE_CLOCK_MAX_AGE_MS = 5 * 60_000
+const DEVICE_CLOCK_MAX_AHEAD_MS = 30_000
+
+// 重启检测: uptime 与按服务器时间推算的值相差超过此值, 视为设备重启
+// (覆盖两次上报的网络延迟差; millis() 约 49.7 天回绕一次, 按 32 位取模比较)
+const UPTIME_MAX_DRIFT_MS = 60_000
+const UPTIME_MODULUS = 2 ** 32
+
+// 设备时间是否可用 (未同步或明显错误时退回服务器接收时间)
+function isPlausibleDeviceTime(ms: number, receivedAt: number): boolean {
+  return ms >= receivedAt - DEVICE_CLOCK_MAX_AGE_MS && ms <= receivedAt + DEVICE_CLOCK_MAX_AHEAD_MS
+}
+
+// 解码时间序列块, 用设备 uptime 把设备 millis 换算为绝对时间
+// reference: uptimeMs 时刻对应的时间 (设备时钟或服务器接收时间)
+// 块损坏或截断时抛出异常 (调用方在写库前解码)
+function decodeSeries(
+  stationId: number,
+  uptimeMs: number,
+  reference: number,
+  series: { channel: SeriesChannel; count: number; data: string }[]
+) {
+  return series.flatMap(({ channel, count, data }) =>
+    decodeSeriesBlock(Buffer.from(data, 'base64'), count).map((sample) => {
+      const row: Prisma.TelemetryDataCreateManyInput = {
+        stationId,
+        source: 'SERIES', // 只有本通道一列, 不是完整快照
+        // millis() 为 32 位无符号数, 差值按 32 位回绕处理
+        timestamp: new Date(reference - ((uptimeMs - sample.t) >>> 0)),
+      }
+      row[channel] = sample.v
+      return row
+    })
+  )
+}
+
+// 设备是否在上次上报后重启: 上报的 uptime 比上次 uptime 加上经过的服务器时间明显要小
+function isRebooted(
+  uptimeMs: number,
+  receivedAt: number,
+  last: { lastUptimeMs: number | null; lastPing: Date | null }
+): boolean {
+  if (last.lastUptimeMs === null || last.lastPing === null) return false
+  const expected = last.lastUptimeMs + (receivedAt - last.lastPing.getTime())
+  const drift = (((expected - uptimeMs) % UPTIME_MODULUS) + UPTIME_MODULUS) % UPTIME_MODULUS
+  return drift > UPTIME_MAX_DRIFT_MS && drift < UPTIME_MODULUS - UPTIME_MAX_DRIFT_MS
+}
+
+// 验证 API 密钥 (HTTP: x-api-key 头, CoAP: Uri-Query key=)
+export function isValidApiKey(apiKey: string | null): boolean {
+  const validKey = process.env.IOT_API_KEY
+
+  // 如果未配置 IOT_API_KEY，开发环境下允许通过
+  if (!validKey && process.env.NODE_ENV === 'development') {
+    return true
+  }
+
+  return apiKey === validKey
+}
+
+// 根据传感器数据自动推断充电桩状态
+// 有窗口统计时按整个窗口判断, 不再只看上报前的瞬时值
+function inferStatus(data: {
+  current?: number
+  voltage?: number
+  power?: number
+  agg?: { current?: WindowStats }
+}): StationStatus | null {
+  const window = data.agg?.current
+  // 窗口内至少 5% 的采样 > 1A (或瞬时电流 > 1A)，认为正在充电
+  if (window ? window.p95 > 1 : data.current && data.current > 1) {
+    return 'OCCUPIED'
+  }
+  // 如果有电压但无电流 (整个窗口都 < 0.5A)，认为空闲
+  const idle = window ? window.max < 0.5 : !data.current || data.current < 0.5
+  if (data.voltage && data.voltage > 100 && idle) {
+    return 'AVAILABLE'
+  }
+  // 如果电压过低，可能故障
+  if (data.voltage && data.voltage < 100) {
+    return 'FAULT'
+  }
+  return null
+}
+
+export type IngestResult =
+  | {
+      ok: false
+      status: 400 | 403 | 404
+      error: string
+      details?: z.ZodError['issues']
+    }
+  | {
+      ok: true
+      telemetry: TelemetryData
+      station: { id: number; status: StationStatus; lastPing: Date | null }
+      command: string             // 'NONE' 表示无待处理命令
+      commandId: string | null    // 设备在确认中回传
+    }
+
+// 保存一次上报并取出下一条待处理命令 (标记为 SENT)
+// 数据库错误直接抛出, 由调用方返回服务器错误
+export async function ingestTelemetry(stationId: number, body: unknown): Promise<IngestResult> {
+  const parsed = iotDataSchema.safeParse(body)
+  if (!parsed.success) {
+    return { ok: false, status: 400, error: 'Validation failed', details: parsed.error.issues }
+  }
+  const validated = parsed.data
+
+  if (validated.series && validated.uptimeMs === undefined) {
+    return { ok: false, status: 400, error: 'uptimeMs is required with series' }
+  }
+  if (validated.clockMs !== undefined && validated.uptimeMs === undefined) {
+    return { ok: false, status: 400, error: 'uptimeMs is required with clockMs' }
+  }
+
+  // 时间基准: 优先使用设备时钟, 网络延迟和重传不再影响数据时间
+  const receivedAt = Date.now()
+  const clockMs = validated.clockMs
+  const reference =
+    clockMs !== undefined && isPlausibleDeviceTime(clockMs, receivedAt) ? clockMs : receivedAt
+  const sampledAt =
+    validated.timestamp !== undefined && isPlausibleDeviceTime(validated.timestamp, receivedAt)
+      ? new Date(validated.timestamp)
+      : undefined
+
+  // 先解码全部序列: 损坏的块返回 400, 不会在写入一半后失败 (设备收到 5xx 会重发同一上报)
+  let seriesRows: Prisma.TelemetryDataCreateManyInput[] = []
+  if (validated.series && validated.series.length > 0 && validated.uptimeMs !== undefined) {
+    try {
+      seriesRows = decodeSeries(stationId, validated.uptimeMs, reference, validated.series)
+    } catch (error) {
+      return { ok: false, status: 400, error: `Invalid series block: ${(error as Error).message}` }
+    }
+  }
+
+  // 检查充电桩是否存在
+  const station = await prisma.chargingStation.findUnique({
+    where: { id: stationId },
+  })
+
+  if (!station) {
+    return { ok: false, status: 404, error: 'Station not found' }
+  }
+
+  // 可选：验证设备 ID
+  if (validated.deviceId && station.deviceId !== validated.deviceId) {
+    return { ok: false, status: 403, error: 'Device ID mismatch' }
+  }
+
+  // 重启前未结束的会话不会再收到 END (设备端会话状态在内存中), 以重启时间关闭
+  const rebootedAt =
+    validated.uptimeMs !== undefined && isRebooted(validated.uptimeMs, receivedAt, station)
+      ? new Date(reference - validated.uptimeMs)
+      : null
+
+  // 遥测、序列、命令确认和会话在同一事务中写入: 要么全部保存, 要么全部不保存
+  const telemetry = await prisma.$transaction(async (tx) => {
+    // 保存遥测数据 (包括太阳能数据)
+    const telemetry = await tx.telemetryData.create({
+      data: {
+        stationId,
+        voltage: validated.voltage,
+        current: validated.current,
+        power: validated.power,
+        temperature: validated.temperature,
+        pvPower: validated.pvPower,
+        battVoltage: validated.battVoltage,
+        aggregates: validated.agg,
+        timestamp: sampledAt, // 无设备时间时使用默认值 now()
+      },
+    })
+
+    // 保存压缩上传的高分辨率序列
+    if (seriesRows.length > 0) {
+      await tx.telemetryData.createMany({ data: seriesRows })
+    }
+
+    // 处理命令确认 (只更新本站已发送的命令)
+    for (const ack of validated.acks ?? []) {
+      await tx.deviceCommand.updateMany({
+        where: { id: ack.commandId, stationId, status: 'SENT' },
+        data: {
+          status: ack.result === 'APPLIED' ? 'ACKNOWLEDGED' : ack.result,
+          ackedAt: new Date(reference - ack.ageMs),
+          actuationMs: ack.latencyMs,
+        },
+      })
+    }
+
+    if (rebootedAt) {
+      await tx.chargingSession.updateMany({
+        where: {
+          stationId,
+          deviceRef: { startsWith: `${stationId}:` },
+          endTime: null,
+          startTime: { lt: rebootedAt },
+        },
+        data: { endTime: rebootedAt },
+      })
+    }
+
+    // 处理会话事件: 以 deviceRef 幂等写入, 重发的上报不会产生重复会话
+    for (const event of validated.sessions ?? []) {
+      const deviceRef = `${stationId}:${event.id}`
+      const at = new Date(reference - event.ageMs)
+      if (event.event === 'START') {
+        // 同一时间只有一个会话: 本站更早的未结束会话的 END 已丢失, 以新会话开始时间关闭
+        await tx.chargingSession.updateMany({
+          where: {
+            stationId,
+            deviceRef: { startsWith: `${stationId}:`, not: deviceRef },
+            endTime: null,
+            startTime: { lt: at },
+          },
+          data: { endTime: at },
+        })
+        await tx.chargingSession.upsert({
+          where: { deviceRef },
+          create: { stationId, deviceRef, startTime: at },
+          update: {},
+        })
+      } else {
+        const summary = {
+          endTime: at,
+          energyDelivered: event.energyWh !== undefined ? event.energyWh / 1000 : undefined, // kWh
+          peakCurrent: event.peakA,
+          avgCurrent: event.avgA,
+        }
+        // START 丢失时 (例如设备重启前未送达) 由时长补出开始时间
+        await tx.chargingSession.upsert({
+          where: { deviceRef },
+          create: {
+            stationId,
+            deviceRef,
+            startTime: new Date(at.getTime() - (event.durationMs ?? 0)),
+            ...summary,
+          },
+          update: summary,
+        })
+      }
+    }
+
+    return telemetry
+  })
+
+  // 更新充电桩状态和最后心跳时间
+  const newStatus = validated.status || inferStatus(validated)
+  const updateData: { lastPing: Date; lastUptimeMs: number | null; status?: StationStatus } = {
+    lastPing: new Date(receivedAt),
+    lastUptimeMs: validated.uptimeMs ?? null, // 无 uptime 的上报不能作为重启检测的基准
+  }
+  if (newStatus) {
+    updateData.status = newStatus
+  }
+
+  const updatedStation = await prisma.chargingStation.update({
+    where: { id: stationId },
+    data: updateData,
+  })
+
+  // 查找待处理的命令
+  const pendingCommand = await prisma.deviceCommand.findFirst({
+    where: {
+      stationId,
+      status: 'PENDING',
+    },
+    orderBy: {
+      createdAt: 'asc', // 先进先出
+    },
+  })
+
+  // 如果有待处理命令，标记为已发送
+  let command = 'NONE'
+  let commandId: string | null = null
+  if (pendingCommand) {
+    await prisma.deviceCommand.update({
+      where: { id: pendingCommand.id },
+      data: {
+        status: 'SENT',
+        sentAt: new Date(),
+      },
+    })
+    command = pendingCommand.command
+    commandId = pendingCommand.id
+  }
+
+  return {
+    ok: true,
+    telemetry,
+    station: {
+      id: updatedStation.id,
+      status: updatedStation.status,
+      lastPing: updatedStation.lastPing,
+    },
+    command,
+    commandId,
+  }
+}
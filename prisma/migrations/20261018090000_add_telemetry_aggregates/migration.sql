@@ -0,0 +1,2 @@
+-- AlterTable
+ALTER TABLE "telemetry_data" ADD COLUMN     "aggregates" JSONB;
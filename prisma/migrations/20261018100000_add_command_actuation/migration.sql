@@ -0,0 +1,2 @@
+-- AlterTable
+ALTER TABLE "device_commands" ADD COLUMN     "actuationMs" INTEGER;
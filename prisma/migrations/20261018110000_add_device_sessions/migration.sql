@@ -0,0 +1,14 @@
+-- DropForeignKey
+ALTER TABLE "charging_sessions" DROP CONSTRAINT "charging_sessions_userId_fkey";
+
+-- AlterTable
+ALTER TABLE "charging_sessions" ADD COLUMN     "avgCurrent" DOUBLE PRECISION,
+ADD COLUMN     "deviceRef" TEXT,
+ADD COLUMN     "peakCurrent" DOUBLE PRECISION,
+ALTER COLUMN "userId" DROP NOT NULL;
+
+-- CreateIndex
+CREATE UNIQUE INDEX "charging_sessions_deviceRef_key" ON "charging_sessions"("deviceRef");
+
+-- AddForeignKey
+ALTER TABLE "charging_sessions" ADD CONSTRAINT "charging_sessions_userId_fkey" FOREIGN KEY ("userId") REFERENCES "users"("id") ON DELETE CASCADE ON UPDATE CASCADE;
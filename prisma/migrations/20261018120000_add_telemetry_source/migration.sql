@@ -0,0 +1,15 @@
+-- CreateEnum
+CREATE TYPE "TelemetrySource" AS ENUM ('REPORT', 'SERIES');
+
+-- AlterTable
+ALTER TABLE "telemetry_data" ADD COLUMN     "source" "TelemetrySource" NOT NULL DEFAULT 'REPORT';
+
+-- Series samples stored before this column: only their channel column is set
+UPDATE "telemetry_data" SET "source" = 'SERIES' WHERE "aggregates" IS NULL AND "temperature" IS NULL AND (
+  ("current" IS NOT NULL AND "voltage" IS NULL AND "power" IS NULL AND "pvPower" IS NULL AND "battVoltage" IS NULL) OR
+  ("pvPower" IS NOT NULL AND "voltage" IS NULL AND "current" IS NULL AND "power" IS NULL AND "battVoltage" IS NULL) OR
+  ("battVoltage" IS NOT NULL AND "voltage" IS NULL AND "current" IS NULL AND "power" IS NULL AND "pvPower" IS NULL)
+);
+
+-- CreateIndex
+CREATE INDEX "telemetry_data_stationId_source_timestamp_idx" ON "telemetry_data"("stationId", "source", "timestamp");
@@ -0,0 +1,2 @@
+-- AlterTable
+ALTER TABLE "charging_stations" ADD COLUMN     "lastUptimeMs" DOUBLE PRECISION;
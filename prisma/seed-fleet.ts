@@ -0,0 +1,49 @@
+// Seeds a simulated station fleet for firmware/tools/loadgen.
+// Station <id> gets deviceId "esp32-station-<id>", matching the firmware payload.
+//
+// Usage: npx tsx prisma/seed-fleet.ts <count> [firstId]
+
+import { PrismaClient, PowerType } from '@prisma/client'
+
+const prisma = new PrismaClient()
+
+async function main() {
+  const count = parseInt(process.argv[2] ?? '100', 10)
+  const firstId = parseInt(process.argv[3] ?? '1', 10)
+
+  console.log(`🌱 Seeding ${count} simulated stations from id ${firstId}...\n`)
+
+  for (let id = firstId; id < firstId + count; id++) {
+    const deviceId = `esp32-station-${id}`
+    await prisma.chargingStation.upsert({
+      where: { id },
+      update: { deviceId },
+      create: {
+        id,
+        deviceId,
+        name: `Load Test ${id}`,
+        latitude: 48.85 + (id % 100) * 0.001,
+        longitude: 2.35 + Math.floor(id / 100) * 0.001,
+        address: `Simulated station ${id}`,
+        powerType: PowerType.AC_SLOW,
+        maxPower: 7.4,
+      },
+    })
+  }
+
+  // Explicit ids bypass the autoincrement sequence: move it past the fleet
+  await prisma.$executeRawUnsafe(
+    `SELECT setval(pg_get_serial_sequence('charging_stations', 'id'), (SELECT MAX(id) FROM charging_stations))`
+  )
+
+  console.log(`✅ Fleet ready: stations ${firstId}..${firstId + count - 1}`)
+}
+
+main()
+  .catch((e) => {
+    console.error('❌ Error during fleet seeding:', e)
+    process.exit(1)
+  })
+  .finally(async () => {
+    await prisma.$disconnect()
+  })
@@ -0,0 +1,240 @@
+// CoAP/UDP ingest front-end for station telemetry (firmware ENABLE_COAP).
+//
+// POST coap://<host>:5683/iot/stations/<id>?key=<IOT_API_KEY> with the same
+// JSON body as POST /api/iot/stations/<id>, in one datagram or as a Block1
+// transfer. Validation and storage are shared with the HTTP route
+// (lib/iot/ingest.ts). The reply is piggybacked on the ACK: 2.04 Changed,
+// empty when no command is pending, otherwise { command, commandId } like the
+// minimal HTTP response. Retransmitted requests are answered from a cache, so
+// a lost ACK never stores a report twice.
+//
+// Usage: npx tsx scripts/coap-gateway.ts [port]   (default COAP_PORT or 5683)
+
+import dgram from 'node:dgram'
+import { config } from 'dotenv'
+import {
+  type Block1,
+  COAP_FORMAT_JSON,
+  CoapCode,
+  type CoapMessage,
+  CoapOption,
+  CoapType,
+  block1Option,
+  blockSize,
+  getOption,
+  getOptionStrings,
+  parseBlock1,
+  parseCoap,
+  readUintOption,
+  serializeCoap,
+  uintOption,
+} from '../lib/iot/coap'
+
+config({ path: ['.env.local', '.env'] })
+
+const PORT = parseInt(process.argv[2] ?? process.env.COAP_PORT ?? '5683', 10)
+const MAX_BODY_BYTES = 64 * 1024          // series: up to 8 blocks of 8 KB base64
+const EXCHANGE_LIFETIME_MS = 247_000      // RFC 7252 §4.8.2: how long a message ID may be retransmitted
+const TRANSFER_TIMEOUT_MS = 60_000        // Abandoned Block1 transfers
+
+type Ingest = typeof import('../lib/iot/ingest')
+
+interface Transfer {
+  chunks: Buffer[]
+  received: number
+  updatedAt: number
+}
+
+interface Exchange {
+  at: number
+  response?: Buffer // undefined while the request is being processed
+}
+
+const transfers = new Map<string, Transfer>() // endpoint + path -> Block1 body so far
+const exchanges = new Map<string, Exchange>() // endpoint + message ID -> reply
+
+const stats = { requests: 0, blocks: 0, duplicates: 0, reports: 0, errors: 0 }
+
+function reply(
+  req: CoapMessage,
+  code: number,
+  payload: Buffer = Buffer.alloc(0),
+  options: CoapMessage['options'] = []
+): CoapMessage {
+  return {
+    type: req.type === CoapType.CON ? CoapType.ACK : CoapType.NON,
+    code,
+    messageId: req.messageId,
+    token: req.token,
+    options,
+    payload,
+  }
+}
+
+function diagnostic(req: CoapMessage, code: number, message: string): CoapMessage {
+  stats.errors++
+  return reply(req, code, Buffer.from(message)) // Diagnostic payload (RFC 7252 §5.5.2)
+}
+
+const ingestStatusCode: Record<number, number> = {
+  400: CoapCode.BAD_REQUEST,
+  403: CoapCode.FORBIDDEN,
+  404: CoapCode.NOT_FOUND,
+}
+
+async function handleRequest(ingest: Ingest, req: CoapMessage, endpoint: string): Promise<CoapMessage> {
+  if (req.code !== CoapCode.POST) {
+    return diagnostic(req, CoapCode.METHOD_NOT_ALLOWED, 'POST only')
+  }
+
+  const path = getOptionStrings(req, CoapOption.URI_PATH)
+  if (path.length !== 3 || path[0] !== 'iot' || path[1] !== 'stations') {
+    return diagnostic(req, CoapCode.NOT_FOUND, 'Unknown resource')
+  }
+  const stationId = parseInt(path[2], 10)
+  if (isNaN(stationId)) {
+    return diagnostic(req, CoapCode.BAD_REQUEST, 'Invalid station ID')
+  }
+
+  const key = getOptionStrings(req, CoapOption.URI_QUERY).find((q) => q.startsWith('key='))
+  if (!ingest.isValidApiKey(key ? key.slice(4) : null)) {
+    return diagnostic(req, CoapCode.UNAUTHORIZED, 'Invalid API key')
+  }
+
+  const format = getOption(req, CoapOption.CONTENT_FORMAT)
+  if (format && readUintOption(format) !== COAP_FORMAT_JSON) {
+    return diagnostic(req, CoapCode.UNSUPPORTED_CONTENT_FORMAT, 'JSON only')
+  }
+
+  // Block-wise request body (RFC 7959): blocks must arrive in order
+  let body = req.payload
+  const block1Value = getOption(req, CoapOption.BLOCK1)
+  let block: Block1 | undefined
+  if (block1Value) {
+    block = parseBlock1(block1Value)
+    stats.blocks++
+    const transferKey = `${endpoint}/${path.join('/')}`
+    if (block.num === 0) {
+      const size1 = getOption(req, CoapOption.SIZE1)
+      if (size1 && readUintOption(size1) > MAX_BODY_BYTES) {
+        return reply(req, CoapCode.REQUEST_ENTITY_TOO_LARGE, Buffer.alloc(0), [
+          { number: CoapOption.SIZE1, value: uintOption(MAX_BODY_BYTES) },
+        ])
+      }
+      transfers.set(transferKey, { chunks: [], received: 0, updatedAt: Date.now() })
+    }
+
+    const transfer = transfers.get(transferKey)
+    if (!transfer || block.num * blockSize(block.szx) !== transfer.received) {
+      transfers.delete(transferKey)
+      return diagnostic(req, CoapCode.REQUEST_ENTITY_INCOMPLETE, 'Block out of sequence')
+    }
+    transfer.chunks.push(req.payload)
+    transfer.received += req.payload.length
+    transfer.updatedAt = Date.now()
+    if (transfer.received > MAX_BODY_BYTES) {
+      transfers.delete(transferKey)
+      return diagnostic(req, CoapCode.REQUEST_ENTITY_TOO_LARGE, 'Body too large')
+    }
+
+    if (block.more) {
+      return reply(req, CoapCode.CONTINUE, Buffer.alloc(0), [
+        { number: CoapOption.BLOCK1, value: block1Option(block) },
+      ])
+    }
+    body = Buffer.concat(transfer.chunks)
+    transfers.delete(transferKey)
+  }
+
+  let data: unknown
+  try {
+    data = JSON.parse(body.toString('utf8'))
+  } catch {
+    return diagnostic(req, CoapCode.BAD_REQUEST, 'Invalid JSON')
+  }
+
+  const result = await ingest.ingestTelemetry(stationId, data)
+  if (!result.ok) {
+    return diagnostic(req, ingestStatusCode[result.status], result.error)
+  }
+  stats.reports++
+
+  const options: CoapMessage['options'] = []
+  if (block) options.push({ number: CoapOption.BLOCK1, value: block1Option(block) })
+  if (!result.commandId) {
+    return reply(req, CoapCode.CHANGED, Buffer.alloc(0), options) // Common case: no payload
+  }
+  options.push({ number: CoapOption.CONTENT_FORMAT, value: uintOption(COAP_FORMAT_JSON) })
+  const payload = Buffer.from(JSON.stringify({ command: result.command, commandId: result.commandId }))
+  return reply(req, CoapCode.CHANGED, payload, options)
+}
+
+async function main() {
+  const ingest: Ingest = await import('../lib/iot/ingest') // After the environment is loaded
+  const socket = dgram.createSocket('udp4')
+
+  socket.on('message', async (buf, rinfo) => {
+    const endpoint = `${rinfo.address}:${rinfo.port}`
+    let req: CoapMessage
+    try {
+      req = parseCoap(buf)
+    } catch {
+      // Malformed confirmable message: reject it (RFC 7252 §4.2)
+      if (buf.length >= 4 && ((buf[0] >> 4) & 0x03) === CoapType.CON) {
+        socket.send(Buffer.from([0x70, 0, buf[2], buf[3]]), rinfo.port, rinfo.address)
+      }
+      return
+    }
+    if (req.type !== CoapType.CON && req.type !== CoapType.NON) return // ACK/RST: nothing outstanding
+    if (req.code === CoapCode.EMPTY) {
+      // CoAP ping
+      socket.send(serializeCoap({ ...reply(req, CoapCode.EMPTY), type: CoapType.RST, token: Buffer.alloc(0) }), rinfo.port, rinfo.address)
+      return
+    }
+
+    // Retransmission: same reply again, nothing stored twice
+    const exchangeKey = `${endpoint}#${req.messageId}`
+    const seen = exchanges.get(exchangeKey)
+    if (seen) {
+      stats.duplicates++
+      if (seen.response) socket.send(seen.response, rinfo.port, rinfo.address)
+      return
+    }
+    const exchange: Exchange = { at: Date.now() }
+    exchanges.set(exchangeKey, exchange)
+    stats.requests++
+
+    let response: CoapMessage
+    try {
+      response = await handleRequest(ingest, req, endpoint)
+    } catch (error) {
+      console.error('Error processing CoAP telemetry:', error)
+      response = diagnostic(req, CoapCode.INTERNAL_SERVER_ERROR, 'Failed to process IoT data')
+    }
+    exchange.response = serializeCoap(response)
+    socket.send(exchange.response, rinfo.port, rinfo.address)
+  })
+
+  // Forget old exchanges and abandoned transfers
+  setInterval(() => {
+    const now = Date.now()
+    for (const [key, e] of exchanges) if (now - e.at > EXCHANGE_LIFETIME_MS) exchanges.delete(key)
+    for (const [key, t] of transfers) if (now - t.updatedAt > TRANSFER_TIMEOUT_MS) transfers.delete(key)
+  }, 10_000).unref()
+
+  setInterval(() => {
+    console.log(
+      `coap: ${stats.requests} requests (${stats.blocks} blocks, ${stats.duplicates} duplicates), ` +
+        `${stats.reports} reports, ${stats.errors} errors`
+    )
+  }, 60_000).unref()
+
+  socket.bind(PORT, () => {
+    console.log(`📡 CoAP telemetry gateway listening on udp/${PORT}`)
+  })
+}
+
+main().catch((error) => {
+  console.error(error)
+  process.exit(1)
+})